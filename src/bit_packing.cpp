@@ -0,0 +1,245 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bit_packing.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITPACKING_X86
+#include <immintrin.h>
+#endif
+
+namespace badgerdb {
+
+static inline std::uint32_t valueMask(const int bits)
+{
+	return bits == 32 ? ~std::uint32_t(0) : (std::uint32_t(1) << bits) - 1;
+}
+
+// -----------------------------------------------------------------------------
+// Scalar kernels, used when no vector unit is available. Kernels only see bit
+// widths in [1, 32] and whole rows.
+// -----------------------------------------------------------------------------
+
+static void unpackRowsScalar(const std::uint32_t* words, const int rows, const int bits, const std::uint32_t base, std::uint32_t* values)
+{
+	for (int i = 0; i < rows * PACK_LANES; i++)
+	{
+		values[i] = base + unpackValue(words, i, bits);
+	}
+}
+
+static int lessLanesScalar(const std::uint32_t* words, const int row, const int bits, const std::uint32_t value)
+{
+	int mask = 0;
+	for (int lane = 0; lane < PACK_LANES; lane++)
+	{
+		mask |= (unpackValue(words, row * PACK_LANES + lane, bits) < value) << lane;
+	}
+	return mask;
+}
+
+#ifdef BITPACKING_X86
+
+// -----------------------------------------------------------------------------
+// SSE2 kernels. A row is two vectors of four lanes.
+// -----------------------------------------------------------------------------
+
+__attribute__((target("sse2")))
+static inline __m128i unpackHalfSSE2(const std::uint32_t* words, const int word, const int shift, const int bits, const __m128i mask)
+{
+	__m128i v = _mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words + word * PACK_LANES)), _mm_cvtsi32_si128(shift));
+	if (shift + bits > 32)
+	{
+		const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + (word + 1) * PACK_LANES));
+		v = _mm_or_si128(v, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - shift)));
+	}
+	return _mm_and_si128(v, mask);
+}
+
+__attribute__((target("sse2")))
+static void unpackRowsSSE2(const std::uint32_t* words, const int rows, const int bits, const std::uint32_t base, std::uint32_t* values)
+{
+	const __m128i mask = _mm_set1_epi32(valueMask(bits));
+	const __m128i b = _mm_set1_epi32(base);
+	for (int row = 0; row < rows; row++)
+	{
+		const int bit = row * bits;
+		const __m128i lo = unpackHalfSSE2(words, bit / 32, bit % 32, bits, mask);
+		const __m128i hi = unpackHalfSSE2(words + 4, bit / 32, bit % 32, bits, mask);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(values + row * PACK_LANES), _mm_add_epi32(lo, b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(values + row * PACK_LANES + 4), _mm_add_epi32(hi, b));
+	}
+}
+
+__attribute__((target("sse2")))
+static int lessLanesSSE2(const std::uint32_t* words, const int row, const int bits, const std::uint32_t value)
+{
+	// unsigned comparison, as a signed one with the sign bits flipped
+	const __m128i mask = _mm_set1_epi32(valueMask(bits));
+	const __m128i sign = _mm_set1_epi32(0x80000000u);
+	const __m128i v = _mm_xor_si128(_mm_set1_epi32(value), sign);
+	const int bit = row * bits;
+	const __m128i lo = _mm_xor_si128(unpackHalfSSE2(words, bit / 32, bit % 32, bits, mask), sign);
+	const __m128i hi = _mm_xor_si128(unpackHalfSSE2(words + 4, bit / 32, bit % 32, bits, mask), sign);
+	return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, lo))) |
+		   (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, hi))) << 4);
+}
+
+// -----------------------------------------------------------------------------
+// AVX2 kernels, a row per vector
+// -----------------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static inline __m256i unpackRowAVX2(const std::uint32_t* words, const int row, const int bits, const __m256i mask)
+{
+	const int bit = row * bits;
+	const int word = bit / 32;
+	const int shift = bit % 32;
+	__m256i v = _mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + word * PACK_LANES)), _mm_cvtsi32_si128(shift));
+	if (shift + bits > 32)
+	{
+		const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + (word + 1) * PACK_LANES));
+		v = _mm256_or_si256(v, _mm256_sll_epi32(next, _mm_cvtsi32_si128(32 - shift)));
+	}
+	return _mm256_and_si256(v, mask);
+}
+
+__attribute__((target("avx2")))
+static void unpackRowsAVX2(const std::uint32_t* words, const int rows, const int bits, const std::uint32_t base, std::uint32_t* values)
+{
+	const __m256i mask = _mm256_set1_epi32(valueMask(bits));
+	const __m256i b = _mm256_set1_epi32(base);
+	for (int row = 0; row < rows; row++)
+	{
+		const __m256i v = unpackRowAVX2(words, row, bits, mask);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(values + row * PACK_LANES), _mm256_add_epi32(v, b));
+	}
+}
+
+__attribute__((target("avx2")))
+static int lessLanesAVX2(const std::uint32_t* words, const int row, const int bits, const std::uint32_t value)
+{
+	const __m256i mask = _mm256_set1_epi32(valueMask(bits));
+	const __m256i sign = _mm256_set1_epi32(0x80000000u);
+	const __m256i v = _mm256_xor_si256(_mm256_set1_epi32(value), sign);
+	const __m256i d = _mm256_xor_si256(unpackRowAVX2(words, row, bits, mask), sign);
+	return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, d)));
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Runtime dispatch. The kernels are picked once, on the first decode, by the
+// initializer of a function-local static.
+// -----------------------------------------------------------------------------
+
+typedef void (*UnpackRowsFn)(const std::uint32_t*, const int, const int, const std::uint32_t, std::uint32_t*);
+typedef int (*LessLanesFn)(const std::uint32_t*, const int, const int, const std::uint32_t);
+
+struct PackingKernels
+{
+	UnpackRowsFn unpackRows;
+	LessLanesFn lessLanes;
+
+	PackingKernels()
+		: unpackRows( unpackRowsScalar ), lessLanes( lessLanesScalar )
+	{
+#ifdef BITPACKING_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2"))
+		{
+			unpackRows = unpackRowsSSE2;
+			lessLanes = lessLanesSSE2;
+		}
+		if (__builtin_cpu_supports("avx2"))
+		{
+			unpackRows = unpackRowsAVX2;
+			lessLanes = lessLanesAVX2;
+		}
+#endif
+	}
+};
+
+static const PackingKernels &kernels()
+{
+	static const PackingKernels selected;
+	return selected;
+}
+
+// -----------------------------------------------------------------------------
+// Columns
+// -----------------------------------------------------------------------------
+
+void packColumn(const std::uint32_t* values, const int numValues, const int bits, std::uint32_t* words)
+{
+	std::fill(words, words + packedWords(numValues, bits), 0);
+	if (bits == 0)
+	{
+		return;
+	}
+	for (int i = 0; i < numValues; i++)
+	{
+		const int lane = i % PACK_LANES;
+		const int bit = (i / PACK_LANES) * bits;
+		const int word = bit / 32;
+		const int shift = bit % 32;
+		words[word * PACK_LANES + lane] |= values[i] << shift;
+		if (shift + bits > 32)
+		{
+			words[(word + 1) * PACK_LANES + lane] |= values[i] >> (32 - shift);
+		}
+	}
+}
+
+void unpackColumn(const std::uint32_t* words, const int numValues, const int bits, const std::uint32_t base, std::uint32_t* values)
+{
+	if (bits == 0)
+	{
+		std::fill(values, values + numValues, base);
+		return;
+	}
+
+	// whole rows go through the kernel, the last partial one value by value
+	const int rows = numValues / PACK_LANES;
+	kernels().unpackRows(words, rows, bits, base, values);
+	for (int i = rows * PACK_LANES; i < numValues; i++)
+	{
+		values[i] = base + unpackValue(words, i, bits);
+	}
+}
+
+int packedLowerBound(const std::uint32_t* words, const int numValues, const int bits, const std::uint32_t value)
+{
+	if (numValues == 0)
+	{
+		return 0;
+	}
+	if (bits == 0)
+	{
+		return value > 0 ? numValues : 0;
+	}
+
+	// the last row starting below value holds the answer, unless it is the first row and
+	// nothing is below value. Every row before it is below value, every row after it is not.
+	int row = 0;
+	int len = (numValues + PACK_LANES - 1) / PACK_LANES;
+	while (len > 1)
+	{
+		const int half = len / 2;
+		row += unpackValue(words, (row + half) * PACK_LANES, bits) < value ? half : 0;
+		len -= half;
+	}
+
+	// lanes past the end of the column hold padding
+	const int valid = std::min(numValues - row * PACK_LANES, PACK_LANES);
+	const int mask = kernels().lessLanes(words, row, bits, value) & ((1 << valid) - 1);
+	return row * PACK_LANES + __builtin_popcount(mask);
+}
+
+}
@@ -0,0 +1,109 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * @brief Number of values a packed column interleaves. Value i goes to lane
+ * i % PACK_LANES, and each lane packs its values one after the other into its
+ * own 32 bit words, which are stored lane by lane. The PACK_LANES values of a
+ * row all start at the same bit of their lane, so a row decodes with one vector
+ * load, shift and mask.
+ */
+const int PACK_LANES = 8;
+
+/**
+ * @brief Bits needed to hold every value up to maxValue.
+ *
+ * @param maxValue  Largest value of a column
+ * @return  Bit width in [0, 32]
+ */
+inline int packedBitWidth(const std::uint32_t maxValue)
+{
+	return maxValue == 0 ? 0 : 32 - __builtin_clz(maxValue);
+}
+
+/**
+ * @brief Number of 32 bit words taken by a column of numValues values of the
+ * given bit width. Whole rows are stored, padded with zero values.
+ *
+ * @param numValues Number of values in the column
+ * @param bits      Bit width of the values, in [0, 32]
+ * @return  Size of the column in words
+ */
+inline int packedWords(const int numValues, const int bits)
+{
+	const int rows = (numValues + PACK_LANES - 1) / PACK_LANES;
+	return (rows * bits + 31) / 32 * PACK_LANES;
+}
+
+/**
+ * @brief Read value i of a packed column on its own.
+ *
+ * @param words     Packed column
+ * @param i         Position of the value
+ * @param bits      Bit width of the values, in [0, 32]
+ * @return  Value i
+ */
+inline std::uint32_t unpackValue(const std::uint32_t* words, const int i, const int bits)
+{
+	if (bits == 0)
+	{
+		return 0;
+	}
+	const int lane = i % PACK_LANES;
+	const int bit = (i / PACK_LANES) * bits;
+	const int word = bit / 32;
+	const int shift = bit % 32;
+	std::uint32_t value = words[word * PACK_LANES + lane] >> shift;
+	if (shift + bits > 32)
+	{
+		value |= words[(word + 1) * PACK_LANES + lane] << (32 - shift);
+	}
+	return bits == 32 ? value : value & ((std::uint32_t(1) << bits) - 1);
+}
+
+/**
+ * @brief Pack values into a column of the given bit width. Every value has to fit in it.
+ *
+ * @param values    Values to pack
+ * @param numValues Number of values
+ * @param bits      Bit width, in [0, 32]
+ * @param words     Column of packedWords(numValues, bits) words to write
+ */
+void packColumn(const std::uint32_t* values, const int numValues, const int bits, std::uint32_t* words);
+
+/**
+ * @brief Unpack a whole column, adding base to every value, modulo 2^32.
+ * Decodes a row at a time with SIMD kernels where the CPU has them.
+ *
+ * @param words     Packed column
+ * @param numValues Number of values in the column
+ * @param bits      Bit width of the values, in [0, 32]
+ * @param base      Added to every value
+ * @param values    Array of numValues values to write
+ */
+void unpackColumn(const std::uint32_t* words, const int numValues, const int bits, const std::uint32_t base, std::uint32_t* values);
+
+/**
+ * @brief Position of the first value of a sorted packed column that is not less
+ * than value. Binary search on the first value of each row, then the row found
+ * is decoded and compared all at once.
+ *
+ * @param words     Packed column, ascending
+ * @param numValues Number of values in the column
+ * @param bits      Bit width of the values, in [0, 32]
+ * @param value     Value to search for
+ * @return  Index in [0, numValues]
+ */
+int packedLowerBound(const std::uint32_t* words, const int numValues, const int bits, const std::uint32_t value);
+
+}
@@ -7,6 +7,12 @@
 
 #include "btree.h"
 #include "filescan.h"
+#include "external_sort.h"
+#include "node_search.h"
+#include <thread>
+#include <cmath>
+#include <unordered_set>
+#include <limits>
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -21,6 +27,160 @@
 
 namespace badgerdb
 {
+	/**
+	 * A leaf slot removed by a LAZY delete keeps its key but loses its record id.
+	 */
+	static inline bool isDeletedSlot(const RecordId &rid)
+	{
+		return rid.page_number == Page::INVALID_NUMBER;
+	}
+
+	/**
+	 * A leaf slot of a key with many duplicates points at the posting list holding their record ids.
+	 */
+	static inline bool isPostingSlot(const RecordId &rid)
+	{
+		return rid.slot_number == Page::INVALID_SLOT && rid.page_number != Page::INVALID_NUMBER;
+	}
+
+	/**
+	 * Number of posting list slots in a leaf.
+	 */
+	template <class T>
+	static inline int countPostingSlots(const LeafNode<T> *node)
+	{
+		int count = 0;
+		for (int i = 0; i < node->numKeys; i++)
+		{
+			count += isPostingSlot(node->ridArray[i]);
+		}
+		return count;
+	}
+
+	/**
+	 * Number of entries under the children [first, last) of a non-leaf.
+	 */
+	template <class T>
+	static inline std::uint32_t sumCounts(const NonLeafNode<T> *node, const int first, const int last)
+	{
+		std::uint32_t count = 0;
+		for (int i = first; i < last; i++)
+		{
+			count += node->countArray[i];
+		}
+		return count;
+	}
+
+	/**
+	 * Keys of an index with packed leaves are searched as the ints they are stored as.
+	 */
+	template <>
+	inline int countLess<PackedIntKey>(const PackedIntKey *keys, const int numKeys, const PackedIntKey &key)
+	{
+		return countLess<int>(reinterpret_cast<const int *>(keys), numKeys, key.value);
+	}
+
+	template <>
+	inline int countLessEqual<PackedIntKey>(const PackedIntKey *keys, const int numKeys, const PackedIntKey &key)
+	{
+		return countLessEqual<int>(reinterpret_cast<const int *>(keys), numKeys, key.value);
+	}
+
+	/**
+	 * Bytes a column of a composite key takes, both normalized and as passed in.
+	 */
+	static inline int keyColumnSize(const Datatype type)
+	{
+		switch (type)
+		{
+		case INTEGER:
+			return sizeof(int);
+		case DOUBLE:
+			return sizeof(double);
+		default:
+			return STRINGSIZE;
+		}
+	}
+
+	static inline bool sameKeyColumn(const KeyColumn &c1, const KeyColumn &c2)
+	{
+		return c1.attrByteOffset == c2.attrByteOffset && c1.type == c2.type;
+	}
+
+	/**
+	 * Normalize the value of a column so that it compares bytewise, see CompositeKey.
+	 */
+	static inline void encodeKeyColumn(const Datatype type, const char *value, unsigned char *out)
+	{
+		std::uint64_t bits = 0;
+		int size = 0;
+		switch (type)
+		{
+		case INTEGER:
+		{
+			int v;
+			memcpy(&v, value, sizeof(v));
+			bits = static_cast<std::uint32_t>(v) ^ 0x80000000u;
+			size = sizeof(int);
+			break;
+		}
+		case DOUBLE:
+		{
+			// -0.0 and 0.0 are the same key
+			double v;
+			memcpy(&v, value, sizeof(v));
+			if (v == 0)
+			{
+				v = 0;
+			}
+			memcpy(&bits, &v, sizeof(bits));
+			bits = (bits >> 63) ? ~bits : bits | (std::uint64_t(1) << 63);
+			size = sizeof(double);
+			break;
+		}
+		default:
+			strncpy(reinterpret_cast<char *>(out), value, STRINGSIZE);
+			return;
+		}
+		for (int i = 0; i < size; i++)
+		{
+			out[i] = static_cast<unsigned char>(bits >> (8 * (size - 1 - i)));
+		}
+	}
+
+	/**
+	 * Undo encodeKeyColumn.
+	 */
+	static inline void decodeKeyColumn(const Datatype type, const unsigned char *in, char *value)
+	{
+		if (type != INTEGER && type != DOUBLE)
+		{
+			memcpy(value, in, STRINGSIZE);
+			return;
+		}
+		const int size = keyColumnSize(type);
+		std::uint64_t bits = 0;
+		for (int i = 0; i < size; i++)
+		{
+			bits = (bits << 8) | in[i];
+		}
+		if (type == INTEGER)
+		{
+			const int v = static_cast<int>(static_cast<std::uint32_t>(bits) ^ 0x80000000u);
+			memcpy(value, &v, sizeof(v));
+			return;
+		}
+		bits = (bits >> 63) ? bits & ~(std::uint64_t(1) << 63) : ~bits;
+		memcpy(value, &bits, sizeof(bits));
+	}
+
+	/**
+	 * Key count of a node read without a latch, kept inside the key array.
+	 */
+	static inline int clampNumKeys(const int numKeys, const int maxKeys)
+	{
+		return numKeys < 0 ? 0 : (numKeys > maxKeys ? maxKeys : numKeys);
+	}
 
 	// -----------------------------------------------------------------------------
 	// BTreeIndex::BTreeIndex -- Constructor
@@ -30,485 +190,5637 @@ namespace badgerdb
 						   std::string &outIndexName,
 						   BufMgr *bufMgrIn,
 						   const int attrByteOffset,
-						   const Datatype attrType)
+						   const Datatype attrType,
+						   const BTreeBuildOptions &buildOptions)
+	{
+		KeyColumn column;
+		column.attrByteOffset = attrByteOffset;
+		column.type = attrType;
+		openIndex(relationName, outIndexName, bufMgrIn, std::vector<KeyColumn>(1, column), attrType, buildOptions);
+	}
+
+	BTreeIndex::BTreeIndex(const std::string &relationName,
+						   std::string &outIndexName,
+						   BufMgr *bufMgrIn,
+						   const std::vector<KeyColumn> &keyColumns,
+						   const BTreeBuildOptions &buildOptions)
 	{
+		openIndex(relationName, outIndexName, bufMgrIn, keyColumns, COMPOSITE, buildOptions);
+	}
+
+	void BTreeIndex::openIndex(const std::string &relationName,
+							   std::string &outIndexName,
+							   BufMgr *bufMgrIn,
+							   const std::vector<KeyColumn> &columns,
+							   const Datatype attrType,
+							   const BTreeBuildOptions &buildOptions)
+	{
+		// nothing is allocated until the key columns are known to be good
+		setKeyColumns(columns.empty() ? NULL : &columns[0], columns.size());
 
 		// initalize vars
 		this->bufMgr = bufMgrIn;
 		this->headerPageNum = 1;
-		this->attrByteOffset = attrByteOffset;
+		this->attrByteOffset = keyColumns[0].attrByteOffset;
 		this->attributeType = attrType;
-		this->scanExecuting = false;
-		this->leafOccupancy = INTARRAYLEAFSIZE;
-		this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+		this->nodeLatches = buildOptions.concurrent ? new OptimisticLatchTable() : NULL;
+		this->nodeCache = NULL;
+		this->rightmostLeafPageNum = Page::INVALID_NUMBER;
+		this->lastInsertRightmost = false;
+		this->readAheadLeaves = buildOptions.readAhead;
+		this->includedSize = 0;
+		this->bufferCapacity = 0;
+		this->packedLeaves = false;
+		this->countsValid = true;
+		this->writtenConcurrently = false;
+		this->statsPageNum = Page::INVALID_NUMBER;
+		this->stats = NULL;
+		this->statsDirty = false;
+		this->statsDeltas = NULL;
+
+		switch (attrType)
+		{
+		case INTEGER:
+			this->leafOccupancy = INTARRAYLEAFSIZE;
+			this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+			break;
+		case DOUBLE:
+			this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
+			this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+			break;
+		case STRING:
+			this->leafOccupancy = STRINGARRAYLEAFSIZE;
+			this->nodeOccupancy = STRINGARRAYNONLEAFSIZE;
+			break;
+		case COMPOSITE:
+			this->leafOccupancy = COMPOSITEARRAYLEAFSIZE;
+			this->nodeOccupancy = COMPOSITEARRAYNONLEAFSIZE;
+			break;
+		}
 
 		// Index File Name
 		std::ostringstream idxStr;
 		idxStr << relationName << '.' << attrByteOffset;
+		for (std::size_t i = 1; i < keyColumns.size(); i++)
+		{
+			idxStr << '+' << keyColumns[i].attrByteOffset;
+		}
 		outIndexName = idxStr.str();
 
 		try
 		{
 			// if the index already exists
-			BlobFile indexFile = BlobFile::open(outIndexName);
-			this->file = &indexFile;
+			this->file = new BlobFile(outIndexName, false);
+		}
+		catch (const FileNotFoundException &e)
+		{
+			this->file = NULL;
+		}
+
+		if (this->file != NULL)
+		{
 			Page *temp;
 			IndexMetaInfo *header;
 			bufMgr->readPage(file, headerPageNum, temp);
 
 			// check vailidy of index
 			header = reinterpret_cast<IndexMetaInfo *>(temp);
-			if (std::string(header->relationName) != relationName ||
+			if (strncmp(header->relationName, relationName.c_str(), sizeof(header->relationName)) != 0 ||
 				header->attrByteOffset != attrByteOffset ||
-				header->attrType != attrType)
+				header->attrType != attrType ||
+				header->numKeyColumns != static_cast<int>(keyColumns.size()) ||
+				!std::equal(keyColumns.begin(), keyColumns.end(), header->keyColumns, sameKeyColumn) ||
+				header->numIncluded < 0 || header->numIncluded > MAX_INCLUDED_ATTRS ||
+				header->bufferSlots < 0 || header->bufferSlots > nodeOccupancy - BUFFER_MIN_KEYS ||
+				header->statsPageNo == Page::INVALID_NUMBER || header->statsPageNo == headerPageNum ||
+				header->statsPageNo >= file->getEndPageNo())
 			{
+				bufMgr->unPinPage(file, headerPageNum, false);
+				bufMgr->flushFile(file);
+				delete file;
+				delete nodeLatches;
 				throw BadIndexInfoException("Invalid index was found!");
 			}
 
 			// update root
 			this->rootPageNum = header->rootPageNo;
+			this->freeListHead = header->freeListHead;
+			this->countsValid = header->countsValid != 0;
+			this->writtenConcurrently = header->writtenConcurrently != 0;
+			this->statsPageNum = header->statsPageNo;
+			try
+			{
+				setIncludedAttrs(header->included, header->numIncluded);
+				setMessageBuffer(header->bufferSlots);
+				setPackedLeaves(header->packedLeaves != 0);
+			}
+			catch (const BadIndexInfoException &e)
+			{
+				bufMgr->unPinPage(file, headerPageNum, false);
+				bufMgr->flushFile(file);
+				delete file;
+				delete nodeLatches;
+				throw;
+			}
 			bufMgr->unPinPage(file, headerPageNum, false);
 		}
-		catch (FileNotFoundException *ex)
+		else
 		{
-			// no pre-existing index
-			BlobFile indexFile = BlobFile::create(outIndexName);
-			this->file = &indexFile;
-			this->rootPageNum = 2;
+			try
+			{
+				setIncludedAttrs(buildOptions.included.empty() ? NULL : &buildOptions.included[0], buildOptions.included.size());
+				if (!(buildOptions.bufferFraction >= 0 && buildOptions.bufferFraction < 1))
+				{
+					throw BadIndexInfoException("Invalid message buffer fraction");
+				}
+				setMessageBuffer(static_cast<int>(nodeOccupancy * buildOptions.bufferFraction));
+				setPackedLeaves(buildOptions.packedLeaves);
+			}
+			catch (const BadIndexInfoException &e)
+			{
+				delete nodeLatches;
+				throw;
+			}
+			createIndex(relationName, outIndexName, buildOptions);
+		}
 
-			// create header page
-			Page *temp;
-			IndexMetaInfo *header;
-			bufMgr->allocPage(file, headerPageNum, temp);
-			header = reinterpret_cast<IndexMetaInfo *>(temp);
+		try
+		{
+			finishOpenIndex(buildOptions);
+		}
+		catch (...)
+		{
+			try
+			{
+				unpinHeldPages();
+				bufMgr->flushFile(file);
+			}
+			catch (const BadgerDbException &e)
+			{
+			}
+			delete file;
+			delete nodeLatches;
+			delete nodeCache;
+			delete[] statsDeltas;
+			throw;
+		}
+	}
+
+	void BTreeIndex::finishOpenIndex(const BTreeBuildOptions &buildOptions)
+	{
+		// createIndex leaves the statistics page of a new index pinned, an existing one reads it here
+		if (stats == NULL)
+		{
+			Page *statsPage;
+			bufMgr->readPage(file, statsPageNum, statsPage);
+			stats = reinterpret_cast<KeyStatsPage *>(statsPage);
+		}
 
-			// Initialize empty root
-			NonLeafNodeInt *root;
-			bufMgr->allocPage(file, rootPageNum, temp);
+		// concurrent inserts and deletes keep their statistics changes in shards of their own
+		if (nodeLatches != NULL)
+		{
+			statsDeltas = new StatsDelta[STATS_SHARDS];
+			deltaBuckets = stats->numBuckets;
+		}
 
-			root = reinterpret_cast<NonLeafNodeInt *>(temp);
-			std::fill(root->keyArray, root->keyArray + nodeOccupancy, INT_MAX);
-			std::fill(root->pageNoArray, root->pageNoArray + nodeOccupancy, -1);
-			root->level = 1;
-			bufMgr->unPinPage(file, rootPageNum, true);
+		// concurrent inserts and buffered messages do not keep the entry counts, which are rebuilt
+		// once the index is used without them. Concurrent inserts are also remembered for good.
+		const bool keepsCounts = nodeLatches == NULL && bufferCapacity == 0;
+		if ((!keepsCounts && countsValid) || (nodeLatches != NULL && !writtenConcurrently))
+		{
+			countsValid = countsValid && keepsCounts;
+			writtenConcurrently = writtenConcurrently || nodeLatches != NULL;
+			writeMetaInfo();
+		}
+		else if (keepsCounts && !countsValid && buildOptions.rebuildCounts)
+		{
+			switch (attributeType)
+			{
+			case INTEGER:
+				if (packedLeaves)
+				{
+					rebuildCounts<PackedIntKey>(rootPageNum, false);
+				}
+				else
+				{
+					rebuildCounts<int>(rootPageNum, false);
+				}
+				break;
+			case DOUBLE:
+				rebuildCounts<double>(rootPageNum, false);
+				break;
+			case STRING:
+				rebuildCounts<StringKey>(rootPageNum, false);
+				break;
+			case COMPOSITE:
+				rebuildCounts<CompositeKey>(rootPageNum, false);
+				break;
+			}
+			countsValid = true;
+			writeMetaInfo();
+		}
 
-			// fill header info
-			relationName.copy(header->relationName, 20);
-			header->attrByteOffset = attrByteOffset;
-			header->attrType = attrType;
-			header->rootPageNo = this->rootPageNum;
-			bufMgr->unPinPage(file, headerPageNum, true);
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				fillNodeCache<PackedIntKey>(buildOptions.cachedNodes);
+			}
+			else
+			{
+				fillNodeCache<int>(buildOptions.cachedNodes);
+			}
+			break;
+		case DOUBLE:
+			fillNodeCache<double>(buildOptions.cachedNodes);
+			break;
+		case STRING:
+			fillNodeCache<StringKey>(buildOptions.cachedNodes);
+			break;
+		case COMPOSITE:
+			fillNodeCache<CompositeKey>(buildOptions.cachedNodes);
+			break;
+		}
+	}
 
-			// populate index
-			FileScan scanner(relationName, bufMgr);
-			std::string recordStr;
-			RecordId rid;
-			const char *record;
-			const void *key;
-			while (true)
+	void BTreeIndex::createIndex(const std::string &relationName, const std::string &outIndexName, const BTreeBuildOptions &buildOptions)
+	{
+
+		// no pre-existing index
+		this->file = new BlobFile(outIndexName, true);
+		this->freeListHead = Page::INVALID_NUMBER;
+
+		// create header page
+		Page *temp;
+		IndexMetaInfo *header;
+		bufMgr->allocPage(file, headerPageNum, temp);
+		header = reinterpret_cast<IndexMetaInfo *>(temp);
+
+		// populate index
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				bulkLoad<PackedIntKey>(relationName, outIndexName, buildOptions);
+			}
+			else
+			{
+				bulkLoad<int>(relationName, outIndexName, buildOptions);
+			}
+			break;
+		case DOUBLE:
+			bulkLoad<double>(relationName, outIndexName, buildOptions);
+			break;
+		case STRING:
+			bulkLoad<StringKey>(relationName, outIndexName, buildOptions);
+			break;
+		case COMPOSITE:
+			bulkLoad<CompositeKey>(relationName, outIndexName, buildOptions);
+			break;
+		}
+
+		// the statistics page stays pinned, and starts out describing the leaves just built
+		Page *statsPage;
+		allocIndexPage(statsPageNum, statsPage);
+		stats = reinterpret_cast<KeyStatsPage *>(statsPage);
+		refreshStatistics();
+
+		// fill header info
+		strncpy(header->relationName, relationName.c_str(), sizeof(header->relationName));
+		header->attrByteOffset = attrByteOffset;
+		header->attrType = attributeType;
+		header->numKeyColumns = keyColumns.size();
+		std::copy(keyColumns.begin(), keyColumns.end(), header->keyColumns);
+		header->rootPageNo = this->rootPageNum;
+		header->freeListHead = this->freeListHead;
+		header->countsValid = countsValid;
+		header->numIncluded = includedAttrs.size();
+		std::copy(includedAttrs.begin(), includedAttrs.end(), header->included);
+		header->bufferSlots = bufferCapacity;
+		header->statsPageNo = statsPageNum;
+		header->packedLeaves = packedLeaves;
+		header->writtenConcurrently = writtenConcurrently;
+		bufMgr->unPinPage(file, headerPageNum, true);
+	}
+
+	void BTreeIndex::setKeyColumns(const KeyColumn *columns, const int numColumns)
+	{
+		if (numColumns < 1 || numColumns > MAX_KEY_COLUMNS)
+		{
+			throw BadIndexInfoException("Invalid number of key columns");
+		}
+		int size = 0;
+		for (int i = 0; i < numColumns; i++)
+		{
+			if (columns[i].attrByteOffset < 0 || columns[i].type == COMPOSITE)
+			{
+				throw BadIndexInfoException("Invalid key column");
+			}
+			size += keyColumnSize(columns[i].type);
+		}
+		if (size > COMPOSITESIZE)
+		{
+			throw BadIndexInfoException("Key columns do not fit in a composite key");
+		}
+		keyColumns.assign(columns, columns + numColumns);
+	}
+
+	void BTreeIndex::setIncludedAttrs(const IncludedAttr *attrs, const int numAttrs)
+	{
+		int size = 0;
+		for (int i = 0; i < numAttrs; i++)
+		{
+			if (attrs[i].attrByteOffset < 0 || attrs[i].length <= 0)
+			{
+				throw BadIndexInfoException("Invalid included attribute");
+			}
+			size += attrs[i].length;
+		}
+		if (numAttrs > MAX_INCLUDED_ATTRS || size > MAX_INCLUDED_SIZE)
+		{
+			throw BadIndexInfoException("Included attributes do not fit in a leaf entry");
+		}
+		includedAttrs.assign(attrs, attrs + numAttrs);
+		includedSize = size;
+
+		// the values of the entries a leaf holds take the room of the record ids it gives up
+		leafOccupancy = leafOccupancy * sizeof(RecordId) / (sizeof(RecordId) + includedSize);
+	}
+
+	void BTreeIndex::setMessageBuffer(const int slots)
+	{
+		if (slots < 0 || nodeOccupancy - slots < BUFFER_MIN_KEYS)
+		{
+			throw BadIndexInfoException("Message buffer does not leave room for keys");
+		}
+		if (slots > 0 && (nodeLatches != NULL || includedSize > 0))
+		{
+			throw BadIndexInfoException("Concurrent and covering indexes cannot buffer messages");
+		}
+		bufferCapacity = slots;
+		nodeOccupancy -= slots;
+	}
+
+	void BTreeIndex::setPackedLeaves(const bool packed)
+	{
+		if (packed && (attributeType != INTEGER || nodeLatches != NULL || includedSize > 0 || bufferCapacity > 0))
+		{
+			throw BadIndexInfoException("Only plain INTEGER indexes can pack their leaves");
+		}
+		packedLeaves = packed;
+		if (packed)
+		{
+			leafOccupancy = PACKEDLEAFSIZE;
+		}
+	}
+
+	void BTreeIndex::copyIncluded(const char *record, char *out) const
+	{
+		for (std::size_t i = 0; i < includedAttrs.size(); i++)
+		{
+			memcpy(out, record + includedAttrs[i].attrByteOffset, includedAttrs[i].length);
+			out += includedAttrs[i].length;
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::~BTreeIndex -- destructor
+	// -----------------------------------------------------------------------------
+
+	BTreeIndex::~BTreeIndex()
+	{
+		try
+		{
+			// endscan
+			if (scanCursor.isExecuting())
+			{
+				endScan();
+			}
+
+			// let go of the cached pages and flush the file
+			unpinHeldPages();
+			bufMgr->flushFile(this->file);
+		}
+		catch (const BadgerDbException &e)
+		{
+		}
+
+		delete file;
+		delete nodeLatches;
+		delete nodeCache;
+		delete[] statsDeltas;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Page management
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::allocIndexPage(PageId &pageNo, Page *&page)
+	{
+		std::lock_guard<std::recursive_mutex> guard(metaLatch);
+		if (freeListHead == Page::INVALID_NUMBER)
+		{
+			bufMgr->allocPage(file, pageNo, page);
+			return;
+		}
+
+		// reuse the first free page
+		pageNo = freeListHead;
+		bufMgr->readPage(file, pageNo, page);
+		freeListHead = reinterpret_cast<FreePageInfo *>(page)->nextFreePageNo;
+		writeMetaInfo();
+	}
+
+	void BTreeIndex::freeIndexPage(const PageId pageNo, Page *page)
+	{
+		std::lock_guard<std::recursive_mutex> guard(metaLatch);
+		reinterpret_cast<FreePageInfo *>(page)->nextFreePageNo = freeListHead;
+		bufMgr->unPinPage(file, pageNo, true);
+		freeListHead = pageNo;
+		writeMetaInfo();
+	}
+
+	void BTreeIndex::writeMetaInfo()
+	{
+		std::lock_guard<std::recursive_mutex> guard(metaLatch);
+		Page *temp;
+		bufMgr->readPage(file, headerPageNum, temp);
+		IndexMetaInfo *header = reinterpret_cast<IndexMetaInfo *>(temp);
+		header->rootPageNo = rootPageNum;
+		header->freeListHead = freeListHead;
+		header->countsValid = countsValid;
+		header->writtenConcurrently = writtenConcurrently;
+		bufMgr->unPinPage(file, headerPageNum, true);
+	}
+
+	// -----------------------------------------------------------------------------
+	// Upper level cache
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	void BTreeIndex::fillNodeCache(const std::uint32_t maxPages)
+	{
+		if (maxPages == 0)
+		{
+			return;
+		}
+		nodeCache = new NodeCache(maxPages);
+
+		// breadth first from the root, so whole upper levels are cached before any lower one
+		std::vector<PageId> level(1, rootPageNum.load());
+		while (!level.empty() && nodeCache->size() < maxPages)
+		{
+			std::vector<PageId> below;
+			for (std::size_t i = 0; i < level.size() && nodeCache->size() < maxPages; i++)
+			{
+				cacheNode(level[i]);
+				Page *temp;
+				readNode(level[i], temp);
+				NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+				if (node->level > 1)
+				{
+					below.insert(below.end(), node->pageNoArray, node->pageNoArray + node->numKeys + 1);
+				}
+			}
+			level.swap(below);
+		}
+	}
+
+	void BTreeIndex::cacheNode(const PageId pageNo)
+	{
+		if (nodeCache == NULL || nodeCache->find(pageNo) != NULL)
+		{
+			return;
+		}
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		if (!nodeCache->add(pageNo, page))
+		{
+			bufMgr->unPinPage(file, pageNo, false);
+		}
+	}
+
+	void BTreeIndex::unpinHeldPages()
+	{
+		if (nodeCache != NULL)
+		{
+			std::vector<PageId> pageNos = nodeCache->pageNos();
+			for (std::size_t i = 0; i < pageNos.size(); i++)
+			{
+				bufMgr->unPinPage(file, pageNos[i], false);
+			}
+			delete nodeCache;
+			nodeCache = NULL;
+		}
+		if (stats != NULL)
+		{
+			if (statsDeltas != NULL)
+			{
+				std::lock_guard<std::mutex> guard(statsLatch);
+				foldStatsDeltas();
+			}
+			bufMgr->unPinPage(file, statsPageNum, statsDirty);
+			stats = NULL;
+		}
+	}
+
+	bool BTreeIndex::readNode(const PageId pageNo, Page *&page)
+	{
+		if (nodeCache != NULL)
+		{
+			page = nodeCache->find(pageNo);
+			if (page != NULL)
+			{
+				return true;
+			}
+		}
+		bufMgr->readPage(file, pageNo, page);
+		return false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Typed key helpers
+	// -----------------------------------------------------------------------------
+
+	template <>
+	int BTreeIndex::keyFromPtr<int>(const void *key) const
+	{
+		return *reinterpret_cast<const int *>(key);
+	}
+
+	template <>
+	PackedIntKey BTreeIndex::keyFromPtr<PackedIntKey>(const void *key) const
+	{
+		PackedIntKey k;
+		k.value = *reinterpret_cast<const int *>(key);
+		return k;
+	}
+
+	template <>
+	double BTreeIndex::keyFromPtr<double>(const void *key) const
+	{
+		return *reinterpret_cast<const double *>(key);
+	}
+
+	template <>
+	StringKey BTreeIndex::keyFromPtr<StringKey>(const void *key) const
+	{
+		return StringKey::fromChars(reinterpret_cast<const char *>(key));
+	}
+
+	template <>
+	CompositeKey BTreeIndex::keyFromPtr<CompositeKey>(const void *key) const
+	{
+		CompositeKey k;
+		memset(k.bytes, 0, COMPOSITESIZE);
+		const char *value = reinterpret_cast<const char *>(key);
+		int pos = 0;
+		for (std::size_t i = 0; i < keyColumns.size(); i++)
+		{
+			encodeKeyColumn(keyColumns[i].type, value + pos, k.bytes + pos);
+			pos += keyColumnSize(keyColumns[i].type);
+		}
+		return k;
+	}
+
+	template <>
+	void BTreeIndex::keyToPtr<int>(const int &key, void *out) const
+	{
+		*reinterpret_cast<int *>(out) = key;
+	}
+
+	template <>
+	void BTreeIndex::keyToPtr<PackedIntKey>(const PackedIntKey &key, void *out) const
+	{
+		*reinterpret_cast<int *>(out) = key.value;
+	}
+
+	template <>
+	void BTreeIndex::keyToPtr<double>(const double &key, void *out) const
+	{
+		*reinterpret_cast<double *>(out) = key;
+	}
+
+	template <>
+	void BTreeIndex::keyToPtr<StringKey>(const StringKey &key, void *out) const
+	{
+		key.toChars(reinterpret_cast<char *>(out));
+	}
+
+	template <>
+	void BTreeIndex::keyToPtr<CompositeKey>(const CompositeKey &key, void *out) const
+	{
+		char *value = reinterpret_cast<char *>(out);
+		int pos = 0;
+		for (std::size_t i = 0; i < keyColumns.size(); i++)
+		{
+			decodeKeyColumn(keyColumns[i].type, key.bytes + pos, value + pos);
+			pos += keyColumnSize(keyColumns[i].type);
+		}
+	}
+
+	template <class T>
+	T BTreeIndex::keyFromRecord(const char *record) const
+	{
+		return keyFromPtr<T>(record + attrByteOffset);
+	}
+
+	template <>
+	CompositeKey BTreeIndex::keyFromRecord<CompositeKey>(const char *record) const
+	{
+		CompositeKey k;
+		memset(k.bytes, 0, COMPOSITESIZE);
+		int pos = 0;
+		for (std::size_t i = 0; i < keyColumns.size(); i++)
+		{
+			encodeKeyColumn(keyColumns[i].type, record + keyColumns[i].attrByteOffset, k.bytes + pos);
+			pos += keyColumnSize(keyColumns[i].type);
+		}
+		return k;
+	}
+
+	template <class T>
+	void BTreeIndex::initEmptyTree()
+	{
+		Page *temp;
+		PageId rootNo;
+		PageId leafPageNum;
+
+		allocIndexPage(rootNo, temp);
+		NonLeafNode<T> *root = reinterpret_cast<NonLeafNode<T> *>(temp);
+
+		allocIndexPage(leafPageNum, temp);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *leaf = newLeaf<T>(temp, scratch);
+		leaf->numKeys = 0;
+		leaf->numDeleted = 0;
+		leaf->numPostings = 0;
+		leaf->rightSibPageNo = Page::INVALID_NUMBER;
+		leaf->leftSibPageNo = Page::INVALID_NUMBER;
+		storeLeaf<T>(leaf, temp);
+
+		root->level = 1;
+		root->numKeys = 0;
+		root->numMessages = 0;
+		root->rightSibPageNo = Page::INVALID_NUMBER;
+		root->pageNoArray[0] = leafPageNum;
+		root->countArray[0] = 0;
+
+		bufMgr->unPinPage(file, leafPageNum, true);
+		bufMgr->unPinPage(file, rootNo, true);
+		rootPageNum = rootNo;
+		rightmostLeafPageNum = leafPageNum;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Leaf entries
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	inline char *BTreeIndex::leafIncluded(LeafNode<T> *node, const int i) const
+	{
+		return reinterpret_cast<char *>(node->ridArray + leafOccupancy) + i * includedSize;
+	}
+
+	template <class T>
+	void BTreeIndex::moveLeafEntries(LeafNode<T> *from, const int first, const int last, LeafNode<T> *to, const int dest)
+	{
+		if (from == to && dest > first)
+		{
+			std::copy_backward(from->keyArray + first, from->keyArray + last, to->keyArray + dest + (last - first));
+			std::copy_backward(from->ridArray + first, from->ridArray + last, to->ridArray + dest + (last - first));
+		}
+		else
+		{
+			std::copy(from->keyArray + first, from->keyArray + last, to->keyArray + dest);
+			std::copy(from->ridArray + first, from->ridArray + last, to->ridArray + dest);
+		}
+		if (includedSize > 0 && last > first)
+		{
+			memmove(leafIncluded<T>(to, dest), leafIncluded<T>(from, first), (last - first) * includedSize);
+		}
+	}
+
+	template <class T>
+	LeafNode<T> *BTreeIndex::openLeaf(Page *page, std::unique_ptr<LeafNode<T> > &scratch) const
+	{
+		return reinterpret_cast<LeafNode<T> *>(page);
+	}
+
+	template <class T>
+	LeafNode<T> *BTreeIndex::newLeaf(Page *page, std::unique_ptr<LeafNode<T> > &scratch) const
+	{
+		return reinterpret_cast<LeafNode<T> *>(page);
+	}
+
+	template <class T>
+	void BTreeIndex::storeLeaf(const LeafNode<T> *leaf, Page *page) const
+	{
+	}
+
+	template <class T>
+	bool BTreeIndex::leafHasRoom(const LeafNode<T> *leaf, const T &key, const RecordId &rid) const
+	{
+		return leaf->numKeys < leafOccupancy;
+	}
+
+	template <class T>
+	bool BTreeIndex::leafHasRoom(const LeafNode<T> *leaf, const LeafNode<T> *from, const int numKeys) const
+	{
+		return leaf->numKeys + numKeys <= leafOccupancy;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Packed leaves
+	// A packed leaf is decoded into a LeafNodePacked to be read and encoded again
+	// once changed, each column relative to its smallest value and only as wide as
+	// the largest one needs, see PackedLeafHeader.
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Smallest and largest values of the columns of a packed leaf, to tell its size.
+	 */
+	struct PackedRanges
+	{
+		int numKeys;
+		int minKey, maxKey;
+		PageId minPageNo, maxPageNo;
+		SlotId minSlot, maxSlot;
+
+		PackedRanges()
+			: numKeys(0), minKey(std::numeric_limits<int>::max()), maxKey(std::numeric_limits<int>::min()),
+			  minPageNo(std::numeric_limits<PageId>::max()), maxPageNo(0),
+			  minSlot(std::numeric_limits<SlotId>::max()), maxSlot(0)
+		{
+		}
+
+		void add(const PackedIntKey &key, const RecordId &rid)
+		{
+			numKeys++;
+			minKey = std::min(minKey, key.value);
+			maxKey = std::max(maxKey, key.value);
+			minPageNo = std::min(minPageNo, rid.page_number);
+			maxPageNo = std::max(maxPageNo, rid.page_number);
+			minSlot = std::min(minSlot, rid.slot_number);
+			maxSlot = std::max(maxSlot, rid.slot_number);
+		}
+
+		void add(const LeafNodePacked *leaf, const int first, const int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				add(leaf->keyArray[i], leaf->ridArray[i]);
+			}
+		}
+
+		int keyBits() const
+		{
+			return numKeys == 0 ? 0 : packedBitWidth(static_cast<std::uint32_t>(maxKey) - static_cast<std::uint32_t>(minKey));
+		}
+
+		int pageBits() const
+		{
+			return numKeys == 0 ? 0 : packedBitWidth(maxPageNo - minPageNo);
+		}
+
+		int slotBits() const
+		{
+			return numKeys == 0 ? 0 : packedBitWidth(maxSlot - minSlot);
+		}
+
+		int words() const
+		{
+			return packedWords(numKeys, keyBits()) + packedWords(numKeys, pageBits()) + packedWords(numKeys, slotBits());
+		}
+	};
+
+	/**
+	 * Whether the header of a packed leaf describes columns that fit in the page.
+	 */
+	static inline bool validPackedLeaf(const PackedLeafHeader *header)
+	{
+		const int n = header->numKeys;
+		return n >= 0 && n <= PACKEDLEAFSIZE && header->keyBits <= 32 && header->pageBits <= 32 && header->slotBits <= 16 &&
+			   packedWords(n, header->keyBits) + packedWords(n, header->pageBits) + packedWords(n, header->slotBits) <= PACKEDLEAFWORDS;
+	}
+
+	/**
+	 * Decode a packed leaf page into leaf.
+	 * @return  false if the header is not valid, see validPackedLeaf, in which case only the
+	 * sibling links, high key and number of keys of leaf are filled in
+	 */
+	static bool unpackLeaf(const Page *page, LeafNodePacked *leaf)
+	{
+		const PackedLeafHeader *header = reinterpret_cast<const PackedLeafHeader *>(page);
+		const int n = header->numKeys;
+		leaf->highKey.value = header->highKey;
+		leaf->rightSibPageNo = header->rightSibPageNo;
+		leaf->leftSibPageNo = header->leftSibPageNo;
+		leaf->numKeys = n;
+		leaf->numDeleted = 0;
+		leaf->numPostings = 0;
+		if (!validPackedLeaf(header))
+		{
+			return false;
+		}
+
+		const std::uint32_t *words = reinterpret_cast<const std::uint32_t *>(header + 1);
+		std::uint32_t pages[PACKEDLEAFSIZE];
+		std::uint32_t slots[PACKEDLEAFSIZE];
+		unpackColumn(words, n, header->keyBits, header->minKey, reinterpret_cast<std::uint32_t *>(leaf->keyArray));
+		words += packedWords(n, header->keyBits);
+		unpackColumn(words, n, header->pageBits, header->minPageNo, pages);
+		words += packedWords(n, header->pageBits);
+		unpackColumn(words, n, header->slotBits, header->minSlot, slots);
+		for (int i = 0; i < n; i++)
+		{
+			leaf->ridArray[i].page_number = pages[i];
+			leaf->ridArray[i].slot_number = slots[i];
+			leaf->ridArray[i].padding = 0;
+		}
+		return true;
+	}
+
+	/**
+	 * Encode leaf into a packed leaf page. Every caller makes sure beforehand that it fits.
+	 */
+	static void packLeaf(const LeafNodePacked *leaf, Page *page)
+	{
+		const int n = leaf->numKeys;
+		PackedRanges ranges;
+		ranges.add(leaf, 0, n);
+		if (ranges.words() > PACKEDLEAFWORDS)
+		{
+			throw BadIndexInfoException("Packed leaf does not fit in a page");
+		}
+
+		PackedLeafHeader *header = reinterpret_cast<PackedLeafHeader *>(page);
+		header->highKey = leaf->highKey.value;
+		header->rightSibPageNo = leaf->rightSibPageNo;
+		header->leftSibPageNo = leaf->leftSibPageNo;
+		header->numKeys = n;
+		header->minKey = n > 0 ? ranges.minKey : 0;
+		header->minPageNo = n > 0 ? ranges.minPageNo : 0;
+		header->minSlot = n > 0 ? ranges.minSlot : 0;
+		header->keyBits = ranges.keyBits();
+		header->pageBits = ranges.pageBits();
+		header->slotBits = ranges.slotBits();
+
+		std::uint32_t values[PACKEDLEAFSIZE];
+		std::uint32_t *words = reinterpret_cast<std::uint32_t *>(header + 1);
+		for (int i = 0; i < n; i++)
+		{
+			values[i] = static_cast<std::uint32_t>(leaf->keyArray[i].value) - static_cast<std::uint32_t>(header->minKey);
+		}
+		packColumn(values, n, header->keyBits, words);
+		words += packedWords(n, header->keyBits);
+		for (int i = 0; i < n; i++)
+		{
+			values[i] = leaf->ridArray[i].page_number - header->minPageNo;
+		}
+		packColumn(values, n, header->pageBits, words);
+		words += packedWords(n, header->pageBits);
+		for (int i = 0; i < n; i++)
+		{
+			values[i] = leaf->ridArray[i].slot_number - header->minSlot;
+		}
+		packColumn(values, n, header->slotBits, words);
+	}
+
+	template <>
+	LeafNodePacked *BTreeIndex::openLeaf<PackedIntKey>(Page *page, std::unique_ptr<LeafNodePacked> &scratch) const
+	{
+		if (!scratch)
+		{
+			scratch.reset(new LeafNodePacked);
+		}
+		if (!unpackLeaf(page, scratch.get()))
+		{
+			throw BadIndexInfoException("Invalid packed leaf");
+		}
+		return scratch.get();
+	}
+
+	template <>
+	LeafNodePacked *BTreeIndex::newLeaf<PackedIntKey>(Page *page, std::unique_ptr<LeafNodePacked> &scratch) const
+	{
+		if (!scratch)
+		{
+			scratch.reset(new LeafNodePacked);
+		}
+		return scratch.get();
+	}
+
+	template <>
+	void BTreeIndex::storeLeaf<PackedIntKey>(const LeafNodePacked *leaf, Page *page) const
+	{
+		packLeaf(leaf, page);
+	}
+
+	template <>
+	bool BTreeIndex::leafHasRoom<PackedIntKey>(const LeafNodePacked *leaf, const PackedIntKey &key, const RecordId &rid) const
+	{
+		if (leaf->numKeys >= PACKEDLEAFSIZE)
+		{
+			return false;
+		}
+		PackedRanges ranges;
+		ranges.add(leaf, 0, leaf->numKeys);
+		ranges.add(key, rid);
+		return ranges.words() <= PACKEDLEAFWORDS;
+	}
+
+	template <>
+	bool BTreeIndex::leafHasRoom<PackedIntKey>(const LeafNodePacked *leaf, const LeafNodePacked *from, const int numKeys) const
+	{
+		if (leaf->numKeys + numKeys > PACKEDLEAFSIZE)
+		{
+			return false;
+		}
+		PackedRanges ranges;
+		ranges.add(leaf, 0, leaf->numKeys);
+		ranges.add(from, 0, numKeys);
+		return ranges.words() <= PACKEDLEAFWORDS;
+	}
+
+	/**
+	 * Number of the first count sorted entries to bulk load into a leaf. A packed leaf takes
+	 * as many as fill the fraction fillFactor of its columns, at least one.
+	 */
+	template <class Entry>
+	static inline std::size_t leafFitCount(const Entry *entries, const std::size_t count, const double fillFactor)
+	{
+		return count;
+	}
+
+	static std::size_t leafFitCount(const RIDKeyPair<PackedIntKey> *entries, const std::size_t count, const double fillFactor)
+	{
+		const int budget = static_cast<int>(PACKEDLEAFWORDS * fillFactor);
+		PackedRanges ranges;
+		ranges.add(entries[0].key, entries[0].rid);
+		std::size_t fit = 1;
+		while (fit < count)
+		{
+			PackedRanges more = ranges;
+			more.add(entries[fit].key, entries[fit].rid);
+			if (more.words() > budget)
+			{
+				break;
+			}
+			ranges = more;
+			fit++;
+		}
+		return fit;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::bulkLoad
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Included attribute values carried by a sorted bulk load entry, none for a plain RIDKeyPair.
+	 */
+	template <class T>
+	static inline char *entryIncluded(RIDKeyPair<T> &entry)
+	{
+		return NULL;
+	}
+
+	template <class T>
+	static inline char *entryIncluded(IncludedRIDKeyPair<T> &entry)
+	{
+		return entry.included;
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoad(const std::string &relationName, const std::string &runPrefix, const BTreeBuildOptions &options)
+	{
+		// only a covering index pays for sorting the included values along with the keys
+		if (includedSize > 0)
+		{
+			bulkLoadEntries<T, IncludedRIDKeyPair<T> >(relationName, runPrefix, options);
+		}
+		else
+		{
+			bulkLoadEntries<T, RIDKeyPair<T> >(relationName, runPrefix, options);
+		}
+	}
+
+	template <class T, class Entry>
+	void BTreeIndex::bulkLoadEntries(const std::string &relationName, const std::string &runPrefix, const BTreeBuildOptions &options)
+	{
+		// sort the (key, rid) pairs of the relation
+		ExternalSorter<Entry> sorter(runPrefix, options.sortBudget);
+		{
+			FileScan scanner(relationName, bufMgr);
+			Entry pair;
+			RecordId rid;
+			std::string recordStr;
+			while (true)
+			{
+				try
+				{
+					scanner.scanNext(rid);
+				}
+				catch (const EndOfFileException &e)
+				{
+					break;
+				}
+				recordStr = scanner.getRecord();
+				pair.set(rid, keyFromRecord<T>(recordStr.c_str()));
+				if (includedSize > 0)
+				{
+					copyIncluded(recordStr.c_str(), entryIncluded<T>(pair));
+				}
+				sorter.add(pair);
+			}
+		}
+		sorter.finish();
+
+		const std::size_t total = sorter.size();
+		if (total == 0)
+		{
+			initEmptyTree<T>();
+			return;
+		}
+
+		const double fillFactor = std::min(std::max(options.fillFactor, 0.0), 1.0);
+		const std::size_t leafFill = std::max(1, static_cast<int>(leafOccupancy * fillFactor));
+		const std::size_t childFill = std::max(1, static_cast<int>(nodeOccupancy * fillFactor)) + 1;
+
+		// write the leaves left to right. Hot keys get a posting list and a single
+		// slot, unless the index has included values or packed leaves. Slots are gathered
+		// until there are two leaves' worth, so that the last two leaves can share what is
+		// left evenly. A packed leaf may take fewer of them, when they do not pack narrowly.
+		const bool postings = includedSize == 0 && !packedLeaves;
+		std::vector<PageKeyPair<T> > level;
+		level.reserve((total + leafFill - 1) / leafFill);
+		std::vector<Entry> slots;
+		std::vector<RecordId> run;
+		PageId runPostingNo = Page::INVALID_NUMBER;
+
+		Page *temp;
+		Page *prevPage = NULL;
+		PageId prevPageNo = Page::INVALID_NUMBER;
+		LeafNode<T> *prevLeaf = NULL;
+		std::unique_ptr<LeafNode<T> > scratch;
+		std::unique_ptr<LeafNode<T> > prevScratch;
+		Entry entry;
+		Entry slot;
+		bool more = true;
+		while (more)
+		{
+			more = sorter.next(entry);
+			if (more && !postings)
+			{
+				slots.push_back(entry);
+			}
+
+			// the run of the previous key ends
+			if ((!run.empty() || runPostingNo != Page::INVALID_NUMBER) && (!more || slot.key < entry.key))
+			{
+				if (runPostingNo == Page::INVALID_NUMBER && run.size() < static_cast<std::size_t>(POSTING_MIN_RUN))
+				{
+					for (std::size_t i = 0; i < run.size(); i++)
+					{
+						slot.rid = run[i];
+						slots.push_back(slot);
+					}
+				}
+				else
+				{
+					if (!run.empty())
+					{
+						runPostingNo = writePostingPage(&run[0], run.size(), runPostingNo);
+					}
+					slot.rid.page_number = runPostingNo;
+					slot.rid.slot_number = Page::INVALID_SLOT;
+					slots.push_back(slot);
+				}
+				run.clear();
+				runPostingNo = Page::INVALID_NUMBER;
+			}
+			if (more && postings)
+			{
+				slot.key = entry.key;
+				run.push_back(entry.rid);
+				if (run.size() == static_cast<std::size_t>(POSTINGSIZE))
+				{
+					runPostingNo = writePostingPage(&run[0], POSTINGSIZE, runPostingNo);
+					run.clear();
+				}
+			}
+
+			while (slots.size() >= 2 * leafFill || (!more && !slots.empty()))
+			{
+				std::size_t count = slots.size();
+				if (count > leafFill)
+				{
+					count = more ? leafFill : (count + 1) / 2;
+				}
+				count = leafFitCount(&slots[0], count, fillFactor);
+
+				PageId pageNo;
+				allocIndexPage(pageNo, temp);
+				LeafNode<T> *leaf = newLeaf<T>(temp, scratch);
+				for (std::size_t j = 0; j < count; j++)
+				{
+					leaf->keyArray[j] = slots[j].key;
+					leaf->ridArray[j] = slots[j].rid;
+					if (includedSize > 0)
+					{
+						memcpy(leafIncluded<T>(leaf, j), entryIncluded<T>(slots[j]), includedSize);
+					}
+				}
+				slots.erase(slots.begin(), slots.begin() + count);
+				leaf->numKeys = count;
+				leaf->numDeleted = 0;
+				leaf->numPostings = countPostingSlots<T>(leaf);
+				leaf->rightSibPageNo = Page::INVALID_NUMBER;
+				leaf->leftSibPageNo = prevLeaf != NULL ? prevPageNo : Page::INVALID_NUMBER;
+
+				PageKeyPair<T> child;
+				child.set(pageNo, leaf->keyArray[0]);
+				child.count = countLeafEntries<T>(leaf, leaf->numKeys);
+				if (prevLeaf != NULL)
+				{
+					prevLeaf->highKey = leaf->keyArray[0];
+					prevLeaf->rightSibPageNo = pageNo;
+					storeLeaf<T>(prevLeaf, prevPage);
+					bufMgr->unPinPage(file, prevPageNo, true);
+				}
+				prevLeaf = leaf;
+				prevPage = temp;
+				prevPageNo = pageNo;
+				scratch.swap(prevScratch);
+				level.push_back(child);
+			}
+		}
+		storeLeaf<T>(prevLeaf, prevPage);
+		bufMgr->unPinPage(file, prevPageNo, true);
+		rightmostLeafPageNum = prevPageNo;
+
+		// build the non-leaf levels until a single root is left. There is always at
+		// least one, since the root is never a leaf.
+		int nodeLevel = 1;
+		do
+		{
+			std::vector<PageKeyPair<T> > parents;
+			const std::size_t numNodes = (level.size() + childFill - 1) / childFill;
+			parents.reserve(numNodes);
+
+			std::size_t pos = 0;
+			NonLeafNode<T> *prevNode = NULL;
+			for (std::size_t i = 0; i < numNodes; i++)
+			{
+				const int count = level.size() / numNodes + (i < level.size() % numNodes ? 1 : 0);
+
+				PageId pageNo;
+				allocIndexPage(pageNo, temp);
+				NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+				node->level = nodeLevel;
+				node->numKeys = count - 1;
+				node->numMessages = 0;
+				node->rightSibPageNo = Page::INVALID_NUMBER;
+				node->pageNoArray[0] = level[pos].pageNo;
+				node->countArray[0] = level[pos].count;
+				std::uint32_t entries = level[pos].count;
+				for (int j = 1; j < count; j++)
+				{
+					node->keyArray[j - 1] = level[pos + j].key;
+					node->pageNoArray[j] = level[pos + j].pageNo;
+					node->countArray[j] = level[pos + j].count;
+					entries += level[pos + j].count;
+				}
+
+				// the smallest key below this node separates it from its left neighbour
+				if (prevNode != NULL)
+				{
+					prevNode->highKey = level[pos].key;
+					prevNode->rightSibPageNo = pageNo;
+					bufMgr->unPinPage(file, prevPageNo, true);
+				}
+				prevNode = node;
+				prevPageNo = pageNo;
+
+				PageKeyPair<T> child;
+				child.set(pageNo, level[pos].key);
+				child.count = entries;
+				parents.push_back(child);
+				pos += count;
+			}
+			bufMgr->unPinPage(file, prevPageNo, true);
+
+			level.swap(parents);
+			nodeLevel++;
+		} while (level.size() > 1);
+
+		rootPageNum = level[0].pageNo;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::insertEntry
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::insertEntry(const void *key, const RecordId rid, const void *record)
+	{
+		char includedBuf[MAX_INCLUDED_SIZE];
+		const char *included = NULL;
+		if (includedSize > 0)
+		{
+			if (record == NULL)
+			{
+				throw BadIndexInfoException("Index with included attributes needs the record of an entry");
+			}
+			copyIncluded(reinterpret_cast<const char *>(record), includedBuf);
+			included = includedBuf;
+		}
+
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				insertKey<PackedIntKey>(keyFromPtr<PackedIntKey>(key), rid, included);
+			}
+			else
+			{
+				insertKey<int>(keyFromPtr<int>(key), rid, included);
+			}
+			break;
+		case DOUBLE:
+			insertKey<double>(keyFromPtr<double>(key), rid, included);
+			break;
+		case STRING:
+			insertKey<StringKey>(keyFromPtr<StringKey>(key), rid, included);
+			break;
+		case COMPOSITE:
+			insertKey<CompositeKey>(keyFromPtr<CompositeKey>(key), rid, included);
+			break;
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::insertKey(const T &key, const RecordId rid, const char *included)
+	{
+		if (nodeLatches != NULL)
+		{
+			insertKeyLinked<T>(key, rid, included);
+		}
+		else if (bufferCapacity > 0)
+		{
+			BufferedMessage<T> msg;
+			msg.set(key, rid, false);
+			bufferMessage<T>(msg);
+		}
+		else
+		{
+			insertIntoTree<T>(key, rid, included);
+		}
+		noteInserted<T>(key);
+	}
+
+	// ------------------------------------------------------------------------------
+	// Insert into the leaves
+	// One descent pins the path to the leaf, then splits are carried back up it
+	// in a loop, without recursion or reading any page of the path again
+	// ------------------------------------------------------------------------------
+	template <class T>
+	void BTreeIndex::insertIntoTree(const T &key, const RecordId rid, const char *included)
+	{
+		if (appendToLastLeaf<T>(key, rid, included))
+		{
+			countAppended<T>();
+			return;
+		}
+
+		// go down to the leaf, keeping the non-leaf nodes on the way pinned for the way back up
+		PinnedPathNode path[MAX_TREE_HEIGHT];
+		int depth = 0;
+		PageId currNo = rootPageNum;
+		bool isLeaf = false;
+		while (!isLeaf)
+		{
+			Page *temp;
+			bufMgr->readPage(file, currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			const int index = nodeUpperBound<T>(node->keyArray, node->numKeys, key);
+			path[depth].pageNo = currNo;
+			path[depth].page = temp;
+			path[depth].index = index;
+			depth++;
+			isLeaf = node->level == 1;
+			currNo = node->pageNoArray[index];
+		}
+
+		Page *temp;
+		bufMgr->readPage(file, currNo, temp);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *leaf = openLeaf<T>(temp, scratch);
+		lastInsertRightmost.store(leaf->rightSibPageNo == Page::INVALID_NUMBER, std::memory_order_relaxed);
+		PageKeyPair<T> pushUp;
+		bool split = !insertWithoutSplit<T>(leaf, key, rid, included);
+		if (split)
+		{
+			splitLeaf<T>(currNo, leaf, key, rid, included, pushUp);
+		}
+		storeLeaf<T>(leaf, temp);
+		bufMgr->unPinPage(file, currNo, true);
+		if (split)
+		{
+			linkLeftSib<T>(pushUp.pageNo, currNo);
+		}
+
+		// count the entry on the way back up, and add the separator of each split node to its parent
+		while (depth > 0)
+		{
+			const PinnedPathNode &parent = path[--depth];
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(parent.page);
+			node->countArray[parent.index] += 1;
+			if (split)
+			{
+				// the entries moved to the new child are counted under it
+				node->countArray[parent.index] -= pushUp.count;
+				if (node->numKeys < nodeOccupancy)
+				{
+					insertIntoNonLeaf<T>(node, parent.index, pushUp);
+					split = false;
+				}
+				else
+				{
+					PageKeyPair<T> parentPushUp;
+					splitNonLeaf<T>(node, parent.index, pushUp, parentPushUp);
+					pushUp = parentPushUp;
+				}
+			}
+			if (split && depth == 0)
+			{
+				// the root got split, grow the tree by one level
+				growRoot<T>(pushUp, node);
+			}
+			bufMgr->unPinPage(file, parent.pageNo, true);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::growRoot(const PageKeyPair<T> &pushUp, const NonLeafNode<T> *oldRoot)
+	{
+		Page *temp;
+		const NonLeafNode<T> *root = oldRoot;
+		if (root == NULL)
+		{
+			bufMgr->readPage(file, rootPageNum, temp);
+			root = reinterpret_cast<NonLeafNode<T> *>(temp);
+		}
+		const int level = root->level + 1;
+		const std::uint32_t oldRootCount = sumCounts<T>(root, 0, root->numKeys + 1);
+		if (oldRoot == NULL)
+		{
+			bufMgr->unPinPage(file, rootPageNum, false);
+		}
+
+		PageId newRootPageNum;
+		allocIndexPage(newRootPageNum, temp);
+		NonLeafNode<T> *newRoot = reinterpret_cast<NonLeafNode<T> *>(temp);
+		newRoot->level = level;
+		newRoot->numKeys = 1;
+		newRoot->numMessages = 0;
+		newRoot->rightSibPageNo = Page::INVALID_NUMBER;
+		newRoot->keyArray[0] = pushUp.key;
+		newRoot->pageNoArray[0] = rootPageNum;
+		newRoot->pageNoArray[1] = pushUp.pageNo;
+		newRoot->countArray[0] = oldRootCount;
+		newRoot->countArray[1] = pushUp.count;
+		bufMgr->unPinPage(file, newRootPageNum, true);
+		cacheNode(newRootPageNum);
+		rootPageNum = newRootPageNum;
+
+		// metapage has to point to the new root
+		writeMetaInfo();
+	}
+
+	// ------------------------------------------------------------------------------
+	// Concurrent insert
+	// The tree is a B-link tree: nodes at each level are chained and carry a high
+	// key, so the leaf is found without latching anything and a split is done in
+	// two steps, each latching a single node. First the node is split and linked
+	// to its new right sibling, then the separator is added to the parent.
+	// ------------------------------------------------------------------------------
+	template <class T>
+	void BTreeIndex::insertKeyLinked(const T &key, const RecordId rid, const char *included)
+	{
+		if (appendToLastLeaf<T>(key, rid, included))
+		{
+			return;
+		}
+
+		DescentPath path;
+		PageId currNo = findNode<T>(key, 0, false, &path);
+
+		Page *currPage;
+		LeafNode<T> *leaf = latchCovering<T, LeafNode<T> >(currNo, currPage, key);
+		lastInsertRightmost.store(leaf->rightSibPageNo == Page::INVALID_NUMBER, std::memory_order_relaxed);
+		if (insertWithoutSplit<T>(leaf, key, rid, included))
+		{
+			bufMgr->unPinPage(file, currNo, true);
+			nodeLatches->latchFor(currNo).writeUnlock();
+			return;
+		}
+
+		PageKeyPair<T> pushUp;
+		splitLeaf<T>(currNo, leaf, key, rid, included, pushUp);
+		bufMgr->unPinPage(file, currNo, true);
+		nodeLatches->latchFor(currNo).writeUnlock();
+		linkLeftSib<T>(pushUp.pageNo, currNo);
+
+		// readers can reach the moved entries through the right link already,
+		// the parent only needs the separator to find them directly
+		int level = 1;
+		while (true)
+		{
+			PageId parentNo;
+			if (path.depth > 0)
+			{
+				parentNo = path.pageNos[--path.depth];
+			}
+			else
+			{
+				std::unique_lock<std::recursive_mutex> guard(metaLatch);
+				if (rootPageNum == currNo)
+				{
+					growRoot<T>(pushUp, NULL);
+					return;
+				}
+
+				// the root was split by someone else, whose new root may not be there yet
+				Page *rootPage;
+				const PageId rootNo = rootPageNum;
+				bufMgr->readPage(file, rootNo, rootPage);
+				const int rootLevel = reinterpret_cast<NonLeafNode<T> *>(rootPage)->level;
+				bufMgr->unPinPage(file, rootNo, false);
+				if (rootLevel < level)
+				{
+					guard.unlock();
+					std::this_thread::yield();
+					continue;
+				}
+				parentNo = findNode<T>(pushUp.key, level, false, NULL);
+			}
+
+			Page *parentPage;
+			int index;
+			NonLeafNode<T> *parent = latchParent<T>(parentNo, parentPage, currNo, pushUp.key, index);
+			if (parent->numKeys < nodeOccupancy)
+			{
+				insertIntoNonLeaf<T>(parent, index, pushUp);
+				bufMgr->unPinPage(file, parentNo, true);
+				nodeLatches->latchFor(parentNo).writeUnlock();
+				return;
+			}
+
+			PageKeyPair<T> parentPushUp;
+			splitNonLeaf<T>(parent, index, pushUp, parentPushUp);
+			bufMgr->unPinPage(file, parentNo, true);
+			nodeLatches->latchFor(parentNo).writeUnlock();
+
+			pushUp = parentPushUp;
+			currNo = parentNo;
+			level++;
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::appendToLastLeaf(const T &key, const RecordId rid, const char *included)
+	{
+		const PageId lastNo = rightmostLeafPageNum;
+		if (lastNo == Page::INVALID_NUMBER || !lastInsertRightmost.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+
+		OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(lastNo) : NULL;
+		if (latch != NULL)
+		{
+			latch->writeLock();
+		}
+		Page *temp;
+		bufMgr->readPage(file, lastNo, temp);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *leaf = openLeaf<T>(temp, scratch);
+
+		// the leaf holds everything from its first key on, as long as it is still the last one.
+		// The leaf is left alone when it has to be split.
+		const bool fits = leaf->rightSibPageNo == Page::INVALID_NUMBER && leaf->numKeys > 0 &&
+						  !(key < leaf->keyArray[0]) && insertWithoutSplit<T>(leaf, key, rid, included);
+		if (fits)
+		{
+			storeLeaf<T>(leaf, temp);
+		}
+		bufMgr->unPinPage(file, lastNo, fits);
+		lastInsertRightmost.store(fits, std::memory_order_relaxed);
+		if (latch != NULL)
+		{
+			if (fits)
+			{
+				latch->writeUnlock();
+			}
+			else
+			{
+				latch->writeUnlockUnchanged();
+			}
+		}
+		return fits;
+	}
+
+	template <class T, class Node>
+	Node *BTreeIndex::latchCovering(PageId &pageNo, Page *&page, const T &key)
+	{
+		while (true)
+		{
+			OptimisticLatch &latch = nodeLatches->latchFor(pageNo);
+			latch.writeLock();
+			bufMgr->readPage(file, pageNo, page);
+			Node *node = reinterpret_cast<Node *>(page);
+			if (node->rightSibPageNo == Page::INVALID_NUMBER || key < node->highKey)
+			{
+				return node;
+			}
+
+			// split after it was found, key now belongs further right
+			const PageId rightNo = node->rightSibPageNo;
+			bufMgr->unPinPage(file, pageNo, false);
+			latch.writeUnlockUnchanged();
+			pageNo = rightNo;
+		}
+	}
+
+	template <class T>
+	NonLeafNode<T> *BTreeIndex::latchParent(PageId &pageNo, Page *&page, const PageId childNo, const T &key, int &index)
+	{
+		const PageId startNo = pageNo;
+		bool passed = false;
+		while (true)
+		{
+			OptimisticLatch &latch = nodeLatches->latchFor(pageNo);
+			latch.writeLock();
+			bufMgr->readPage(file, pageNo, page);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+			PageId *last = node->pageNoArray + node->numKeys + 1;
+			PageId *pos = passed ? last : std::find(node->pageNoArray, last, childNo);
+			if (pos != last || passed)
+			{
+				// the new page goes after childNo, and after any page split off childNo since whose
+				// separator is below key. Those may have moved right with a split of the parent.
+				index = pos != last ? pos - node->pageNoArray : 0;
+				while (index < node->numKeys && node->keyArray[index] < key)
+				{
+					index++;
+				}
+				passed = true;
+				if (index < node->numKeys || node->rightSibPageNo == Page::INVALID_NUMBER || key < node->highKey)
+				{
+					return node;
+				}
+			}
+
+			// the parent was split and the child went to a node on its right
+			const PageId rightNo = node->rightSibPageNo;
+			const bool covers = rightNo == Page::INVALID_NUMBER || key < node->highKey;
+			bufMgr->unPinPage(file, pageNo, false);
+			latch.writeUnlockUnchanged();
+			if (!passed && covers)
+			{
+				// the child was split off by another thread that has not posted it yet,
+				// which happens to the right of where the search started
+				std::this_thread::yield();
+				pageNo = startNo;
+				continue;
+			}
+			pageNo = rightNo;
+		}
+	}
+
+	template <class T>
+	PageId BTreeIndex::findNode(const T &key, const int level, const bool leftmost, DescentPath *path)
+	{
+		PageId currNo = rootPageNum;
+		while (true)
+		{
+			Page *temp;
+			const bool cached = readNode(currNo, temp);
+			NonLeafNode<T> *curr = reinterpret_cast<NonLeafNode<T> *>(temp);
+			OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(currNo) : NULL;
+
+			// read what is needed from the node, again if a writer got in the way
+			int currLevel;
+			PageId rightNo;
+			PageId childNo;
+			bool pastHigh;
+			while (true)
+			{
+				const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+				const int numKeys = clampNumKeys(curr->numKeys, KeyTraits<T>::NONLEAFSIZE);
+				currLevel = curr->level;
+				rightNo = curr->rightSibPageNo;
+				pastHigh = rightNo != Page::INVALID_NUMBER && (leftmost ? curr->highKey < key : !(key < curr->highKey));
+				childNo = curr->pageNoArray[leftmost ? nodeLowerBound<T>(curr->keyArray, numKeys, key)
+													 : nodeUpperBound<T>(curr->keyArray, numKeys, key)];
+				if (latch == NULL || latch->validate(version))
+				{
+					break;
+				}
+			}
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, currNo, false);
+			}
+
+			if (pastHigh)
+			{
+				// split after its parent was read
+				currNo = rightNo;
+				continue;
+			}
+			if (currLevel <= level)
+			{
+				return currNo;
+			}
+			if (path != NULL)
+			{
+				path->pageNos[path->depth++] = currNo;
+			}
+			if (currLevel == level + 1)
+			{
+				return childNo;
+			}
+			currNo = childNo;
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::splitLeaf(const PageId nodeNo, LeafNode<T> *node, const T &key, const RecordId rid, const char *included, PageKeyPair<T> &pushUp)
+	{
+		// remember with leaf nodes, we COPY up instead of pushing up
+		// create sibling
+		Page *newSibPage;
+		PageId sibId;
+		allocIndexPage(sibId, newSibPage);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *newSibNode = newLeaf<T>(newSibPage, scratch);
+		newSibNode->numDeleted = 0;
+		newSibNode->numPostings = 0;
+
+		// copy upper half of old array into new array. A key going past either end of
+		// the whole tree is most likely the next of a run of sequential inserts, which
+		// would leave every leaf half full, so it gets a leaf of its own instead.
+		int mid = node->numKeys / 2;
+		if (node->rightSibPageNo == Page::INVALID_NUMBER && !(key < node->keyArray[node->numKeys - 1]))
+		{
+			mid = node->numKeys;
+		}
+		else if (node->leftSibPageNo == Page::INVALID_NUMBER && key < node->keyArray[0])
+		{
+			mid = 0;
+		}
+		moveLeafEntries<T>(node, mid, node->numKeys, newSibNode, 0);
+		newSibNode->numKeys = node->numKeys - mid;
+		node->numKeys = mid;
+
+		// have new sibling point to original nodes neighbor, taking over its high key
+		newSibNode->rightSibPageNo = node->rightSibPageNo;
+		newSibNode->highKey = node->highKey;
+		newSibNode->leftSibPageNo = nodeNo;
+		node->rightSibPageNo = sibId;
+
+		if (newSibNode->rightSibPageNo == Page::INVALID_NUMBER)
+		{
+			rightmostLeafPageNum = sibId;
+		}
+
+		// now we insert the value as we did before
+		if (newSibNode->numKeys > 0 && key < newSibNode->keyArray[0])
+		{
+			insertIntoLeaf<T>(node, key, rid, included);
+		}
+		else
+		{
+			insertIntoLeaf<T>(newSibNode, key, rid, included);
+		}
+		if (node->numPostings > 0)
+		{
+			node->numPostings = countPostingSlots<T>(node);
+			newSibNode->numPostings = countPostingSlots<T>(newSibNode);
+		}
+
+		// copy up the first key of the new sibling
+		pushUp.set(sibId, newSibNode->keyArray[0]);
+		pushUp.count = countLeafEntries<T>(newSibNode, newSibNode->numKeys);
+		node->highKey = pushUp.key;
+		storeLeaf<T>(newSibNode, newSibPage);
+		this->bufMgr->unPinPage(this->file, sibId, true);
+	}
+
+	template <class T>
+	void BTreeIndex::linkLeftSib(const PageId leafNo, const PageId oldLeftNo)
+	{
+		// the new leaf's right neighbour still points at the leaf it was split from,
+		// unless that neighbour was merged or relinked in the meantime
+		Page *temp;
+		bufMgr->readPage(file, leafNo, temp);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *leaf = openLeaf<T>(temp, scratch);
+		PageId rightNo;
+		OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(leafNo) : NULL;
+		while (true)
+		{
+			const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+			rightNo = leaf->rightSibPageNo;
+			if (latch == NULL || latch->validate(version))
+			{
+				break;
+			}
+		}
+		bufMgr->unPinPage(file, leafNo, false);
+		if (rightNo == Page::INVALID_NUMBER)
+		{
+			return;
+		}
+
+		latch = nodeLatches != NULL ? &nodeLatches->latchFor(rightNo) : NULL;
+		if (latch != NULL)
+		{
+			latch->writeLock();
+		}
+		bufMgr->readPage(file, rightNo, temp);
+		LeafNode<T> *right = openLeaf<T>(temp, scratch);
+		const bool relink = right->leftSibPageNo == oldLeftNo;
+		if (relink)
+		{
+			right->leftSibPageNo = leafNo;
+			storeLeaf<T>(right, temp);
+		}
+		bufMgr->unPinPage(file, rightNo, relink);
+		if (latch != NULL)
+		{
+			if (relink)
+			{
+				latch->writeUnlock();
+			}
+			else
+			{
+				latch->writeUnlockUnchanged();
+			}
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::insertIntoLeaf(LeafNode<T> *node, const T &key, const RecordId rid, const char *included)
+	{
+		// find where to insert, after any equal keys
+		int i = nodeUpperBound<T>(node->keyArray, node->numKeys, key);
+		if (i > 0 && isPostingSlot(node->ridArray[i - 1]) && !(node->keyArray[i - 1] < key))
+		{
+			appendToPosting(node->ridArray[i - 1], rid);
+			return;
+		}
+		moveLeafEntries<T>(node, i, node->numKeys, node, i + 1);
+
+		// insert key and rid at specified positions
+		node->keyArray[i] = key;
+		node->ridArray[i] = rid;
+		if (included != NULL)
+		{
+			memcpy(leafIncluded<T>(node, i), included, includedSize);
+		}
+		node->numKeys += 1;
+	}
+
+	template <class T>
+	void BTreeIndex::insertIntoNonLeaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &pair)
+	{
+		// the new page goes right after the child it was split from. Searching for
+		// the separator instead could land past other children when keys repeat.
+		const int i = index;
+		std::copy_backward(node->keyArray + i, node->keyArray + node->numKeys, node->keyArray + node->numKeys + 1);
+		std::copy_backward(node->pageNoArray + i + 1, node->pageNoArray + node->numKeys + 1, node->pageNoArray + node->numKeys + 2);
+		std::copy_backward(node->countArray + i + 1, node->countArray + node->numKeys + 1, node->countArray + node->numKeys + 2);
+
+		node->keyArray[i] = pair.key;
+		node->pageNoArray[i + 1] = pair.pageNo;
+		node->countArray[i + 1] = pair.count;
+		node->numKeys += 1;
+	}
+
+	template <class T>
+	void BTreeIndex::splitNonLeaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &pair, PageKeyPair<T> &pushUp)
+	{
+		const int size = nodeOccupancy;
+
+		// position of the new key among the existing ones
+		const int pos = index;
+
+		// the middle of the size + 1 keys gets pushed up. A key added after the end of
+		// the last node of the level leaves this one full instead, see splitLeaf.
+		const int mid = node->rightSibPageNo == Page::INVALID_NUMBER && pos == size ? size - 1 : (size + 1) / 2;
+
+		Page *newSibPage;
+		PageId sibId;
+		allocIndexPage(sibId, newSibPage);
+		NonLeafNode<T> *newSibNode = reinterpret_cast<NonLeafNode<T> *>(newSibPage);
+		newSibNode->level = node->level;
+
+		if (pos == mid)
+		{
+			// the new key itself is the middle one
+			pushUp.set(sibId, pair.key);
+			newSibNode->pageNoArray[0] = pair.pageNo;
+			newSibNode->countArray[0] = pair.count;
+			for (int i = mid; i < size; i++)
+			{
+				newSibNode->keyArray[i - mid] = node->keyArray[i];
+				newSibNode->pageNoArray[i - mid + 1] = node->pageNoArray[i + 1];
+				newSibNode->countArray[i - mid + 1] = node->countArray[i + 1];
+			}
+			newSibNode->numKeys = size - mid;
+			node->numKeys = mid;
+		}
+		else if (pos < mid)
+		{
+			// key mid - 1 goes up, new key goes left
+			pushUp.set(sibId, node->keyArray[mid - 1]);
+			newSibNode->pageNoArray[0] = node->pageNoArray[mid];
+			newSibNode->countArray[0] = node->countArray[mid];
+			for (int i = mid; i < size; i++)
+			{
+				newSibNode->keyArray[i - mid] = node->keyArray[i];
+				newSibNode->pageNoArray[i - mid + 1] = node->pageNoArray[i + 1];
+				newSibNode->countArray[i - mid + 1] = node->countArray[i + 1];
+			}
+			newSibNode->numKeys = size - mid;
+			node->numKeys = mid - 1;
+			insertIntoNonLeaf<T>(node, pos, pair);
+		}
+		else
+		{
+			// key mid goes up, new key goes right
+			pushUp.set(sibId, node->keyArray[mid]);
+			newSibNode->pageNoArray[0] = node->pageNoArray[mid + 1];
+			newSibNode->countArray[0] = node->countArray[mid + 1];
+			for (int i = mid + 1; i < size; i++)
+			{
+				newSibNode->keyArray[i - mid - 1] = node->keyArray[i];
+				newSibNode->pageNoArray[i - mid] = node->pageNoArray[i + 1];
+				newSibNode->countArray[i - mid] = node->countArray[i + 1];
+			}
+			newSibNode->numKeys = size - mid - 1;
+			node->numKeys = mid;
+			insertIntoNonLeaf<T>(newSibNode, pos - mid - 1, pair);
+		}
+
+		pushUp.count = sumCounts<T>(newSibNode, 0, newSibNode->numKeys + 1);
+
+		// link the sibling in at this level
+		newSibNode->rightSibPageNo = node->rightSibPageNo;
+		newSibNode->highKey = node->highKey;
+		node->rightSibPageNo = sibId;
+		node->highKey = pushUp.key;
+
+		// buffered messages go with the children they are bound for
+		int kept = 0;
+		newSibNode->numMessages = 0;
+		for (int i = 0; i < node->numMessages; i++)
+		{
+			const BufferedMessage<T> msg = getMessage<T>(node, i);
+			if (msg.key < pushUp.key)
+			{
+				setMessage<T>(node, kept++, msg);
+			}
+			else
+			{
+				setMessage<T>(newSibNode, newSibNode->numMessages++, msg);
+			}
+		}
+		node->numMessages = kept;
+
+		this->bufMgr->unPinPage(this->file, sibId, true);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::deleteEntry
+	// -----------------------------------------------------------------------------
+
+	bool BTreeIndex::deleteEntry(const void *key, const RecordId rid, const DeleteMode mode)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return deleteKey<PackedIntKey>(keyFromPtr<PackedIntKey>(key), rid, mode);
+			}
+			return deleteKey<int>(keyFromPtr<int>(key), rid, mode);
+		case DOUBLE:
+			return deleteKey<double>(keyFromPtr<double>(key), rid, mode);
+		case STRING:
+			return deleteKey<StringKey>(keyFromPtr<StringKey>(key), rid, mode);
+		case COMPOSITE:
+			return deleteKey<CompositeKey>(keyFromPtr<CompositeKey>(key), rid, mode);
+		}
+		return false;
+	}
+
+	template <class T>
+	bool BTreeIndex::deleteKey(const T &key, const RecordId rid, const DeleteMode mode)
+	{
+		if (bufferCapacity == 0)
+		{
+			if (!deleteFromTree<T>(key, rid, mode))
+			{
+				return false;
+			}
+			noteDeleted<T>(key);
+			return true;
+		}
+
+		// only an entry that is there gets a message, so that the result is known now
+		std::vector<RecordId> rids;
+		if (!lookupPending<T>(key, rids))
+		{
+			lookupInLeaves<T>(key, [&rids](const RecordId &r) { rids.push_back(r); });
+		}
+		if (std::find(rids.begin(), rids.end(), rid) == rids.end())
+		{
+			return false;
+		}
+		BufferedMessage<T> msg;
+		msg.set(key, rid, true);
+		bufferMessage<T>(msg);
+		noteDeleted<T>(key);
+		return true;
+	}
+
+	template <class T>
+	bool BTreeIndex::deleteFromTree(const T &key, const RecordId rid, const DeleteMode mode)
+	{
+		bool found = false;
+		if (!recursiveDelete<T>(key, rid, false, rootPageNum, mode, found))
+		{
+			return found;
+		}
+
+		// a root without keys above the bottom level is dropped, its only child
+		// becomes the new root. The tree shrinks by one level.
+		Page *temp;
+		bufMgr->readPage(file, rootPageNum, temp);
+		NonLeafNode<T> *root = reinterpret_cast<NonLeafNode<T> *>(temp);
+		if (root->numKeys > 0 || root->level == 1)
+		{
+			bufMgr->unPinPage(file, rootPageNum, false);
+			return found;
+		}
+
+		const PageId oldRootPageNum = rootPageNum;
+		rootPageNum = root->pageNoArray[0];
+		freeIndexPage(oldRootPageNum, temp);
+		return found;
+	}
+
+	// ------------------------------------------------------------------------------
+	// Recursive delete
+	// Returns true when the node is left underfull
+	// ------------------------------------------------------------------------------
+	template <class T>
+	bool BTreeIndex::recursiveDelete(const T &key, const RecordId rid, const bool isLeaf, const PageId currPageId, const DeleteMode mode, bool &found)
+	{
+		Page *temp;
+		this->bufMgr->readPage(this->file, currPageId, temp);
+
+		if (!isLeaf)
+		{
+			NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(temp);
+
+			// duplicates of key may be spread over every child between these two
+			const int first = nodeLowerBound<T>(currNode->keyArray, currNode->numKeys, key);
+			const int last = nodeUpperBound<T>(currNode->keyArray, currNode->numKeys, key);
+			const bool isNextLeaf = currNode->level == 1;
+
+			for (int index = first; index <= last; index++)
+			{
+				bool childUnderfull = recursiveDelete<T>(key, rid, isNextLeaf, currNode->pageNoArray[index], mode, found);
+				if (!found)
+				{
+					continue;
+				}
+
+				bool underfull = false;
+				currNode->countArray[index] -= 1;
+				if (childUnderfull && mode == MERGE)
+				{
+					underfull = fixUnderflow<T>(currNode, index);
+				}
+				this->bufMgr->unPinPage(this->file, currPageId, true);
+				return underfull;
+			}
+
+			this->bufMgr->unPinPage(this->file, currPageId, false);
+			return false;
+		}
+
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *currNode = openLeaf<T>(temp, scratch);
+		for (int i = nodeLowerBound<T>(currNode->keyArray, currNode->numKeys, key);
+			 i < currNode->numKeys && currNode->keyArray[i] == key; i++)
+		{
+			if (isPostingSlot(currNode->ridArray[i]))
+			{
+				if (!removeFromPosting(currNode->ridArray[i], rid))
+				{
+					continue;
+				}
+				found = true;
+				if (currNode->ridArray[i].page_number != Page::INVALID_NUMBER)
+				{
+					this->bufMgr->unPinPage(this->file, currPageId, true);
+					return false;
+				}
+
+				// the list ran empty, its slot goes away like a single entry
+				currNode->numPostings -= 1;
+			}
+			else if (!(currNode->ridArray[i] == rid))
+			{
+				continue;
+			}
+
+			found = true;
+			if (mode == LAZY && !packedLeaves)
+			{
+				// leave the key in place so separators and search stay valid
+				currNode->ridArray[i].page_number = Page::INVALID_NUMBER;
+				currNode->numDeleted += 1;
+				this->bufMgr->unPinPage(this->file, currPageId, true);
+				return false;
+			}
+
+			// a packed leaf removes the entry right away, since it would have to be encoded
+			// again anyway. It counts as underfull by the entries it holds at any width.
+			moveLeafEntries<T>(currNode, i + 1, currNode->numKeys, currNode, i);
+			currNode->numKeys -= 1;
+			storeLeaf<T>(currNode, temp);
+
+			const int minKeys = packedLeaves ? PACKEDLEAFMINSIZE / 2 : leafOccupancy / 2;
+			bool underfull = currNode->numKeys - currNode->numDeleted < minKeys;
+			this->bufMgr->unPinPage(this->file, currPageId, true);
+			return underfull;
+		}
+
+		this->bufMgr->unPinPage(this->file, currPageId, false);
+		return false;
+	}
+
+	template <class T>
+	bool BTreeIndex::fixUnderflow(NonLeafNode<T> *node, const int index)
+	{
+		// only child, nothing to merge with. The caller shrinks the tree.
+		if (node->numKeys == 0)
+		{
+			return true;
+		}
+
+		// work on the pair (left, left + 1), preferring the left sibling
+		const int left = index > 0 ? index - 1 : index;
+		const PageId leftPageNum = node->pageNoArray[left];
+		const PageId rightPageNum = node->pageNoArray[left + 1];
+
+		Page *leftPage;
+		Page *rightPage;
+		bufMgr->readPage(file, leftPageNum, leftPage);
+		bufMgr->readPage(file, rightPageNum, rightPage);
+
+		if (node->level == 1)
+		{
+			std::unique_ptr<LeafNode<T> > leftScratch;
+			std::unique_ptr<LeafNode<T> > rightScratch;
+			LeafNode<T> *leftLeaf = openLeaf<T>(leftPage, leftScratch);
+			LeafNode<T> *rightLeaf = openLeaf<T>(rightPage, rightScratch);
+			compactLeaf<T>(leftLeaf);
+			compactLeaf<T>(rightLeaf);
+
+			const int total = leftLeaf->numKeys + rightLeaf->numKeys;
+			if (leafHasRoom<T>(leftLeaf, rightLeaf, rightLeaf->numKeys))
+			{
+				// merge right into left and unlink it
+				moveLeafEntries<T>(rightLeaf, 0, rightLeaf->numKeys, leftLeaf, leftLeaf->numKeys);
+				leftLeaf->numKeys = total;
+				leftLeaf->numPostings += rightLeaf->numPostings;
+				leftLeaf->highKey = rightLeaf->highKey;
+				leftLeaf->rightSibPageNo = rightLeaf->rightSibPageNo;
+				const PageId nextPageNum = leftLeaf->rightSibPageNo;
+				storeLeaf<T>(leftLeaf, leftPage);
+				bufMgr->unPinPage(file, leftPageNum, true);
+				freeIndexPage(rightPageNum, rightPage);
+				if (rightmostLeafPageNum == rightPageNum)
+				{
+					rightmostLeafPageNum = leftPageNum;
+				}
+				if (nextPageNum != Page::INVALID_NUMBER)
+				{
+					Page *nextPage;
+					bufMgr->readPage(file, nextPageNum, nextPage);
+					LeafNode<T> *nextLeaf = openLeaf<T>(nextPage, rightScratch);
+					nextLeaf->leftSibPageNo = leftPageNum;
+					storeLeaf<T>(nextLeaf, nextPage);
+					bufMgr->unPinPage(file, nextPageNum, true);
+				}
+				node->countArray[left] += node->countArray[left + 1];
+				removeFromNonLeaf<T>(node, left);
+				return node->numKeys < nodeOccupancy / 2;
+			}
+
+			// packed leaves that do not fit in one are left as they are, since
+			// either might not have room for entries of the other
+			if (packedLeaves)
+			{
+				bufMgr->unPinPage(file, leftPageNum, false);
+				bufMgr->unPinPage(file, rightPageNum, false);
+				return false;
+			}
+
+			// split the entries evenly between the two leaves
+			const int newLeft = total / 2;
+			if (leftLeaf->numKeys < newLeft)
+			{
+				const int moved = newLeft - leftLeaf->numKeys;
+				moveLeafEntries<T>(rightLeaf, 0, moved, leftLeaf, leftLeaf->numKeys);
+				moveLeafEntries<T>(rightLeaf, moved, rightLeaf->numKeys, rightLeaf, 0);
+			}
+			else
+			{
+				const int moved = leftLeaf->numKeys - newLeft;
+				moveLeafEntries<T>(rightLeaf, 0, rightLeaf->numKeys, rightLeaf, moved);
+				moveLeafEntries<T>(leftLeaf, newLeft, leftLeaf->numKeys, rightLeaf, 0);
+			}
+			leftLeaf->numKeys = newLeft;
+			rightLeaf->numKeys = total - newLeft;
+			leftLeaf->numPostings = countPostingSlots<T>(leftLeaf);
+			rightLeaf->numPostings = countPostingSlots<T>(rightLeaf);
+			node->keyArray[left] = rightLeaf->keyArray[0];
+			leftLeaf->highKey = node->keyArray[left];
+			node->countArray[left] = countLeafEntries<T>(leftLeaf, leftLeaf->numKeys);
+			node->countArray[left + 1] = countLeafEntries<T>(rightLeaf, rightLeaf->numKeys);
+
+			bufMgr->unPinPage(file, leftPageNum, true);
+			bufMgr->unPinPage(file, rightPageNum, true);
+			return false;
+		}
+
+		NonLeafNode<T> *leftNode = reinterpret_cast<NonLeafNode<T> *>(leftPage);
+		NonLeafNode<T> *rightNode = reinterpret_cast<NonLeafNode<T> *>(rightPage);
+
+		// pull the separator down between the two nodes' keys
+		std::vector<T> keys(leftNode->keyArray, leftNode->keyArray + leftNode->numKeys);
+		keys.push_back(node->keyArray[left]);
+		keys.insert(keys.end(), rightNode->keyArray, rightNode->keyArray + rightNode->numKeys);
+		std::vector<PageId> pages(leftNode->pageNoArray, leftNode->pageNoArray + leftNode->numKeys + 1);
+		pages.insert(pages.end(), rightNode->pageNoArray, rightNode->pageNoArray + rightNode->numKeys + 1);
+		std::vector<std::uint32_t> counts(leftNode->countArray, leftNode->countArray + leftNode->numKeys + 1);
+		counts.insert(counts.end(), rightNode->countArray, rightNode->countArray + rightNode->numKeys + 1);
+
+		const int total = keys.size();
+		if (total <= nodeOccupancy)
+		{
+			std::copy(keys.begin(), keys.end(), leftNode->keyArray);
+			std::copy(pages.begin(), pages.end(), leftNode->pageNoArray);
+			std::copy(counts.begin(), counts.end(), leftNode->countArray);
+			leftNode->numKeys = total;
+			leftNode->highKey = rightNode->highKey;
+			leftNode->rightSibPageNo = rightNode->rightSibPageNo;
+			bufMgr->unPinPage(file, leftPageNum, true);
+			freeIndexPage(rightPageNum, rightPage);
+			node->countArray[left] += node->countArray[left + 1];
+			removeFromNonLeaf<T>(node, left);
+			return node->numKeys < nodeOccupancy / 2;
+		}
+
+		// the middle key goes back up as the new separator
+		const int newLeft = total / 2;
+		std::copy(keys.begin(), keys.begin() + newLeft, leftNode->keyArray);
+		std::copy(pages.begin(), pages.begin() + newLeft + 1, leftNode->pageNoArray);
+		std::copy(counts.begin(), counts.begin() + newLeft + 1, leftNode->countArray);
+		leftNode->numKeys = newLeft;
+		node->keyArray[left] = keys[newLeft];
+		leftNode->highKey = keys[newLeft];
+		std::copy(keys.begin() + newLeft + 1, keys.end(), rightNode->keyArray);
+		std::copy(pages.begin() + newLeft + 1, pages.end(), rightNode->pageNoArray);
+		std::copy(counts.begin() + newLeft + 1, counts.end(), rightNode->countArray);
+		rightNode->numKeys = total - newLeft - 1;
+		node->countArray[left] = sumCounts<T>(leftNode, 0, leftNode->numKeys + 1);
+		node->countArray[left + 1] = sumCounts<T>(rightNode, 0, rightNode->numKeys + 1);
+
+		bufMgr->unPinPage(file, leftPageNum, true);
+		bufMgr->unPinPage(file, rightPageNum, true);
+		return false;
+	}
+
+	template <class T>
+	void BTreeIndex::compactLeaf(LeafNode<T> *node)
+	{
+		if (node->numDeleted == 0)
+		{
+			return;
+		}
+
+		int kept = 0;
+		for (int i = 0; i < node->numKeys; i++)
+		{
+			if (!isDeletedSlot(node->ridArray[i]))
+			{
+				moveLeafEntries<T>(node, i, i + 1, node, kept);
+				kept++;
+			}
+		}
+		node->numKeys = kept;
+		node->numDeleted = 0;
+	}
+
+	template <class T>
+	void BTreeIndex::removeFromNonLeaf(NonLeafNode<T> *node, const int index)
+	{
+		std::copy(node->keyArray + index + 1, node->keyArray + node->numKeys, node->keyArray + index);
+		std::copy(node->pageNoArray + index + 2, node->pageNoArray + node->numKeys + 1, node->pageNoArray + index + 1);
+		std::copy(node->countArray + index + 2, node->countArray + node->numKeys + 1, node->countArray + index + 1);
+		node->numKeys -= 1;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Posting lists
+	// A key with many duplicates keeps a single leaf slot, and its record ids go
+	// to a list of pages of their own. Only full leaves get their duplicates moved
+	// out, so keys with few of them cost nothing extra.
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	bool BTreeIndex::insertWithoutSplit(LeafNode<T> *node, const T &key, const RecordId rid, const char *included)
+	{
+		if (!leafHasRoom<T>(node, key, rid))
+		{
+			// a key that has a posting list needs no slot of its own
+			const int i = nodeUpperBound<T>(node->keyArray, node->numKeys, key);
+			if (!(i > 0 && isPostingSlot(node->ridArray[i - 1]) && !(node->keyArray[i - 1] < key)))
+			{
+				// lazily deleted slots are reclaimed before resorting to a split. Packed
+				// leaves have neither those nor posting lists.
+				compactLeaf<T>(node);
+				if (!packedLeaves && !leafHasRoom<T>(node, key, rid))
+				{
+					collapseDuplicates<T>(node);
+				}
+				if (!leafHasRoom<T>(node, key, rid))
+				{
+					return false;
+				}
+			}
+		}
+		insertIntoLeaf<T>(node, key, rid, included);
+		return true;
+	}
+
+	template <class T>
+	void BTreeIndex::collapseDuplicates(LeafNode<T> *node)
+	{
+		// the duplicates of a covering index each have included values of their own
+		if (includedSize > 0)
+		{
+			return;
+		}
+
+		int runStart = 0;
+		int runLength = 0;
+		for (int start = 0; start < node->numKeys;)
+		{
+			int end = start + 1;
+			while (end < node->numKeys && !(node->keyArray[start] < node->keyArray[end]))
+			{
+				end++;
+			}
+			if (end - start > runLength)
+			{
+				runStart = start;
+				runLength = end - start;
+			}
+			start = end;
+		}
+		if (runLength < POSTING_MIN_RUN)
+		{
+			return;
+		}
+
+		// single record ids of the run go to a posting list already in it, or a new one
+		std::vector<RecordId> rids;
+		std::vector<RecordId> lists;
+		for (int i = runStart; i < runStart + runLength; i++)
+		{
+			if (isPostingSlot(node->ridArray[i]))
+			{
+				lists.push_back(node->ridArray[i]);
+			}
+			else
+			{
+				rids.push_back(node->ridArray[i]);
+			}
+		}
+		if (lists.empty())
+		{
+			RecordId slot;
+			slot.page_number = Page::INVALID_NUMBER;
+			slot.slot_number = Page::INVALID_SLOT;
+			for (std::size_t i = 0; i < rids.size(); i += POSTINGSIZE)
+			{
+				slot.page_number = writePostingPage(&rids[i], std::min<std::size_t>(rids.size() - i, POSTINGSIZE), slot.page_number);
+			}
+			lists.push_back(slot);
+			node->numPostings += 1;
+		}
+		else
+		{
+			for (std::size_t i = 0; i < rids.size(); i++)
+			{
+				appendToPosting(lists[0], rids[i]);
+			}
+		}
+
+		// the run shrinks down to its posting list slots
+		const T key = node->keyArray[runStart];
+		const int newEnd = runStart + lists.size();
+		moveLeafEntries<T>(node, runStart + runLength, node->numKeys, node, newEnd);
+		std::fill(node->keyArray + runStart, node->keyArray + newEnd, key);
+		std::copy(lists.begin(), lists.end(), node->ridArray + runStart);
+		node->numKeys -= runLength - lists.size();
+	}
+
+	void BTreeIndex::appendToPosting(RecordId &slot, const RecordId rid)
+	{
+		Page *temp;
+		bufMgr->readPage(file, slot.page_number, temp);
+		PostingPage *page = reinterpret_cast<PostingPage *>(temp);
+		const int numRids = page->numRids;
+		if (numRids < POSTINGSIZE)
+		{
+			// readers copy the first numRids entries without a latch
+			page->ridArray[numRids] = rid;
+			__atomic_store_n(&page->numRids, numRids + 1, __ATOMIC_RELEASE);
+			bufMgr->unPinPage(file, slot.page_number, true);
+			return;
+		}
+		bufMgr->unPinPage(file, slot.page_number, false);
+		slot.page_number = writePostingPage(&rid, 1, slot.page_number);
+	}
+
+	bool BTreeIndex::removeFromPosting(RecordId &slot, const RecordId rid)
+	{
+		PageId prevNo = Page::INVALID_NUMBER;
+		PageId pageNo = slot.page_number;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			Page *temp;
+			bufMgr->readPage(file, pageNo, temp);
+			PostingPage *page = reinterpret_cast<PostingPage *>(temp);
+			const PageId nextNo = page->nextPageNo;
+			RecordId *last = page->ridArray + page->numRids;
+			RecordId *pos = std::find(page->ridArray, last, rid);
+			if (pos == last)
+			{
+				bufMgr->unPinPage(file, pageNo, false);
+				prevNo = pageNo;
+				pageNo = nextNo;
+				continue;
+			}
+
+			*pos = *(last - 1);
+			page->numRids -= 1;
+			if (page->numRids > 0)
+			{
+				bufMgr->unPinPage(file, pageNo, true);
+				return true;
+			}
+
+			// unlink the empty page
+			freeIndexPage(pageNo, temp);
+			if (prevNo == Page::INVALID_NUMBER)
+			{
+				slot.page_number = nextNo;
+			}
+			else
+			{
+				bufMgr->readPage(file, prevNo, temp);
+				reinterpret_cast<PostingPage *>(temp)->nextPageNo = nextNo;
+				bufMgr->unPinPage(file, prevNo, true);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	PageId BTreeIndex::writePostingPage(const RecordId *rids, const int numRids, const PageId nextPageNo)
+	{
+		PageId pageNo;
+		Page *temp;
+		allocIndexPage(pageNo, temp);
+		PostingPage *page = reinterpret_cast<PostingPage *>(temp);
+		std::copy(rids, rids + numRids, page->ridArray);
+		page->nextPageNo = nextPageNo;
+		page->numRids = numRids;
+		bufMgr->unPinPage(file, pageNo, true);
+		return pageNo;
+	}
+
+	PageId BTreeIndex::readPostingPage(const PageId pageNo, std::vector<RecordId> &rids)
+	{
+		Page *temp;
+		bufMgr->readPage(file, pageNo, temp);
+		PostingPage *page = reinterpret_cast<PostingPage *>(temp);
+		const int numRids = clampNumKeys(__atomic_load_n(&page->numRids, __ATOMIC_ACQUIRE), POSTINGSIZE);
+		rids.assign(page->ridArray, page->ridArray + numRids);
+		const PageId nextPageNo = page->nextPageNo;
+		bufMgr->unPinPage(file, pageNo, false);
+		return nextPageNo;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Entry counts
+	// Every non-leaf knows how many entries are under each of its children, which
+	// is what ranks are found from. Writers keep the counts on the path they take,
+	// except in concurrent mode, where inserts do not go through their parents.
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	std::uint32_t BTreeIndex::countLeafEntries(const LeafNode<T> *node, const int end)
+	{
+		std::uint32_t count = 0;
+		for (int i = 0; i < end; i++)
+		{
+			if (isPostingSlot(node->ridArray[i]))
+			{
+				count += postingListSize(node->ridArray[i]);
+			}
+			else if (!isDeletedSlot(node->ridArray[i]))
+			{
+				count += 1;
+			}
+		}
+		return count;
+	}
+
+	std::uint32_t BTreeIndex::postingListSize(const RecordId &slot)
+	{
+		std::uint32_t count = 0;
+		PageId pageNo = slot.page_number;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			Page *temp;
+			bufMgr->readPage(file, pageNo, temp);
+			PostingPage *page = reinterpret_cast<PostingPage *>(temp);
+			count += clampNumKeys(__atomic_load_n(&page->numRids, __ATOMIC_ACQUIRE), POSTINGSIZE);
+			const PageId nextNo = page->nextPageNo;
+			bufMgr->unPinPage(file, pageNo, false);
+			pageNo = nextNo;
+		}
+		return count;
+	}
+
+	template <class T>
+	void BTreeIndex::countAppended()
+	{
+		if (!countsValid)
+		{
+			return;
+		}
+
+		// the last leaf is the last child all the way down
+		PageId currNo = rootPageNum;
+		while (true)
+		{
+			Page *temp;
+			bufMgr->readPage(file, currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			node->countArray[node->numKeys] += 1;
+			const PageId childNo = node->pageNoArray[node->numKeys];
+			const int level = node->level;
+			bufMgr->unPinPage(file, currNo, true);
+			if (level == 1)
+			{
+				return;
+			}
+			currNo = childNo;
+		}
+	}
+
+	template <class T>
+	std::uint32_t BTreeIndex::rebuildCounts(const PageId pageNo, const bool isLeaf)
+	{
+		Page *temp;
+		bufMgr->readPage(file, pageNo, temp);
+		if (isLeaf)
+		{
+			std::unique_ptr<LeafNode<T> > scratch;
+			LeafNode<T> *leaf = openLeaf<T>(temp, scratch);
+			const std::uint32_t count = countLeafEntries<T>(leaf, leaf->numKeys);
+			bufMgr->unPinPage(file, pageNo, false);
+			return count;
+		}
+
+		NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+		for (int i = 0; i <= node->numKeys; i++)
+		{
+			node->countArray[i] = rebuildCounts<T>(node->pageNoArray[i], node->level == 1);
+		}
+		const std::uint32_t count = sumCounts<T>(node, 0, node->numKeys + 1);
+		bufMgr->unPinPage(file, pageNo, true);
+		return count;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::rankOf(const T &key, const bool inclusive)
+	{
+		// everything left of the child key would go to is below it, everything right of it above
+		std::size_t rank = 0;
+		PageId currNo = rootPageNum;
+		bool isLeaf = false;
+		while (!isLeaf)
+		{
+			Page *temp;
+			const bool cached = readNode(currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			const int index = inclusive ? nodeUpperBound<T>(node->keyArray, node->numKeys, key)
+										: nodeLowerBound<T>(node->keyArray, node->numKeys, key);
+			rank += sumCounts<T>(node, 0, index);
+			const PageId childNo = node->pageNoArray[index];
+			isLeaf = node->level == 1;
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, currNo, false);
+			}
+			currNo = childNo;
+		}
+
+		Page *temp;
+		bufMgr->readPage(file, currNo, temp);
+		std::unique_ptr<LeafNode<T> > scratch;
+		LeafNode<T> *leaf = openLeaf<T>(temp, scratch);
+		rank += countLeafEntries<T>(leaf, inclusive ? nodeUpperBound<T>(leaf->keyArray, leaf->numKeys, key)
+												   : nodeLowerBound<T>(leaf->keyArray, leaf->numKeys, key));
+		bufMgr->unPinPage(file, currNo, false);
+		return rank;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeScanCursor
+	// -----------------------------------------------------------------------------
+
+	BTreeScanCursor::BTreeScanCursor()
+		: index(NULL),
+		  scanExecuting(false),
+		  nextEntry(-1),
+		  currentPageNum(Page::INVALID_NUMBER),
+		  currentPageData(NULL),
+		  postingPos(-1),
+		  postingNextPageNo(Page::INVALID_NUMBER),
+		  readAheadPageNum(Page::INVALID_NUMBER),
+		  readAheadPos(0),
+		  readAheadPending(0),
+		  readAheadDepth(0),
+		  order(ASCENDING)
+	{
+	}
+
+	BTreeScanCursor::BTreeScanCursor(BTreeScanCursor &&other)
+		: index(NULL),
+		  scanExecuting(false),
+		  nextEntry(-1),
+		  currentPageNum(Page::INVALID_NUMBER),
+		  currentPageData(NULL),
+		  postingPos(-1),
+		  postingNextPageNo(Page::INVALID_NUMBER),
+		  readAheadPageNum(Page::INVALID_NUMBER),
+		  readAheadPos(0),
+		  readAheadPending(0),
+		  readAheadDepth(0),
+		  order(ASCENDING)
+	{
+		*this = std::move(other);
+	}
+
+	BTreeScanCursor &BTreeScanCursor::operator=(BTreeScanCursor &&other)
+	{
+		if (this == &other)
+		{
+			return *this;
+		}
+		if (scanExecuting)
+		{
+			endScan();
+		}
+
+		index = other.index;
+		scanExecuting = other.scanExecuting;
+		nextEntry = other.nextEntry;
+		currentPageNum = other.currentPageNum;
+		currentPageData = other.currentPageData;
+		leafCopy = std::move(other.leafCopy);
+		packedLeaf = std::move(other.packedLeaf);
+		postingRids = std::move(other.postingRids);
+		postingPos = other.postingPos;
+		postingNextPageNo = other.postingNextPageNo;
+		lowValInt = other.lowValInt;
+		lowValDouble = other.lowValDouble;
+		lowValString = other.lowValString;
+		highValInt = other.highValInt;
+		highValDouble = other.highValDouble;
+		highValString = other.highValString;
+		lowValComposite = other.lowValComposite;
+		highValComposite = other.highValComposite;
+		readAheadPageNum = other.readAheadPageNum;
+		readAheadPos = other.readAheadPos;
+		readAheadPending = other.readAheadPending;
+		readAheadDepth = other.readAheadDepth;
+		lowOp = other.lowOp;
+		highOp = other.highOp;
+		order = other.order;
+
+		// the pinned leaf now belongs to this cursor
+		other.scanExecuting = false;
+		other.nextEntry = -1;
+		other.currentPageNum = Page::INVALID_NUMBER;
+		other.currentPageData = NULL;
+		other.postingPos = -1;
+		return *this;
+	}
+
+	BTreeScanCursor::~BTreeScanCursor()
+	{
+		try
+		{
+			if (scanExecuting)
+			{
+				endScan();
+			}
+		}
+		catch (const BadgerDbException &e)
+		{
+		}
+	}
+
+	void BTreeScanCursor::scanNext(RecordId &outRid, void *outIncluded)
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		index->scanNext(*this, outRid, outIncluded);
+	}
+
+	std::size_t BTreeScanCursor::scanNextBatch(RecordId *outRids, const std::size_t maxRids, void *outIncluded)
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		return index->scanNextBatch(*this, outRids, maxRids, outIncluded);
+	}
+
+	void BTreeScanCursor::endScan()
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		index->endScan(*this);
+	}
+
+	// -----------------------------------------------------------------------------
+	// Scan bounds for each key type
+	// -----------------------------------------------------------------------------
+
+	template <>
+	void BTreeScanCursor::setScanRange<int>(const int &lowVal, const int &highVal)
+	{
+		lowValInt = lowVal;
+		highValInt = highVal;
+	}
+
+	template <>
+	void BTreeScanCursor::setScanRange<PackedIntKey>(const PackedIntKey &lowVal, const PackedIntKey &highVal)
+	{
+		lowValInt = lowVal.value;
+		highValInt = highVal.value;
+	}
+
+	template <>
+	void BTreeScanCursor::setScanRange<double>(const double &lowVal, const double &highVal)
+	{
+		lowValDouble = lowVal;
+		highValDouble = highVal;
+	}
+
+	template <>
+	void BTreeScanCursor::setScanRange<StringKey>(const StringKey &lowVal, const StringKey &highVal)
+	{
+		lowValString = lowVal;
+		highValString = highVal;
+	}
+
+	template <>
+	void BTreeScanCursor::setScanRange<CompositeKey>(const CompositeKey &lowVal, const CompositeKey &highVal)
+	{
+		lowValComposite = lowVal;
+		highValComposite = highVal;
+	}
+
+	template <>
+	int BTreeScanCursor::scanHighVal<int>() const
+	{
+		return highValInt;
+	}
+
+	template <>
+	PackedIntKey BTreeScanCursor::scanHighVal<PackedIntKey>() const
+	{
+		PackedIntKey k;
+		k.value = highValInt;
+		return k;
+	}
+
+	template <>
+	double BTreeScanCursor::scanHighVal<double>() const
+	{
+		return highValDouble;
+	}
+
+	template <>
+	StringKey BTreeScanCursor::scanHighVal<StringKey>() const
+	{
+		return highValString;
+	}
+
+	template <>
+	CompositeKey BTreeScanCursor::scanHighVal<CompositeKey>() const
+	{
+		return highValComposite;
+	}
+
+	template <class T>
+	bool BTreeScanCursor::satisfiesHigh(const T &key) const
+	{
+		if (highOp == LT)
+		{
+			return key < scanHighVal<T>();
+		}
+		return !(scanHighVal<T>() < key);
+	}
+
+	template <>
+	int BTreeScanCursor::scanLowVal<int>() const
+	{
+		return lowValInt;
+	}
+
+	template <>
+	PackedIntKey BTreeScanCursor::scanLowVal<PackedIntKey>() const
+	{
+		PackedIntKey k;
+		k.value = lowValInt;
+		return k;
+	}
+
+	template <>
+	double BTreeScanCursor::scanLowVal<double>() const
+	{
+		return lowValDouble;
+	}
+
+	template <>
+	StringKey BTreeScanCursor::scanLowVal<StringKey>() const
+	{
+		return lowValString;
+	}
+
+	template <>
+	CompositeKey BTreeScanCursor::scanLowVal<CompositeKey>() const
+	{
+		return lowValComposite;
+	}
+
+	template <class T>
+	bool BTreeScanCursor::satisfiesLow(const T &key) const
+	{
+		if (lowOp == GT)
+		{
+			return scanLowVal<T>() < key;
+		}
+		return !(key < scanLowVal<T>());
+	}
+
+	// -----------------------------------------------------------------------------
+	// Message buffers
+	// The non-leaf nodes of a buffered index hold inserts and deletes bound for the
+	// leaves below them. The messages of a key are always on the path inserts take
+	// to it, older ones further down, so they reach the leaves in the order they came.
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	inline BufferedMessage<T> BTreeIndex::getMessage(const NonLeafNode<T> *node, const int i) const
+	{
+		// the key is in a key slot past the node's own keys, the record id in the child
+		// and count slots past its own children, with the kind of message above the slot number
+		const int pos = nodeOccupancy + i;
+		RecordId rid;
+		rid.page_number = node->pageNoArray[pos + 1];
+		rid.slot_number = static_cast<SlotId>(node->countArray[pos + 1]);
+		rid.padding = 0;
+		BufferedMessage<T> msg;
+		msg.set(node->keyArray[pos], rid, (node->countArray[pos + 1] >> 16) != 0);
+		return msg;
+	}
+
+	template <class T>
+	inline void BTreeIndex::setMessage(NonLeafNode<T> *node, const int i, const BufferedMessage<T> &msg) const
+	{
+		const int pos = nodeOccupancy + i;
+		node->keyArray[pos] = msg.key;
+		node->pageNoArray[pos + 1] = msg.rid.page_number;
+		node->countArray[pos + 1] = msg.rid.slot_number | (msg.isDelete ? std::uint32_t(1) << 16 : 0);
+	}
+
+	template <class T>
+	void BTreeIndex::bufferMessage(const BufferedMessage<T> &msg)
+	{
+		const PageId rootNo = rootPageNum;
+		Page *temp;
+		bufMgr->readPage(file, rootNo, temp);
+		NonLeafNode<T> *root = reinterpret_cast<NonLeafNode<T> *>(temp);
+		setMessage<T>(root, root->numMessages, msg);
+		root->numMessages += 1;
+		const bool full = root->numMessages == bufferCapacity;
+		bufMgr->unPinPage(file, rootNo, true);
+
+		if (full)
+		{
+			flushBuffer<T>(rootNo);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::flushBuffer(const PageId pageNo)
+	{
+		while (true)
+		{
+			Page *temp;
+			bufMgr->readPage(file, pageNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+
+			// the child the most messages are bound for
+			std::vector<int> perChild(node->numKeys + 1, 0);
+			for (int i = 0; i < node->numMessages; i++)
+			{
+				perChild[nodeUpperBound<T>(node->keyArray, node->numKeys, getMessage<T>(node, i).key)] += 1;
+			}
+			const int index = std::max_element(perChild.begin(), perChild.end()) - perChild.begin();
+			const int batchSize = perChild[index];
+			const PageId childNo = node->pageNoArray[index];
+			const int level = node->level;
+			if (batchSize == 0)
+			{
+				bufMgr->unPinPage(file, pageNo, false);
+				return;
+			}
+
+			// a child without room for them passes some of its own further down first. That
+			// may split nodes, this one included, so the child is picked again afterwards.
+			if (level > 1)
+			{
+				Page *childPage;
+				bufMgr->readPage(file, childNo, childPage);
+				const int room = bufferCapacity - reinterpret_cast<NonLeafNode<T> *>(childPage)->numMessages;
+				bufMgr->unPinPage(file, childNo, false);
+				if (room < batchSize)
+				{
+					bufMgr->unPinPage(file, pageNo, false);
+					flushBuffer<T>(childNo);
+					continue;
+				}
+			}
+
+			// take them out, keeping the rest in order
+			std::vector<BufferedMessage<T> > batch;
+			batch.reserve(batchSize);
+			int kept = 0;
+			for (int i = 0; i < node->numMessages; i++)
+			{
+				const BufferedMessage<T> msg = getMessage<T>(node, i);
+				if (nodeUpperBound<T>(node->keyArray, node->numKeys, msg.key) == index)
+				{
+					batch.push_back(msg);
+				}
+				else
+				{
+					setMessage<T>(node, kept++, msg);
+				}
+			}
+			node->numMessages = kept;
+			bufMgr->unPinPage(file, pageNo, true);
+
+			if (level == 1)
+			{
+				// the leaf stays in the buffer pool while the whole batch goes into it
+				for (std::size_t i = 0; i < batch.size(); i++)
+				{
+					applyMessage<T>(batch[i]);
+				}
+				return;
+			}
+
+			Page *childPage;
+			bufMgr->readPage(file, childNo, childPage);
+			NonLeafNode<T> *child = reinterpret_cast<NonLeafNode<T> *>(childPage);
+			for (std::size_t i = 0; i < batch.size(); i++)
+			{
+				setMessage<T>(child, child->numMessages++, batch[i]);
+			}
+			bufMgr->unPinPage(file, childNo, true);
+			return;
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::applyMessage(const BufferedMessage<T> &msg)
+	{
+		if (msg.isDelete)
+		{
+			// merges would have to merge the buffers of non-leaf nodes too
+			deleteFromTree<T>(msg.key, msg.rid, LAZY);
+		}
+		else
+		{
+			insertIntoTree<T>(msg.key, msg.rid, NULL);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::flushRange(const T *lowVal, const T *highVal)
+	{
+		std::vector<std::vector<BufferedMessage<T> > > byLevel;
+		takeMessages<T>(rootPageNum, lowVal, highVal, byLevel);
+
+		// the lowest messages are the oldest
+		for (std::size_t level = 0; level < byLevel.size(); level++)
+		{
+			for (std::size_t i = 0; i < byLevel[level].size(); i++)
+			{
+				applyMessage<T>(byLevel[level][i]);
+			}
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::takeMessages(const PageId pageNo, const T *lowVal, const T *highVal, std::vector<std::vector<BufferedMessage<T> > > &byLevel)
+	{
+		Page *temp;
+		bufMgr->readPage(file, pageNo, temp);
+		NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+		if (byLevel.size() <= static_cast<std::size_t>(node->level))
+		{
+			byLevel.resize(node->level + 1);
+		}
+
+		int kept = 0;
+		for (int i = 0; i < node->numMessages; i++)
+		{
+			const BufferedMessage<T> msg = getMessage<T>(node, i);
+			if ((lowVal == NULL || !(msg.key < *lowVal)) && (highVal == NULL || !(*highVal < msg.key)))
+			{
+				byLevel[node->level].push_back(msg);
+			}
+			else
+			{
+				setMessage<T>(node, kept++, msg);
+			}
+		}
+		const bool changed = kept != node->numMessages;
+		node->numMessages = kept;
+
+		// the children that messages with keys in range are routed to
+		std::vector<PageId> children;
+		if (node->level > 1)
+		{
+			const int first = lowVal == NULL ? 0 : nodeUpperBound<T>(node->keyArray, node->numKeys, *lowVal);
+			const int last = highVal == NULL ? node->numKeys : nodeUpperBound<T>(node->keyArray, node->numKeys, *highVal);
+			children.assign(node->pageNoArray + first, node->pageNoArray + last + 1);
+		}
+		bufMgr->unPinPage(file, pageNo, changed);
+
+		for (std::size_t i = 0; i < children.size(); i++)
+		{
+			takeMessages<T>(children[i], lowVal, highVal, byLevel);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::pendingMessages(const T &key, std::vector<BufferedMessage<T> > &out)
+	{
+		// gathered from the root down, newest first
+		std::vector<std::vector<BufferedMessage<T> > > byLevel;
+		PageId currNo = rootPageNum;
+		bool isLeaf = false;
+		while (!isLeaf)
+		{
+			Page *temp;
+			const bool cached = readNode(currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			byLevel.push_back(std::vector<BufferedMessage<T> >());
+			for (int i = 0; i < node->numMessages; i++)
+			{
+				const BufferedMessage<T> msg = getMessage<T>(node, i);
+				if (msg.key == key)
+				{
+					byLevel.back().push_back(msg);
+				}
+			}
+			const PageId childNo = node->pageNoArray[nodeUpperBound<T>(node->keyArray, node->numKeys, key)];
+			isLeaf = node->level == 1;
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, currNo, false);
+			}
+			currNo = childNo;
+		}
+
+		for (std::size_t i = byLevel.size(); i-- > 0;)
+		{
+			out.insert(out.end(), byLevel[i].begin(), byLevel[i].end());
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::lookupPending(const T &key, std::vector<RecordId> &rids)
+	{
+		if (bufferCapacity == 0)
+		{
+			return false;
+		}
+		std::vector<BufferedMessage<T> > pending;
+		pendingMessages<T>(key, pending);
+		if (pending.empty())
+		{
+			return false;
+		}
+
+		rids.clear();
+		lookupInLeaves<T>(key, [&rids](const RecordId &r) { rids.push_back(r); });
+		for (std::size_t i = 0; i < pending.size(); i++)
+		{
+			if (!pending[i].isDelete)
+			{
+				rids.push_back(pending[i].rid);
+				continue;
+			}
+			std::vector<RecordId>::iterator pos = std::find(rids.begin(), rids.end(), pending[i].rid);
+			if (pos != rids.end())
+			{
+				rids.erase(pos);
+			}
+		}
+		return true;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookup
+	// -----------------------------------------------------------------------------
+
+	bool BTreeIndex::lookup(const void *key, RecordId &outRid)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return lookupTyped<PackedIntKey>(keyFromPtr<PackedIntKey>(key), outRid);
+			}
+			return lookupTyped<int>(keyFromPtr<int>(key), outRid);
+		case DOUBLE:
+			return lookupTyped<double>(keyFromPtr<double>(key), outRid);
+		case STRING:
+			return lookupTyped<StringKey>(keyFromPtr<StringKey>(key), outRid);
+		case COMPOSITE:
+			return lookupTyped<CompositeKey>(keyFromPtr<CompositeKey>(key), outRid);
+		}
+		return false;
+	}
+
+	std::size_t BTreeIndex::lookupAll(const void *key, const std::function<void(const RecordId &)> &callback)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return lookupAllTyped<PackedIntKey>(keyFromPtr<PackedIntKey>(key), callback);
+			}
+			return lookupAllTyped<int>(keyFromPtr<int>(key), callback);
+		case DOUBLE:
+			return lookupAllTyped<double>(keyFromPtr<double>(key), callback);
+		case STRING:
+			return lookupAllTyped<StringKey>(keyFromPtr<StringKey>(key), callback);
+		case COMPOSITE:
+			return lookupAllTyped<CompositeKey>(keyFromPtr<CompositeKey>(key), callback);
+		}
+		return 0;
+	}
+
+	template <class T>
+	bool BTreeIndex::lookupTyped(const T &key, RecordId &outRid)
+	{
+		std::vector<RecordId> rids;
+		if (lookupPending<T>(key, rids))
+		{
+			if (rids.empty())
+			{
+				return false;
+			}
+			outRid = rids[0];
+			return true;
+		}
+
+		PageId pageNo = findNode<T>(key, 0, true, NULL);
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			if (lookupInLeaf<T>(pageNo, key, &outRid, 1, pageNo) > 0)
+			{
+				if (isPostingSlot(outRid))
+				{
+					std::vector<RecordId> rids;
+					readPostingPage(outRid.page_number, rids);
+					outRid = rids[0];
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::lookupAllTyped(const T &key, const std::function<void(const RecordId &)> &callback)
+	{
+		std::vector<RecordId> rids;
+		if (lookupPending<T>(key, rids))
+		{
+			for (std::size_t i = 0; i < rids.size(); i++)
+			{
+				callback(rids[i]);
+			}
+			return rids.size();
+		}
+		return lookupInLeaves<T>(key, callback);
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::lookupInLeaves(const T &key, const std::function<void(const RecordId &)> &callback)
+	{
+		// matches are collected a leaf at a time so that no page stays pinned across the callback
+		std::vector<RecordId> rids(KeyTraits<T>::LEAFSIZE);
+		std::vector<RecordId> postingRids;
+		std::size_t total = 0;
+		PageId pageNo = findNode<T>(key, 0, true, NULL);
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			const int n = lookupInLeaf<T>(pageNo, key, &rids[0], KeyTraits<T>::LEAFSIZE, pageNo);
+			for (int i = 0; i < n; i++)
+			{
+				if (!isPostingSlot(rids[i]))
+				{
+					callback(rids[i]);
+					total++;
+					continue;
+				}
+				for (PageId postingNo = rids[i].page_number; postingNo != Page::INVALID_NUMBER;)
+				{
+					postingNo = readPostingPage(postingNo, postingRids);
+					for (std::size_t j = 0; j < postingRids.size(); j++)
+					{
+						callback(postingRids[j]);
+					}
+					total += postingRids.size();
+				}
+			}
+		}
+		return total;
+	}
+
+	template <class T>
+	int BTreeIndex::lookupInLeaf(const PageId pageNo, const T &key, RecordId *outRids, const int maxRids, PageId &nextPageNo)
+	{
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+		OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(pageNo) : NULL;
+
+		int count;
+		while (true)
+		{
+			const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+			const int numKeys = clampNumKeys(leaf->numKeys, KeyTraits<T>::LEAFSIZE);
+			count = 0;
+			int i = nodeLowerBound<T>(leaf->keyArray, numKeys, key);
+			for (; i < numKeys && count < maxRids && !(key < leaf->keyArray[i]); i++)
+			{
+				if (!isDeletedSlot(leaf->ridArray[i]))
+				{
+					outRids[count++] = leaf->ridArray[i];
+				}
+			}
+
+			// equal keys may go on in the next leaf, unless the high key says they cannot
+			nextPageNo = Page::INVALID_NUMBER;
+			if (i == numKeys && count < maxRids && leaf->rightSibPageNo != Page::INVALID_NUMBER && !(key < leaf->highKey))
+			{
+				nextPageNo = leaf->rightSibPageNo;
+			}
+			if (latch == NULL || latch->validate(version))
+			{
+				break;
+			}
+		}
+		bufMgr->unPinPage(file, pageNo, false);
+		return count;
+	}
+
+	template <>
+	int BTreeIndex::lookupInLeaf<PackedIntKey>(const PageId pageNo, const PackedIntKey &key, RecordId *outRids, const int maxRids, PageId &nextPageNo)
+	{
+		// the key column is searched as it is packed, and only the record ids of matches are decoded
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		const PackedLeafHeader *header = reinterpret_cast<const PackedLeafHeader *>(page);
+		if (!validPackedLeaf(header))
+		{
+			bufMgr->unPinPage(file, pageNo, false);
+			throw BadIndexInfoException("Invalid packed leaf");
+		}
+		const int numKeys = header->numKeys;
+		const std::uint32_t *keys = reinterpret_cast<const std::uint32_t *>(header + 1);
+		const std::uint32_t *pages = keys + packedWords(numKeys, header->keyBits);
+		const std::uint32_t *slots = pages + packedWords(numKeys, header->pageBits);
+
+		int count = 0;
+		int i = 0;
+		if (!(key.value < header->minKey))
+		{
+			const std::uint32_t value = static_cast<std::uint32_t>(key.value) - static_cast<std::uint32_t>(header->minKey);
+			i = packedLowerBound(keys, numKeys, header->keyBits, value);
+			for (; i < numKeys && count < maxRids && unpackValue(keys, i, header->keyBits) == value; i++)
+			{
+				RecordId &rid = outRids[count++];
+				rid.page_number = header->minPageNo + unpackValue(pages, i, header->pageBits);
+				rid.slot_number = header->minSlot + unpackValue(slots, i, header->slotBits);
+				rid.padding = 0;
+			}
+		}
+
+		// equal keys may go on in the next leaf, unless the high key says they cannot
+		nextPageNo = Page::INVALID_NUMBER;
+		if (i == numKeys && count < maxRids && header->rightSibPageNo != Page::INVALID_NUMBER && !(key.value < header->highKey))
+		{
+			nextPageNo = header->rightSibPageNo;
+		}
+		bufMgr->unPinPage(file, pageNo, false);
+		return count;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookupBatch
+	// -----------------------------------------------------------------------------
+
+	std::size_t BTreeIndex::lookupBatch(const void *const *keys, const std::size_t numKeys, RecordId *outRids)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return lookupBatchTyped<PackedIntKey>(keys, numKeys, outRids);
+			}
+			return lookupBatchTyped<int>(keys, numKeys, outRids);
+		case DOUBLE:
+			return lookupBatchTyped<double>(keys, numKeys, outRids);
+		case STRING:
+			return lookupBatchTyped<StringKey>(keys, numKeys, outRids);
+		case COMPOSITE:
+			return lookupBatchTyped<CompositeKey>(keys, numKeys, outRids);
+		}
+		return 0;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::lookupBatchTyped(const void *const *keys, const std::size_t numKeys, RecordId *outRids)
+	{
+		std::vector<std::pair<T, std::size_t> > probes(numKeys);
+		for (std::size_t i = 0; i < numKeys; i++)
+		{
+			probes[i] = std::make_pair(keyFromPtr<T>(keys[i]), i);
+			outRids[i].page_number = Page::INVALID_NUMBER;
+			outRids[i].slot_number = 0;
+		}
+		if (numKeys == 0)
+		{
+			return 0;
+		}
+		if (bufferCapacity > 0)
+		{
+			// each key has its own messages to apply
+			std::size_t numFound = 0;
+			for (std::size_t i = 0; i < numKeys; i++)
+			{
+				numFound += lookupTyped<T>(probes[i].first, outRids[i]);
+			}
+			return numFound;
+		}
+
+		// sorted probes that go down the same child form a contiguous run
+		std::sort(probes.begin(), probes.end());
+		lookupBatchNode<T>(rootPageNum, false, &probes[0], numKeys, outRids);
+
+		std::size_t numFound = 0;
+		for (std::size_t i = 0; i < numKeys; i++)
+		{
+			numFound += outRids[i].page_number != Page::INVALID_NUMBER;
+		}
+		return numFound;
+	}
+
+	template <class T>
+	void BTreeIndex::lookupBatchNode(PageId pageNo, const bool isLeaf, const std::pair<T, std::size_t> *probes, std::size_t numProbes, RecordId *outRids)
+	{
+		// children to visit, as the child page and the end of its run of probes
+		std::vector<std::pair<PageId, std::size_t> > runs;
+		std::vector<RecordId> postingRids;
+		std::unique_ptr<LeafNode<T> > scratch;
+
+		while (numProbes > 0)
+		{
+			Page *page;
+			const bool cached = readNode(pageNo, page);
+			OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(pageNo) : NULL;
+
+			// probes [0, done) are settled in this node, the rest belong to the right sibling
+			std::size_t done;
+			PageId rightNo;
+			bool childIsLeaf = false;
+			while (true)
+			{
+				const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+				if (isLeaf)
+				{
+					LeafNode<T> *leaf = openLeaf<T>(page, scratch);
+					const int numKeys = clampNumKeys(leaf->numKeys, KeyTraits<T>::LEAFSIZE);
+					rightNo = leaf->rightSibPageNo;
+					int start = 0;
+					for (done = 0; done < numProbes; done++)
+					{
+						const T &key = probes[done].first;
+						int i = start + nodeLowerBound<T>(leaf->keyArray + start, numKeys - start, key);
+						start = i;
+						for (; i < numKeys && !(key < leaf->keyArray[i]) && isDeletedSlot(leaf->ridArray[i]); i++)
+						{
+						}
+
+						RecordId &out = outRids[probes[done].second];
+						out.page_number = Page::INVALID_NUMBER;
+						if (i < numKeys && !(key < leaf->keyArray[i]))
+						{
+							out = leaf->ridArray[i];
+						}
+						else if (i == numKeys && rightNo != Page::INVALID_NUMBER && !(key < leaf->highKey))
+						{
+							// equal keys may go on in the next leaf, and so may every later probe
+							break;
+						}
+					}
+				}
+				else
+				{
+					NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+					const int numKeys = clampNumKeys(node->numKeys, KeyTraits<T>::NONLEAFSIZE);
+					rightNo = node->rightSibPageNo;
+					childIsLeaf = node->level == 1;
+					runs.clear();
+					for (done = 0; done < numProbes;)
+					{
+						const T &key = probes[done].first;
+						if (rightNo != Page::INVALID_NUMBER && node->highKey < key)
+						{
+							break;
+						}
+						const int child = nodeLowerBound<T>(node->keyArray, numKeys, key);
+						for (done++; done < numProbes && (child == numKeys || !(node->keyArray[child] < probes[done].first)); done++)
+						{
+							if (rightNo != Page::INVALID_NUMBER && node->highKey < probes[done].first)
+							{
+								break;
+							}
+						}
+						runs.push_back(std::make_pair(node->pageNoArray[child], done));
+					}
+				}
+				if (latch == NULL || latch->validate(version))
+				{
+					break;
+				}
+			}
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, pageNo, false);
+			}
+
+			// keys with a posting list hand out its first record id
+			for (std::size_t i = 0; isLeaf && i < done; i++)
+			{
+				RecordId &out = outRids[probes[i].second];
+				if (isPostingSlot(out))
+				{
+					readPostingPage(out.page_number, postingRids);
+					out = postingRids[0];
+				}
+			}
+
+			std::size_t begin = 0;
+			for (std::size_t r = 0; r < runs.size(); r++)
+			{
+				lookupBatchNode<T>(runs[r].first, childIsLeaf, probes + begin, runs[r].second - begin, outRids);
+				begin = runs[r].second;
+			}
+
+			// the rest goes to the right sibling, which split off or holds the following duplicates
+			pageNo = rightNo;
+			probes += done;
+			numProbes -= done;
+			runs.clear();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::countRange
+	// -----------------------------------------------------------------------------
+
+	std::size_t BTreeIndex::countRange(const void *lowValParm,
+									   const Operator lowOpParm,
+									   const void *highValParm,
+									   const Operator highOpParm)
+	{
+		if (!countsValid)
+		{
+			// without counts, the entries are counted a leaf at a time
+			std::size_t count = 0;
+			try
+			{
+				BTreeScanCursor cursor = openScan(lowValParm, lowOpParm, highValParm, highOpParm);
+				RecordId rids[256];
+				std::size_t n;
+				while ((n = cursor.scanNextBatch(rids, 256)) > 0)
+				{
+					count += n;
+				}
+			}
+			catch (const NoSuchKeyFoundException &e)
+			{
+			}
+			return count;
+		}
+
+		if (!(lowOpParm == GT || lowOpParm == GTE) ||
+			!(highOpParm == LT || highOpParm == LTE))
+		{
+			throw BadOpcodesException();
+		}
+
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return countRangeTyped<PackedIntKey>(keyFromPtr<PackedIntKey>(lowValParm), lowOpParm, keyFromPtr<PackedIntKey>(highValParm), highOpParm);
+			}
+			return countRangeTyped<int>(keyFromPtr<int>(lowValParm), lowOpParm, keyFromPtr<int>(highValParm), highOpParm);
+		case DOUBLE:
+			return countRangeTyped<double>(keyFromPtr<double>(lowValParm), lowOpParm, keyFromPtr<double>(highValParm), highOpParm);
+		case STRING:
+			return countRangeTyped<StringKey>(keyFromPtr<StringKey>(lowValParm), lowOpParm, keyFromPtr<StringKey>(highValParm), highOpParm);
+		case COMPOSITE:
+			return countRangeTyped<CompositeKey>(keyFromPtr<CompositeKey>(lowValParm), lowOpParm, keyFromPtr<CompositeKey>(highValParm), highOpParm);
+		}
+		return 0;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::countRangeTyped(const T &lowVal, const Operator lowOp, const T &highVal, const Operator highOp)
+	{
+		if (highVal < lowVal)
+		{
+			throw BadScanrangeException();
+		}
+
+		// entries below the high bound, less those below the low one
+		const std::size_t below = rankOf<T>(lowVal, lowOp == GT);
+		const std::size_t upTo = rankOf<T>(highVal, highOp == LTE);
+		return upTo > below ? upTo - below : 0;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::selectKth
+	// -----------------------------------------------------------------------------
+
+	bool BTreeIndex::selectKth(const std::size_t k, void *outKey, RecordId &outRid)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return selectKthTyped<PackedIntKey>(k, outKey, outRid);
+			}
+			return selectKthTyped<int>(k, outKey, outRid);
+		case DOUBLE:
+			return selectKthTyped<double>(k, outKey, outRid);
+		case STRING:
+			return selectKthTyped<StringKey>(k, outKey, outRid);
+		case COMPOSITE:
+			return selectKthTyped<CompositeKey>(k, outKey, outRid);
+		}
+		return false;
+	}
+
+	template <class T>
+	bool BTreeIndex::selectKthTyped(const std::size_t k, void *outKey, RecordId &outRid)
+	{
+		if (bufferCapacity > 0)
+		{
+			flushRange<T>(NULL, NULL);
+		}
+		T key;
+		if (!entryAtRank<T>(k, key, outRid))
+		{
+			return false;
+		}
+		keyToPtr<T>(key, outKey);
+		return true;
+	}
+
+	template <class T>
+	bool BTreeIndex::entryAtRank(const std::size_t k, T &outKey, RecordId &outRid)
+	{
+		// go down to the leaf holding entry k, or to the first leaf if there are no counts
+		std::size_t rank = k;
+		PageId currNo = rootPageNum;
+		bool isLeaf = false;
+		while (!isLeaf)
+		{
+			Page *temp;
+			const bool cached = readNode(currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			int index = 0;
+			if (countsValid)
+			{
+				while (index < node->numKeys && rank >= node->countArray[index])
+				{
+					rank -= node->countArray[index];
+					index++;
+				}
+			}
+			const PageId childNo = node->pageNoArray[index];
+			isLeaf = node->level == 1;
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, currNo, false);
+			}
+			currNo = childNo;
+		}
+
+		// count off what is left of k from there, moving right past the end of the leaf
+		BTreeScanCursor cursor;
+		cursor.index = this;
+		fetchScanLeaf(cursor, currNo);
+		while (true)
+		{
+			LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+			for (int i = 0; i < leaf->numKeys; i++)
+			{
+				const RecordId &slot = leaf->ridArray[i];
+				bool found = false;
+				if (isPostingSlot(slot))
+				{
+					found = findInPosting(slot, rank, outRid);
+				}
+				else if (!isDeletedSlot(slot) && rank-- == 0)
+				{
+					outRid = slot;
+					found = true;
+				}
+				if (found)
+				{
+					outKey = leaf->keyArray[i];
+					releaseScanLeaf(cursor);
+					return true;
+				}
+			}
+			if (!moveToNextLeaf<T>(cursor))
+			{
+				return false;
+			}
+		}
+	}
+
+	bool BTreeIndex::findInPosting(const RecordId &slot, std::size_t &rank, RecordId &outRid)
+	{
+		std::vector<RecordId> rids;
+		PageId pageNo = slot.page_number;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			pageNo = readPostingPage(pageNo, rids);
+			if (rank < rids.size())
+			{
+				outRid = rids[rank];
+				return true;
+			}
+			rank -= rids.size();
+		}
+		return false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Key statistics
+	// The statistics page describes the keys without reading the leaves. It is
+	// recomputed from the leaves on bulk build, and writers keep it current after.
+	// In concurrent mode writers keep their changes in shards, see StatsDelta.
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	static inline T loadStatsKey(const unsigned char *bytes)
+	{
+		T key;
+		memcpy(&key, bytes, sizeof(T));
+		return key;
+	}
+
+	template <class T>
+	static inline void storeStatsKey(const T &key, unsigned char *bytes)
+	{
+		static_assert(sizeof(T) <= STATS_KEYSIZE, "Keys must fit in a statistics page slot");
+		memcpy(bytes, &key, sizeof(T));
+	}
+
+	/**
+	 * First of the first numBuckets buckets whose bound is not below key, or the last of them for a key above
+	 * them all. The bound of the last bucket is not read.
+	 */
+	template <class T>
+	static inline int findBucket(const KeyStatsPage *stats, const int numBuckets, const T &key)
+	{
+		int low = 0;
+		int high = numBuckets - 1;
+		while (low < high)
+		{
+			const int mid = (low + high) / 2;
+			if (loadStatsKey<T>(stats->bucketBounds[mid]) < key)
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return low;
+	}
+
+	/**
+	 * 64 bit hash of the bytes of a key: FNV-1a, then the finalizer of SplitMix64 so that every bit depends on every byte.
+	 */
+	template <class T>
+	static inline std::uint64_t hashKey(const T &key)
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&key);
+		std::uint64_t h = 14695981039346656037ull;
+		for (std::size_t i = 0; i < sizeof(T); i++)
+		{
+			h = (h ^ bytes[i]) * 1099511628211ull;
+		}
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+		return h ^ (h >> 31);
+	}
+
+	/**
+	 * The first SKETCH_PRECISION bits of the hash pick a register, which keeps the longest run of leading zeros of the rest.
+	 */
+	static inline void addToSketch(std::uint8_t *sketch, const std::uint64_t hash)
+	{
+		const std::uint64_t rest = hash << SKETCH_PRECISION;
+		const std::uint8_t rank = rest == 0 ? 64 - SKETCH_PRECISION + 1 : __builtin_clzll(rest) + 1;
+		std::uint8_t &reg = sketch[hash >> (64 - SKETCH_PRECISION)];
+		if (rank > reg)
+		{
+			reg = rank;
+		}
+	}
+
+	/**
+	 * Position of a key on a line, in key order, for spreading the entries of a bucket evenly between its bounds.
+	 */
+	template <class T>
+	static inline double keyPosition(const T &key)
+	{
+		return key;
+	}
+
+	template <>
+	inline double keyPosition<PackedIntKey>(const PackedIntKey &key)
+	{
+		return key.value;
+	}
+
+	template <>
+	inline double keyPosition<StringKey>(const StringKey &key)
+	{
+		return static_cast<double>(key.prefix) * 65536.0 + key.tail;
+	}
+
+	/**
+	 * For composite keys, the first eight bytes, which are most of the leading column.
+	 */
+	template <>
+	inline double keyPosition<CompositeKey>(const CompositeKey &key)
+	{
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			bits = (bits << 8) | key.bytes[i];
+		}
+		return static_cast<double>(bits);
+	}
+
+	std::size_t BTreeIndex::getEntryCount()
+	{
+		std::lock_guard<std::mutex> guard(statsLatch);
+		foldStatsDeltas();
+		return stats->numEntries;
+	}
+
+	double BTreeIndex::estimateDistinctKeys()
+	{
+		std::lock_guard<std::mutex> guard(statsLatch);
+		foldStatsDeltas();
+		double sum = 0;
+		int zeros = 0;
+		for (int i = 0; i < SKETCH_REGISTERS; i++)
+		{
+			sum += std::ldexp(1.0, -stats->sketch[i]);
+			zeros += stats->sketch[i] == 0;
+		}
+		const double m = SKETCH_REGISTERS;
+		double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+		// few keys are counted better from the registers none of them went to
+		if (estimate <= 2.5 * m && zeros > 0)
+		{
+			estimate = m * std::log(m / zeros);
+		}
+		return std::min(estimate, static_cast<double>(stats->numEntries));
+	}
+
+	bool BTreeIndex::getKeyRange(void *outMin, void *outMax)
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return getKeyRangeTyped<PackedIntKey>(outMin, outMax);
+			}
+			return getKeyRangeTyped<int>(outMin, outMax);
+		case DOUBLE:
+			return getKeyRangeTyped<double>(outMin, outMax);
+		case STRING:
+			return getKeyRangeTyped<StringKey>(outMin, outMax);
+		case COMPOSITE:
+			return getKeyRangeTyped<CompositeKey>(outMin, outMax);
+		}
+		return false;
+	}
+
+	template <class T>
+	bool BTreeIndex::getKeyRangeTyped(void *outMin, void *outMax)
+	{
+		std::lock_guard<std::mutex> guard(statsLatch);
+		foldStatsDeltas();
+		if (stats->numEntries == 0)
+		{
+			return false;
+		}
+		keyToPtr<T>(loadStatsKey<T>(stats->minKey), outMin);
+		keyToPtr<T>(loadStatsKey<T>(stats->maxKey), outMax);
+		return true;
+	}
+
+	double BTreeIndex::estimateRange(const void *lowValParm,
+									 const Operator lowOpParm,
+									 const void *highValParm,
+									 const Operator highOpParm)
+	{
+		if (!(lowOpParm == GT || lowOpParm == GTE) ||
+			!(highOpParm == LT || highOpParm == LTE))
+		{
+			throw BadOpcodesException();
+		}
+
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return estimateRangeTyped<PackedIntKey>(keyFromPtr<PackedIntKey>(lowValParm), lowOpParm, keyFromPtr<PackedIntKey>(highValParm), highOpParm);
+			}
+			return estimateRangeTyped<int>(keyFromPtr<int>(lowValParm), lowOpParm, keyFromPtr<int>(highValParm), highOpParm);
+		case DOUBLE:
+			return estimateRangeTyped<double>(keyFromPtr<double>(lowValParm), lowOpParm, keyFromPtr<double>(highValParm), highOpParm);
+		case STRING:
+			return estimateRangeTyped<StringKey>(keyFromPtr<StringKey>(lowValParm), lowOpParm, keyFromPtr<StringKey>(highValParm), highOpParm);
+		case COMPOSITE:
+			return estimateRangeTyped<CompositeKey>(keyFromPtr<CompositeKey>(lowValParm), lowOpParm, keyFromPtr<CompositeKey>(highValParm), highOpParm);
+		}
+		return 0;
+	}
+
+	template <class T>
+	double BTreeIndex::estimateRangeTyped(const T &lowVal, const Operator lowOp, const T &highVal, const Operator highOp)
+	{
+		if (highVal < lowVal)
+		{
+			throw BadScanrangeException();
+		}
+
+		const double distinct = estimateDistinctKeys();
+		std::lock_guard<std::mutex> guard(statsLatch);
+		foldStatsDeltas();
+		const double perKey = stats->numEntries / std::max(distinct, 1.0);
+		double estimate = 0;
+		T lower = loadStatsKey<T>(stats->minKey);
+		for (int b = 0; b < stats->numBuckets; b++)
+		{
+			// the first bucket holds [lower, upper], the others (lower, upper]
+			const T upper = loadStatsKey<T>(stats->bucketBounds[b]);
+			const bool below = upper < lowVal || (upper == lowVal && lowOp == GT);
+			const bool above = b == 0 ? highVal < lower || (highVal == lower && highOp == LT) : !(lower < highVal);
+			const bool startsIn = b == 0 ? lowVal < lower || (lowVal == lower && lowOp == GTE) : !(lower < lowVal);
+			const bool endsIn = upper < highVal || (upper == highVal && highOp == LTE);
+			const double count = stats->bucketCounts[b];
+			if (below || above)
+			{
+			}
+			else if (startsIn && endsIn)
+			{
+				estimate += count;
+			}
+			else
+			{
+				// the part of the bucket the range covers, but at least one of its keys
+				const double width = keyPosition<T>(upper) - keyPosition<T>(lower);
+				const double from = std::max(keyPosition<T>(lower), keyPosition<T>(lowVal));
+				const double to = std::min(keyPosition<T>(upper), keyPosition<T>(highVal));
+				const double part = width > 0 ? count * std::max(to - from, 0.0) / width : count;
+				estimate += std::max(part, std::min(count, perKey));
+			}
+			lower = upper;
+		}
+		return std::min(estimate, static_cast<double>(stats->numEntries));
+	}
+
+	void BTreeIndex::refreshStatistics()
+	{
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				rebuildStats<PackedIntKey>();
+			}
+			else
+			{
+				rebuildStats<int>();
+			}
+			break;
+		case DOUBLE:
+			rebuildStats<double>();
+			break;
+		case STRING:
+			rebuildStats<StringKey>();
+			break;
+		case COMPOSITE:
+			rebuildStats<CompositeKey>();
+			break;
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::visitLeafSlots(const std::function<void(const T &, std::uint32_t)> &visit)
+	{
+		// the first leaf is the first child all the way down
+		PageId currNo = rootPageNum;
+		bool isLeaf = false;
+		while (!isLeaf)
+		{
+			Page *temp;
+			const bool cached = readNode(currNo, temp);
+			NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(temp);
+			const PageId childNo = node->pageNoArray[0];
+			isLeaf = node->level == 1;
+			if (!cached)
+			{
+				bufMgr->unPinPage(file, currNo, false);
+			}
+			currNo = childNo;
+		}
+
+		BTreeScanCursor cursor;
+		cursor.index = this;
+		fetchScanLeaf(cursor, currNo);
+		do
+		{
+			LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+			for (int i = 0; i < leaf->numKeys; i++)
+			{
+				const RecordId &slot = leaf->ridArray[i];
+				if (isPostingSlot(slot))
+				{
+					visit(leaf->keyArray[i], postingListSize(slot));
+				}
+				else if (!isDeletedSlot(slot))
+				{
+					visit(leaf->keyArray[i], 1);
+				}
+			}
+		} while (moveToNextLeaf<T>(cursor));
+	}
+
+	template <class T>
+	void BTreeIndex::rebuildStats()
+	{
+		if (bufferCapacity > 0)
+		{
+			flushRange<T>(NULL, NULL);
+		}
+		std::lock_guard<std::mutex> guard(statsLatch);
+		if (statsDeltas != NULL)
+		{
+			for (int s = 0; s < STATS_SHARDS; s++)
+			{
+				std::lock_guard<std::mutex> shardGuard(statsDeltas[s].latch);
+				statsDeltas[s].clear();
+			}
+		}
+		memset(stats, 0, sizeof(KeyStatsPage));
+		statsDirty = true;
+
+		// the entry count, which the depth of the buckets comes from, along with the key range and sketch
+		std::uint64_t numEntries = 0;
+		visitLeafSlots<T>([&](const T &key, std::uint32_t count) {
+			if (numEntries == 0)
+			{
+				storeStatsKey<T>(key, stats->minKey);
+			}
+			storeStatsKey<T>(key, stats->maxKey);
+			addToSketch(stats->sketch, hashKey<T>(key));
+			numEntries += count;
+		});
+		stats->numEntries = numEntries;
+		if (numEntries == 0)
+		{
+			return;
+		}
+
+		// then the buckets, each closed once it holds depth entries and the key changes,
+		// so that every duplicate of a key is in the same bucket. At most HISTOGRAM_BUCKETS fill up.
+		const std::uint64_t depth = (numEntries + HISTOGRAM_BUCKETS - 1) / HISTOGRAM_BUCKETS;
+		int b = 0;
+		bool full = false;
+		T last = T();
+		visitLeafSlots<T>([&](const T &key, std::uint32_t count) {
+			if (full && last < key)
+			{
+				b++;
+			}
+			stats->bucketCounts[b] += count;
+			storeStatsKey<T>(key, stats->bucketBounds[b]);
+			last = key;
+			full = stats->bucketCounts[b] >= depth;
+		});
+		stats->numBuckets = b + 1;
+		deltaBuckets = stats->numBuckets;
+	}
+
+	/**
+	 * Shard of the statistics deltas the calling thread writes to. Threads take the shards in turn.
+	 */
+	static inline int statsShard()
+	{
+		static std::atomic<int> nextShard(0);
+		static thread_local int shard = nextShard++ % STATS_SHARDS;
+		return shard;
+	}
+
+	template <class T>
+	void BTreeIndex::noteInserted(const T &key)
+	{
+		if (statsDeltas != NULL)
+		{
+			StatsDelta &delta = statsDeltas[statsShard()];
+			std::lock_guard<std::mutex> guard(delta.latch);
+			addToSketch(delta.sketch, hashKey<T>(key));
+			delta.numEntries += 1;
+			delta.bucketCounts[findBucket<T>(stats, deltaBuckets, key)] += 1;
+			if (!delta.hasRange || key < loadStatsKey<T>(delta.minKey))
+			{
+				storeStatsKey<T>(key, delta.minKey);
+			}
+			if (!delta.hasRange || loadStatsKey<T>(delta.maxKey) < key)
+			{
+				storeStatsKey<T>(key, delta.maxKey);
+			}
+			delta.hasRange = true;
+			delta.changed = true;
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(statsLatch);
+		statsDirty = true;
+		addToSketch(stats->sketch, hashKey<T>(key));
+		stats->numEntries += 1;
+		if (stats->numBuckets == 0)
+		{
+			storeStatsKey<T>(key, stats->minKey);
+			storeStatsKey<T>(key, stats->maxKey);
+			storeStatsKey<T>(key, stats->bucketBounds[0]);
+			stats->bucketCounts[0] = 1;
+			stats->numBuckets = 1;
+			return;
+		}
+
+		if (key < loadStatsKey<T>(stats->minKey))
+		{
+			storeStatsKey<T>(key, stats->minKey);
+		}
+		if (loadStatsKey<T>(stats->maxKey) < key)
+		{
+			storeStatsKey<T>(key, stats->maxKey);
+		}
+		const int b = findBucket<T>(stats, stats->numBuckets, key);
+		if (loadStatsKey<T>(stats->bucketBounds[b]) < key)
+		{
+			storeStatsKey<T>(key, stats->bucketBounds[b]);
+		}
+		stats->bucketCounts[b] += 1;
+
+		// a bucket that cannot be split, holding a single key, is tried again only every depth entries
+		const std::uint64_t depth = std::max<std::uint64_t>(stats->numEntries / HISTOGRAM_BUCKETS, 1);
+		if (countsValid && stats->bucketCounts[b] > 2 * depth && (stats->bucketCounts[b] - 2 * depth - 1) % depth == 0)
+		{
+			splitBucket<T>(b);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::noteDeleted(const T &key)
+	{
+		if (statsDeltas != NULL)
+		{
+			StatsDelta &delta = statsDeltas[statsShard()];
+			std::lock_guard<std::mutex> guard(delta.latch);
+			delta.numEntries -= 1;
+			delta.bucketCounts[findBucket<T>(stats, deltaBuckets, key)] -= 1;
+			delta.changed = true;
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(statsLatch);
+		if (stats->numEntries == 0)
+		{
+			return;
+		}
+		statsDirty = true;
+		stats->numEntries -= 1;
+		if (stats->numEntries == 0)
+		{
+			stats->numBuckets = 0;
+			return;
+		}
+		const int b = findBucket<T>(stats, stats->numBuckets, key);
+		if (stats->bucketCounts[b] > 0)
+		{
+			stats->bucketCounts[b] -= 1;
+		}
+	}
+
+	void BTreeIndex::foldStatsDeltas()
+	{
+		if (statsDeltas == NULL)
+		{
+			return;
+		}
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				foldStatsDeltasTyped<PackedIntKey>();
+			}
+			else
+			{
+				foldStatsDeltasTyped<int>();
+			}
+			break;
+		case DOUBLE:
+			foldStatsDeltasTyped<double>();
+			break;
+		case STRING:
+			foldStatsDeltasTyped<StringKey>();
+			break;
+		case COMPOSITE:
+			foldStatsDeltasTyped<CompositeKey>();
+			break;
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::foldStatsDeltasTyped()
+	{
+		for (int s = 0; s < STATS_SHARDS; s++)
+		{
+			StatsDelta &delta = statsDeltas[s];
+			std::lock_guard<std::mutex> guard(delta.latch);
+			if (!delta.changed)
+			{
+				continue;
+			}
+			statsDirty = true;
+
+			// the key range starts over once the index has run empty, and widens otherwise. The bound of
+			// the last bucket is the only one the shards do not read, and the only one that moves.
+			if (delta.hasRange)
+			{
+				const T minKey = loadStatsKey<T>(delta.minKey);
+				const T maxKey = loadStatsKey<T>(delta.maxKey);
+				if (stats->numEntries == 0 || minKey < loadStatsKey<T>(stats->minKey))
+				{
+					storeStatsKey<T>(minKey, stats->minKey);
+				}
+				if (stats->numEntries == 0 || loadStatsKey<T>(stats->maxKey) < maxKey)
+				{
+					storeStatsKey<T>(maxKey, stats->maxKey);
+				}
+				if (stats->numBuckets == 0)
+				{
+					stats->numBuckets = 1;
+					storeStatsKey<T>(maxKey, stats->bucketBounds[0]);
+				}
+				else if (loadStatsKey<T>(stats->bucketBounds[stats->numBuckets - 1]) < maxKey)
+				{
+					storeStatsKey<T>(maxKey, stats->bucketBounds[stats->numBuckets - 1]);
+				}
+			}
+			for (int i = 0; i < SKETCH_REGISTERS; i++)
+			{
+				stats->sketch[i] = std::max(stats->sketch[i], delta.sketch[i]);
+			}
+			for (int b = 0; b < stats->numBuckets; b++)
+			{
+				stats->bucketCounts[b] = std::max<std::int64_t>(static_cast<std::int64_t>(stats->bucketCounts[b]) + delta.bucketCounts[b], 0);
+			}
+			stats->numEntries = std::max<std::int64_t>(static_cast<std::int64_t>(stats->numEntries) + delta.numEntries, 0);
+			delta.clear();
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::splitBucket(int b)
+	{
+		// the entry counts give the exact number of entries in the bucket, and its median
+		const T upper = loadStatsKey<T>(stats->bucketBounds[b]);
+		const std::size_t below = b == 0 ? 0 : rankOf<T>(loadStatsKey<T>(stats->bucketBounds[b - 1]), true);
+		const std::size_t total = rankOf<T>(upper, true) - below;
+		stats->bucketCounts[b] = total;
+
+		T middle;
+		RecordId rid;
+		std::size_t left = 0;
+		if (total >= 2 && entryAtRank<T>(below + (total - 1) / 2, middle, rid))
+		{
+			if (middle == upper)
+			{
+				// the upper half is all the last key, which gets a bucket to itself
+				const std::size_t belowUpper = rankOf<T>(upper, false);
+				if (belowUpper > below && entryAtRank<T>(belowUpper - 1, middle, rid))
+				{
+					left = belowUpper - below;
+				}
+			}
+			else
+			{
+				left = rankOf<T>(middle, true) - below;
+			}
+		}
+		if (left == 0 || left >= total)
+		{
+			return;
+		}
+
+		if (stats->numBuckets == HISTOGRAM_BUCKETS)
+		{
+			// the adjacent pair with the fewest entries, leaving bucket b out
+			int m = -1;
+			for (int i = 0; i + 1 < stats->numBuckets; i++)
+			{
+				if (i != b && i + 1 != b &&
+					(m < 0 || stats->bucketCounts[i] + stats->bucketCounts[i + 1] < stats->bucketCounts[m] + stats->bucketCounts[m + 1]))
+				{
+					m = i;
+				}
+			}
+			if (m < 0 || stats->bucketCounts[m] + stats->bucketCounts[m + 1] >= total)
+			{
+				return;
+			}
+			stats->bucketCounts[m] += stats->bucketCounts[m + 1];
+			const int after = stats->numBuckets - m - 2;
+			memmove(stats->bucketBounds[m], stats->bucketBounds[m + 1], (after + 1) * STATS_KEYSIZE);
+			memmove(stats->bucketCounts + m + 1, stats->bucketCounts + m + 2, after * sizeof(std::uint64_t));
+			stats->numBuckets -= 1;
+			if (b > m)
+			{
+				b--;
+			}
+		}
+
+		const int after = stats->numBuckets - b;
+		memmove(stats->bucketBounds[b + 1], stats->bucketBounds[b], after * STATS_KEYSIZE);
+		memmove(stats->bucketCounts + b + 1, stats->bucketCounts + b, after * sizeof(std::uint64_t));
+		storeStatsKey<T>(middle, stats->bucketBounds[b]);
+		stats->bucketCounts[b] = left;
+		stats->bucketCounts[b + 1] = total - left;
+		stats->numBuckets += 1;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Verification
+	// verifyIndex walks the whole tree once and checks every node against its
+	// parent. Each subtree hands back the pages and keys at its edges, which are
+	// checked against those of the subtrees next to it when they are joined.
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Number of shards of the set of pages a verifyIndex has reached, each under a latch of its own.
+	 */
+	static const int VERIFY_SHARDS = 64;
+
+	struct IndexVerifyState
+	{
+		/**
+		 * Report handed back, whose page and entry numbers are filled in at the end.
+		 */
+		IndexVerifyReport report;
+
+		/**
+		 * Number of problems found after the report had VERIFY_MAX_ERRORS.
+		 */
+		std::size_t numDropped;
+
+		/**
+		 * Serializes additions to report.
+		 */
+		std::mutex reportLatch;
+
+		/**
+		 * Frames of the ring each thread reads pages through.
+		 */
+		std::uint32_t ringFrames;
+
+		/**
+		 * Page number past the last page of the index file. A page number beyond it must not be read.
+		 */
+		PageId endPageNo;
+
+		/**
+		 * Whether the left siblings of the leaves are exact, which they need not be once the index has been
+		 * written concurrently.
+		 */
+		bool exactLeftSibs;
+
+		/**
+		 * Number of threads that can still be started.
+		 */
+		std::atomic<int> spareThreads;
+
+		std::atomic<std::size_t> numNonLeafPages;
+		std::atomic<std::size_t> numLeafPages;
+		std::atomic<std::size_t> numPostingPages;
+
+		/**
+		 * Inserts less deletes waiting in message buffers.
+		 */
+		std::atomic<std::int64_t> numBuffered;
+
+		/**
+		 * Pages reached so far, sharded by page number.
+		 */
+		std::unordered_set<PageId> reached[VERIFY_SHARDS];
+		std::mutex reachedLatch[VERIFY_SHARDS];
+
+		IndexVerifyState(const std::uint32_t ringFrames, const PageId endPageNo, const bool exactLeftSibs, const int spareThreads)
+			: numDropped(0), ringFrames(ringFrames), endPageNo(endPageNo), exactLeftSibs(exactLeftSibs), spareThreads(spareThreads),
+			  numNonLeafPages(0), numLeafPages(0), numPostingPages(0), numBuffered(0)
+		{
+		}
+
+		/**
+		 * Add a problem found on pageNo to the report.
+		 */
+		void problem(const PageId pageNo, const std::string &what)
+		{
+			std::lock_guard<std::mutex> guard(reportLatch);
+			if (report.errors.size() < VERIFY_MAX_ERRORS)
+			{
+				report.errors.push_back("page " + std::to_string(pageNo) + ": " + what);
+			}
+			else
+			{
+				numDropped += 1;
+			}
+		}
+
+		/**
+		 * Take note of page fromNo pointing to pageNo, which must be in the file and not reached before.
+		 * @return  whether pageNo is to be read
+		 */
+		bool reach(const PageId fromNo, const PageId pageNo)
+		{
+			if (pageNo == Page::INVALID_NUMBER || pageNo >= endPageNo)
+			{
+				problem(fromNo, "points to page " + std::to_string(pageNo) + ", which is not in the file");
+				return false;
+			}
+			std::lock_guard<std::mutex> guard(reachedLatch[pageNo % VERIFY_SHARDS]);
+			if (!reached[pageNo % VERIFY_SHARDS].insert(pageNo).second)
+			{
+				problem(fromNo, "points to page " + std::to_string(pageNo) + ", which is reached from another page as well");
+				return false;
+			}
+			return true;
+		}
+
+		/**
+		 * Take one of the threads that can still be started.
+		 */
+		bool takeThread()
+		{
+			int spare = spareThreads.load();
+			while (spare > 0)
+			{
+				if (spareThreads.compare_exchange_weak(spare, spare - 1))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	template <class T>
+	static inline bool sameKey(const T &a, const T &b)
+	{
+		return !(a < b) && !(b < a);
+	}
+
+	/**
+	 * Check that the high key of a node with a right sibling is the separator after it.
+	 */
+	template <class T>
+	static void verifyHighKey(IndexVerifyState &state, const PageId pageNo, const PageId rightNo, const T &highKey, const T *high)
+	{
+		if (rightNo == Page::INVALID_NUMBER)
+		{
+			// the last node of a level has no separator after it, which joining the levels checks
+			return;
+		}
+		if (high == NULL)
+		{
+			state.problem(pageNo, "has right sibling " + std::to_string(rightNo) + " but is the last node of its level under the root");
+		}
+		else if (!sameKey<T>(highKey, *high))
+		{
+			state.problem(pageNo, "has a high key other than the separator after it");
+		}
+	}
+
+	/**
+	 * Check that the keys of a node are in order and between the separators around it.
+	 */
+	template <class T>
+	static void verifyKeys(IndexVerifyState &state, const PageId pageNo, const T *keys, const int numKeys, const T *low, const T *high)
+	{
+		for (int i = 1; i < numKeys; i++)
+		{
+			if (keys[i] < keys[i - 1])
+			{
+				state.problem(pageNo, "has keys out of order at slot " + std::to_string(i));
+				break;
+			}
+		}
+		if (numKeys > 0 && low != NULL && keys[0] < *low)
+		{
+			state.problem(pageNo, "has a first key below the separator before it");
+		}
+		if (numKeys > 0 && high != NULL && *high < keys[numKeys - 1])
+		{
+			state.problem(pageNo, "has a last key above the separator after it");
+		}
+	}
+
+	/**
+	 * Check that subtree right follows subtree left at every level, and add it to left.
+	 */
+	template <class T>
+	static void joinVerified(IndexVerifyState &state, VerifiedSubtree<T> &left, const VerifiedSubtree<T> &right)
+	{
+		for (std::size_t l = 0; l < right.firstPageNo.size(); l++)
+		{
+			if (left.lastPageNo[l] != Page::INVALID_NUMBER && right.firstPageNo[l] != Page::INVALID_NUMBER &&
+				left.lastRightSibPageNo[l] != right.firstPageNo[l])
+			{
+				state.problem(left.lastPageNo[l], "has right sibling " + std::to_string(left.lastRightSibPageNo[l]) +
+													  " instead of " + std::to_string(right.firstPageNo[l]));
+			}
+		}
+		if (state.exactLeftSibs && left.lastPageNo[0] != Page::INVALID_NUMBER && right.firstPageNo[0] != Page::INVALID_NUMBER &&
+			right.firstLeftSibPageNo != left.lastPageNo[0])
+		{
+			state.problem(right.firstPageNo[0], "has left sibling " + std::to_string(right.firstLeftSibPageNo) +
+													" instead of " + std::to_string(left.lastPageNo[0]));
+		}
+		if (right.hasKeys)
+		{
+			if (left.hasKeys && right.minKey < left.maxKey)
+			{
+				state.problem(right.firstPageNo[0], "has keys below those of the leaves before it");
+			}
+			if (!left.hasKeys)
+			{
+				left.minKey = right.minKey;
+			}
+			left.maxKey = right.maxKey;
+			left.hasKeys = true;
+		}
+
+		// a subtree that could not be followed leaves its edges unknown, rather than checking past it
+		if (left.firstPageNo[0] == Page::INVALID_NUMBER)
+		{
+			left.firstLeftSibPageNo = right.firstLeftSibPageNo;
+		}
+		for (std::size_t l = 0; l < right.firstPageNo.size(); l++)
+		{
+			if (left.firstPageNo[l] == Page::INVALID_NUMBER)
+			{
+				left.firstPageNo[l] = right.firstPageNo[l];
+			}
+			left.lastPageNo[l] = right.lastPageNo[l];
+			left.lastRightSibPageNo[l] = right.lastRightSibPageNo[l];
+		}
+		left.numEntries += right.numEntries;
+	}
+
+	IndexVerifyReport BTreeIndex::verifyIndex(const int numThreads, const std::uint32_t bufferFrames)
+	{
+		const int threads = std::max(numThreads, 1);
+		IndexVerifyState state(std::max<std::uint32_t>(bufferFrames / threads, 1), file->getEndPageNo(), !writtenConcurrently, threads - 1);
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				verifyTyped<PackedIntKey>(state);
+			}
+			else
+			{
+				verifyTyped<int>(state);
+			}
+			break;
+		case DOUBLE:
+			verifyTyped<double>(state);
+			break;
+		case STRING:
+			verifyTyped<StringKey>(state);
+			break;
+		case COMPOSITE:
+			verifyTyped<CompositeKey>(state);
+			break;
+		}
+
+		state.report.numNonLeafPages = state.numNonLeafPages;
+		state.report.numLeafPages = state.numLeafPages;
+		state.report.numPostingPages = state.numPostingPages;
+		if (state.numDropped > 0)
+		{
+			state.report.errors.push_back("and " + std::to_string(state.numDropped) + " more problems");
+		}
+		return state.report;
+	}
+
+	template <class T>
+	void BTreeIndex::verifyTyped(IndexVerifyState &state)
+	{
+		// the meta page, the statistics page and the free pages are in use outside the tree
+		BufRing ring(state.ringFrames);
+		state.reach(headerPageNum, headerPageNum);
+		if (statsPageNum != Page::INVALID_NUMBER)
+		{
+			state.reach(headerPageNum, statsPageNum);
+		}
+		PageId fromNo = headerPageNum;
+		PageId freeNo = freeListHead;
+		while (freeNo != Page::INVALID_NUMBER && state.reach(fromNo, freeNo))
+		{
+			Page *temp;
+			bufMgr->readPage(file, freeNo, temp, ring);
+			const PageId nextNo = reinterpret_cast<FreePageInfo *>(temp)->nextFreePageNo;
+			bufMgr->unPinPage(file, freeNo, false);
+			fromNo = freeNo;
+			freeNo = nextNo;
+		}
+
+		const PageId rootNo = rootPageNum;
+		if (!state.reach(headerPageNum, rootNo))
+		{
+			return;
+		}
+		Page *temp;
+		bufMgr->readPage(file, rootNo, temp, ring);
+		const int rootLevel = reinterpret_cast<NonLeafNode<T> *>(temp)->level;
+		bufMgr->unPinPage(file, rootNo, false);
+		if (rootLevel < 1 || rootLevel >= MAX_TREE_HEIGHT)
+		{
+			state.problem(rootNo, "is the root but is at level " + std::to_string(rootLevel));
+			return;
+		}
+		state.report.height = rootLevel + 1;
+
+		VerifiedSubtree<T> tree(rootLevel + 1);
+		try
+		{
+			verifySubtree<T>(state, ring, rootNo, rootLevel, NULL, NULL, tree);
+		}
+		catch (const BadgerDbException &e)
+		{
+			state.problem(rootNo, e.message());
+			return;
+		}
+
+		// nothing comes after the last node of each level, or before the first leaf
+		for (int l = 0; l <= rootLevel; l++)
+		{
+			if (tree.lastPageNo[l] != Page::INVALID_NUMBER && tree.lastRightSibPageNo[l] != Page::INVALID_NUMBER)
+			{
+				state.problem(tree.lastPageNo[l], "is the last node of level " + std::to_string(l) + " but has right sibling " +
+													  std::to_string(tree.lastRightSibPageNo[l]));
+			}
+		}
+		if (state.exactLeftSibs && tree.firstPageNo[0] != Page::INVALID_NUMBER && tree.firstLeftSibPageNo != Page::INVALID_NUMBER)
+		{
+			state.problem(tree.firstPageNo[0], "is the first leaf but has left sibling " + std::to_string(tree.firstLeftSibPageNo));
+		}
+
+		state.report.numEntries = tree.numEntries;
+		if (stats != NULL)
+		{
+			std::lock_guard<std::mutex> guard(statsLatch);
+			foldStatsDeltas();
+			if (static_cast<std::int64_t>(stats->numEntries) != static_cast<std::int64_t>(tree.numEntries) + state.numBuffered)
+			{
+				state.problem(statsPageNum, "counts " + std::to_string(stats->numEntries) + " entries, but the leaves and message buffers hold " +
+												std::to_string(static_cast<std::int64_t>(tree.numEntries) + state.numBuffered));
+			}
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::verifySubtree(IndexVerifyState &state, BufRing &ring, const PageId pageNo, const int level, const T *low, const T *high, VerifiedSubtree<T> &out)
+	{
+		if (level == 0)
+		{
+			verifyLeaf<T>(state, ring, pageNo, low, high, out);
+			return;
+		}
+
+		// the node is copied out, so that each thread has a single page pinned
+		NonLeafNode<T> node;
+		Page *temp;
+		bufMgr->readPage(file, pageNo, temp, ring);
+		memcpy(&node, temp, sizeof(node));
+		bufMgr->unPinPage(file, pageNo, false);
+		state.numNonLeafPages++;
+
+		out.firstPageNo[level] = pageNo;
+		out.lastPageNo[level] = pageNo;
+		out.lastRightSibPageNo[level] = node.rightSibPageNo;
+		if (node.level != level)
+		{
+			state.problem(pageNo, "is at level " + std::to_string(node.level) + " instead of " + std::to_string(level));
+			return;
+		}
+		if (node.numKeys < 0 || node.numKeys > nodeOccupancy)
+		{
+			state.problem(pageNo, "has " + std::to_string(node.numKeys) + " keys, out of [0, " + std::to_string(nodeOccupancy) + "]");
+			return;
+		}
+		verifyKeys<T>(state, pageNo, node.keyArray, node.numKeys, low, high);
+		verifyHighKey<T>(state, pageNo, node.rightSibPageNo, node.highKey, high);
+
+		if (node.numMessages < 0 || node.numMessages > bufferCapacity)
+		{
+			state.problem(pageNo, "has " + std::to_string(node.numMessages) + " buffered messages, out of [0, " + std::to_string(bufferCapacity) + "]");
+		}
+		else
+		{
+			for (int i = 0; i < node.numMessages; i++)
+			{
+				const BufferedMessage<T> msg = getMessage<T>(&node, i);
+				if ((low != NULL && msg.key < *low) || (high != NULL && *high < msg.key))
+				{
+					state.problem(pageNo, "has buffered message " + std::to_string(i) + " for a key outside the node");
+				}
+				state.numBuffered += msg.isDelete ? -1 : 1;
+			}
+		}
+
+		// children above the leaves are checked on threads of their own while there are any to spare
+		const int numChildren = node.numKeys + 1;
+		std::vector<VerifiedSubtree<T> > children(numChildren, VerifiedSubtree<T>(level));
+		std::vector<char> checked(numChildren, false);
+		std::vector<std::thread> workers;
+		for (int i = 0; i < numChildren; i++)
+		{
+			const PageId childNo = node.pageNoArray[i];
+			if (!state.reach(pageNo, childNo))
+			{
+				continue;
+			}
+			checked[i] = true;
+			const T *childLow = i == 0 ? low : &node.keyArray[i - 1];
+			const T *childHigh = i == node.numKeys ? high : &node.keyArray[i];
+			VerifiedSubtree<T> &child = children[i];
+			const std::function<void(BufRing &)> check = [this, &state, childNo, level, childLow, childHigh, &child](BufRing &childRing)
+			{
+				try
+				{
+					this->verifySubtree<T>(state, childRing, childNo, level - 1, childLow, childHigh, child);
+				}
+				catch (const BadgerDbException &e)
+				{
+					state.problem(childNo, e.message());
+				}
+			};
+			if (level > 1 && state.takeThread())
+			{
+				// a thread of its own reads through a ring of its own
+				workers.push_back(std::thread([&state, check]()
+											  {
+												  BufRing threadRing(state.ringFrames);
+												  check(threadRing);
+												  state.spareThreads++;
+											  }));
+			}
+			else
+			{
+				check(ring);
+			}
+		}
+		for (std::size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i].join();
+		}
+
+		for (int i = 0; i < numChildren; i++)
+		{
+			if (countsValid && checked[i] && children[i].numEntries != node.countArray[i])
+			{
+				state.problem(pageNo, "counts " + std::to_string(node.countArray[i]) + " entries under child " + std::to_string(i) +
+										  ", which holds " + std::to_string(children[i].numEntries));
+			}
+			joinVerified<T>(state, out, children[i]);
+		}
+	}
+
+	/**
+	 * Copy a leaf page for verifyLeaf, decoding it when it is packed.
+	 * @return  false if the columns of a packed leaf do not fit in the page
+	 */
+	template <class T>
+	static inline bool copyLeaf(const Page *page, LeafNode<T> &leaf)
+	{
+		memcpy(&leaf, page, sizeof(leaf));
+		return true;
+	}
+
+	template <>
+	inline bool copyLeaf<PackedIntKey>(const Page *page, LeafNodePacked &leaf)
+	{
+		return unpackLeaf(page, &leaf);
+	}
+
+	template <class T>
+	void BTreeIndex::verifyLeaf(IndexVerifyState &state, BufRing &ring, const PageId pageNo, const T *low, const T *high, VerifiedSubtree<T> &out)
+	{
+		LeafNode<T> leaf;
+		Page *temp;
+		bufMgr->readPage(file, pageNo, temp, ring);
+		const bool decoded = copyLeaf<T>(temp, leaf);
+		bufMgr->unPinPage(file, pageNo, false);
+		state.numLeafPages++;
+
+		out.firstPageNo[0] = pageNo;
+		out.lastPageNo[0] = pageNo;
+		out.lastRightSibPageNo[0] = leaf.rightSibPageNo;
+		out.firstLeftSibPageNo = leaf.leftSibPageNo;
+		if (leaf.numKeys < 0 || leaf.numKeys > leafOccupancy)
+		{
+			state.problem(pageNo, "has " + std::to_string(leaf.numKeys) + " keys, out of [0, " + std::to_string(leafOccupancy) + "]");
+			return;
+		}
+		if (!decoded)
+		{
+			state.problem(pageNo, "has packed columns that do not fit in the page");
+			return;
+		}
+		verifyKeys<T>(state, pageNo, leaf.keyArray, leaf.numKeys, low, high);
+		verifyHighKey<T>(state, pageNo, leaf.rightSibPageNo, leaf.highKey, high);
+
+		int numDeleted = 0;
+		int numPostings = 0;
+		for (int i = 0; i < leaf.numKeys; i++)
+		{
+			if (isPostingSlot(leaf.ridArray[i]))
+			{
+				numPostings += 1;
+				out.numEntries += verifyPostingList(state, ring, pageNo, leaf.ridArray[i]);
+			}
+			else if (isDeletedSlot(leaf.ridArray[i]))
+			{
+				numDeleted += 1;
+			}
+			else
+			{
+				out.numEntries += 1;
+			}
+		}
+		if (numDeleted != leaf.numDeleted)
+		{
+			state.problem(pageNo, "counts " + std::to_string(leaf.numDeleted) + " deleted slots, but has " + std::to_string(numDeleted));
+		}
+		if (numPostings != leaf.numPostings)
+		{
+			state.problem(pageNo, "counts " + std::to_string(leaf.numPostings) + " posting list slots, but has " + std::to_string(numPostings));
+		}
+
+		if (leaf.numKeys > 0)
+		{
+			out.hasKeys = true;
+			out.minKey = leaf.keyArray[0];
+			out.maxKey = leaf.keyArray[leaf.numKeys - 1];
+		}
+	}
+
+	std::uint64_t BTreeIndex::verifyPostingList(IndexVerifyState &state, BufRing &ring, const PageId leafNo, const RecordId &slot)
+	{
+		std::uint64_t count = 0;
+		PageId fromNo = leafNo;
+		PageId pageNo = slot.page_number;
+		while (pageNo != Page::INVALID_NUMBER && state.reach(fromNo, pageNo))
+		{
+			Page *temp;
+			bufMgr->readPage(file, pageNo, temp, ring);
+			const PostingPage *page = reinterpret_cast<const PostingPage *>(temp);
+			const int numRids = page->numRids;
+			const PageId nextNo = page->nextPageNo;
+			bufMgr->unPinPage(file, pageNo, false);
+			state.numPostingPages++;
+
+			if (numRids < 1 || numRids > POSTINGSIZE)
+			{
+				state.problem(pageNo, "has " + std::to_string(numRids) + " record ids, out of [1, " + std::to_string(POSTINGSIZE) + "]");
+			}
+			else
+			{
+				count += numRids;
+			}
+			fromNo = pageNo;
+			pageNo = nextNo;
+		}
+		return count;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::startScan
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::startScan(const void *lowValParm,
+							   const Operator lowOpParm,
+							   const void *highValParm,
+							   const Operator highOpParm,
+							   const ScanOrder order)
+	{
+		startScan(scanCursor, lowValParm, lowOpParm, highValParm, highOpParm, order);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::openScan
+	// -----------------------------------------------------------------------------
+
+	BTreeScanCursor BTreeIndex::openScan(const void *lowValParm,
+										 const Operator lowOpParm,
+										 const void *highValParm,
+										 const Operator highOpParm,
+										 const ScanOrder order)
+	{
+		BTreeScanCursor cursor;
+		startScan(cursor, lowValParm, lowOpParm, highValParm, highOpParm, order);
+		return cursor;
+	}
+
+	void BTreeIndex::startScan(BTreeScanCursor &cursor,
+							   const void *lowValParm,
+							   const Operator lowOpParm,
+							   const void *highValParm,
+							   const Operator highOpParm,
+							   const ScanOrder order)
+	{
+		if (!(lowOpParm == GT || lowOpParm == GTE) ||
+			!(highOpParm == LT || highOpParm == LTE))
+		{
+			throw BadOpcodesException();
+		}
+
+		// a cursor runs one scan at a time
+		if (cursor.scanExecuting)
+		{
+			endScan(cursor);
+		}
+
+		cursor.index = this;
+		cursor.lowOp = lowOpParm;
+		cursor.highOp = highOpParm;
+		cursor.order = order;
+		cursor.postingPos = -1;
+
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				startScanTyped<PackedIntKey>(cursor, keyFromPtr<PackedIntKey>(lowValParm), keyFromPtr<PackedIntKey>(highValParm));
+			}
+			else
+			{
+				startScanTyped<int>(cursor, keyFromPtr<int>(lowValParm), keyFromPtr<int>(highValParm));
+			}
+			break;
+		case DOUBLE:
+			startScanTyped<double>(cursor, keyFromPtr<double>(lowValParm), keyFromPtr<double>(highValParm));
+			break;
+		case STRING:
+			startScanTyped<StringKey>(cursor, keyFromPtr<StringKey>(lowValParm), keyFromPtr<StringKey>(highValParm));
+			break;
+		case COMPOSITE:
+			startScanTyped<CompositeKey>(cursor, keyFromPtr<CompositeKey>(lowValParm), keyFromPtr<CompositeKey>(highValParm));
+			break;
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::startPrefixScan
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::startPrefixScan(const void *prefix, const int numColumns, const ScanOrder order)
+	{
+		startPrefixScan(scanCursor, prefix, numColumns, order);
+	}
+
+	BTreeScanCursor BTreeIndex::openPrefixScan(const void *prefix, const int numColumns, const ScanOrder order)
+	{
+		BTreeScanCursor cursor;
+		startPrefixScan(cursor, prefix, numColumns, order);
+		return cursor;
+	}
+
+	void BTreeIndex::startPrefixScan(BTreeScanCursor &cursor, const void *prefix, const int numColumns, const ScanOrder order)
+	{
+		if (numColumns < 1 || numColumns > static_cast<int>(keyColumns.size()))
+		{
+			throw BadIndexInfoException("Invalid number of prefix columns");
+		}
+		if (attributeType != COMPOSITE)
+		{
+			// the prefix is the whole key
+			startScan(cursor, prefix, GTE, prefix, LTE, order);
+			return;
+		}
+
+		// the keys starting with prefix lie between it padded with zero bytes and with one bytes
+		CompositeKey lowVal;
+		CompositeKey highVal;
+		const char *value = reinterpret_cast<const char *>(prefix);
+		int pos = 0;
+		for (int i = 0; i < numColumns; i++)
+		{
+			encodeKeyColumn(keyColumns[i].type, value + pos, lowVal.bytes + pos);
+			pos += keyColumnSize(keyColumns[i].type);
+		}
+		memcpy(highVal.bytes, lowVal.bytes, pos);
+		memset(lowVal.bytes + pos, 0, COMPOSITESIZE - pos);
+		memset(highVal.bytes + pos, 0xff, COMPOSITESIZE - pos);
+
+		// a cursor runs one scan at a time
+		if (cursor.scanExecuting)
+		{
+			endScan(cursor);
+		}
+
+		cursor.index = this;
+		cursor.lowOp = GTE;
+		cursor.highOp = LTE;
+		cursor.order = order;
+		cursor.postingPos = -1;
+		startScanTyped<CompositeKey>(cursor, lowVal, highVal);
+	}
+
+	template <class T>
+	void BTreeIndex::startScanTyped(BTreeScanCursor &cursor, const T &lowVal, const T &highVal)
+	{
+		if (highVal < lowVal)
+		{
+			throw BadScanrangeException();
+		}
+		if (bufferCapacity > 0)
+		{
+			// the leaves have to hold every entry in range before the scan reads them
+			flushRange<T>(&lowVal, &highVal);
+		}
+		cursor.setScanRange<T>(lowVal, highVal);
+		if (cursor.order == DESCENDING)
+		{
+			startScanDescending<T>(cursor, highVal);
+			return;
+		}
+
+		// go down to the leftmost leaf that may hold lowVal, and start reading the leaves after it
+		DescentPath path;
+		const PageId leafNo = findNode<T>(lowVal, 0, true, readAheadLeaves > 0 ? &path : NULL);
+		fetchScanLeaf(cursor, leafNo);
+		startReadAhead<T>(cursor, path, leafNo);
+
+		// find the first entry satisfying the low bound, moving right if needed
+		LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		int entry;
+		while (true)
+		{
+			entry = cursor.lowOp == GT ? nodeUpperBound<T>(currLeaf->keyArray, currLeaf->numKeys, lowVal)
+									   : nodeLowerBound<T>(currLeaf->keyArray, currLeaf->numKeys, lowVal);
+			while (entry < currLeaf->numKeys && isDeletedSlot(currLeaf->ridArray[entry]))
+			{
+				entry++;
+			}
+			if (entry < currLeaf->numKeys)
+			{
+				break;
+			}
+
+			if (!moveToNextLeaf<T>(cursor))
+			{
+				throw NoSuchKeyFoundException();
+			}
+			currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		}
+
+		if (!cursor.satisfiesHigh<T>(currLeaf->keyArray[entry]))
+		{
+			releaseScanLeaf(cursor);
+			throw NoSuchKeyFoundException();
+		}
+
+		cursor.scanExecuting = true;
+		cursor.nextEntry = entry;
+	}
+
+	template <class T>
+	void BTreeIndex::startScanDescending(BTreeScanCursor &cursor, const T &highVal)
+	{
+		// read-ahead follows right links only
+		cursor.readAheadPageNum = Page::INVALID_NUMBER;
+		cursor.readAheadPending = 0;
+		cursor.readAheadDepth = 0;
+
+		// go down to the leftmost leaf that may hold highVal when it is excluded, so that
+		// its duplicates are not walked through, else to the rightmost one
+		fetchScanLeaf(cursor, findNode<T>(highVal, 0, cursor.highOp == LT, NULL));
+
+		// find the last entry satisfying the high bound, moving left if needed. Duplicates
+		// of highVal may go on in the leaves to the left, so every leaf is searched again.
+		LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		int entry;
+		while (true)
+		{
+			entry = (cursor.highOp == LT ? nodeLowerBound<T>(currLeaf->keyArray, currLeaf->numKeys, highVal)
+										 : nodeUpperBound<T>(currLeaf->keyArray, currLeaf->numKeys, highVal)) - 1;
+			while (entry >= 0 && isDeletedSlot(currLeaf->ridArray[entry]))
+			{
+				entry--;
+			}
+			if (entry >= 0)
+			{
+				break;
+			}
+
+			if (!moveToPrevLeaf<T>(cursor))
+			{
+				throw NoSuchKeyFoundException();
+			}
+			currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		}
+
+		if (!cursor.satisfiesLow<T>(currLeaf->keyArray[entry]))
+		{
+			releaseScanLeaf(cursor);
+			throw NoSuchKeyFoundException();
+		}
+
+		cursor.scanExecuting = true;
+		cursor.nextEntry = entry;
+	}
+
+	std::size_t BTreeIndex::readPostingRids(BTreeScanCursor &cursor, const RecordId &slot, RecordId *outRids, const std::size_t maxRids)
+	{
+		if (cursor.postingPos < 0)
+		{
+			cursor.postingNextPageNo = readPostingPage(slot.page_number, cursor.postingRids);
+			cursor.postingPos = 0;
+		}
+
+		std::size_t count = 0;
+		while (count < maxRids)
+		{
+			const std::size_t n = std::min(maxRids - count, cursor.postingRids.size() - cursor.postingPos);
+			std::copy(cursor.postingRids.begin() + cursor.postingPos, cursor.postingRids.begin() + cursor.postingPos + n, outRids + count);
+			cursor.postingPos += n;
+			count += n;
+			if (static_cast<std::size_t>(cursor.postingPos) < cursor.postingRids.size())
 			{
-				try
-				{
-					scanner.scanNext(rid);
-					recordStr = scanner.getRecord();
-					record = recordStr.c_str();
-					key = record + attrByteOffset;
-					this->insertEntry(key, rid);
-				}
-				catch (EndOfFileException *x)
-				{
-					break;
-				}
+				break;
+			}
+			if (cursor.postingNextPageNo == Page::INVALID_NUMBER)
+			{
+				cursor.postingPos = -1;
+				break;
 			}
+			cursor.postingNextPageNo = readPostingPage(cursor.postingNextPageNo, cursor.postingRids);
+			cursor.postingPos = 0;
 		}
+		return count;
 	}
 
-	// -----------------------------------------------------------------------------
-	// BTreeIndex::~BTreeIndex -- destructor
-	// -----------------------------------------------------------------------------
-
-	BTreeIndex::~BTreeIndex()
+	void BTreeIndex::fetchScanLeaf(BTreeScanCursor &cursor, const PageId pageNo)
 	{
-		// endscan
-		if (scanExecuting)
+		cursor.currentPageNum = pageNo;
+		if (packedLeaves)
 		{
-			endScan();
+			// the cursor reads a decoded copy of a packed leaf
+			if (!cursor.packedLeaf)
+			{
+				cursor.packedLeaf.reset(new LeafNodePacked);
+			}
+			Page *page;
+			bufMgr->readPage(file, pageNo, page);
+			const bool valid = unpackLeaf(page, cursor.packedLeaf.get());
+			bufMgr->unPinPage(file, pageNo, false);
+			if (!valid)
+			{
+				throw BadIndexInfoException("Invalid packed leaf");
+			}
+			cursor.currentPageData = reinterpret_cast<Page *>(cursor.packedLeaf.get());
+			return;
+		}
+		if (nodeLatches == NULL)
+		{
+			bufMgr->readPage(file, pageNo, cursor.currentPageData);
+			return;
 		}
 
-		// flush the file
-		bufMgr->flushFile(this->file);
+		// copy the leaf, retrying until no writer got in the way
+		if (!cursor.leafCopy)
+		{
+			cursor.leafCopy.reset(new Page());
+		}
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		OptimisticLatch &latch = nodeLatches->latchFor(pageNo);
+		std::uint64_t version;
+		do
+		{
+			version = latch.readLock();
+			*cursor.leafCopy = *page;
+		} while (!latch.validate(version));
+		bufMgr->unPinPage(file, pageNo, false);
+		cursor.currentPageData = cursor.leafCopy.get();
+	}
 
-		delete file;
+	void BTreeIndex::releaseScanLeaf(BTreeScanCursor &cursor)
+	{
+		if (nodeLatches == NULL && !packedLeaves)
+		{
+			bufMgr->unPinPage(file, cursor.currentPageNum, false);
+		}
+		cursor.currentPageNum = Page::INVALID_NUMBER;
+		cursor.currentPageData = NULL;
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::insertEntry
+	// BTreeIndex::scanNext
 	// -----------------------------------------------------------------------------
 
-	void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+	void BTreeIndex::scanNext(RecordId &outRid, void *outIncluded)
 	{
-		recursiveInsert(*((int *)key), rid, false, this->rootPageNum);
+		scanCursor.scanNext(outRid, outIncluded);
 	}
 
-	// ------------------------------------------------------------------------------
-	// Recursicve insert
-	// Returns a KeyPagePair to push up when splitting
-	// ------------------------------------------------------------------------------
-	KeyPagePair *BTreeIndex::recursiveInsert(int key, const RecordId rid, const bool isLeaf, PageId currPageId)
+	void BTreeIndex::scanNext(BTreeScanCursor &cursor, RecordId &outRid, void *outIncluded)
 	{
-		// get the page
-		Page *temp;
-		this->bufMgr->readPage(this->file, currPageId, temp);
+		char *included = includedSize > 0 ? reinterpret_cast<char *>(outIncluded) : NULL;
+		switch (attributeType)
+		{
+		case INTEGER:
+			if (packedLeaves)
+			{
+				scanNextTyped<PackedIntKey>(cursor, outRid, included);
+			}
+			else
+			{
+				scanNextTyped<int>(cursor, outRid, included);
+			}
+			break;
+		case DOUBLE:
+			scanNextTyped<double>(cursor, outRid, included);
+			break;
+		case STRING:
+			scanNextTyped<StringKey>(cursor, outRid, included);
+			break;
+		case COMPOSITE:
+			scanNextTyped<CompositeKey>(cursor, outRid, included);
+			break;
+		}
+	}
 
-		if (!isLeaf) // look for leaf
+	template <class T>
+	void BTreeIndex::scanNextTyped(BTreeScanCursor &cursor, RecordId &outRid, char *outIncluded)
+	{
+		// scan already ran off the range and released its page
+		if (cursor.currentPageNum == Page::INVALID_NUMBER)
+		{
+			throw IndexScanCompletedException();
+		}
+		if (cursor.order == DESCENDING)
 		{
-			NonLeafNodeInt *currNode;
-			currNode = reinterpret_cast<NonLeafNodeInt *>(temp);
+			scanPrevTyped<T>(cursor, outRid, outIncluded);
+			return;
+		}
 
-			// index to look for in the page array
-			int index = 0;
-			for (int currKey : currNode->keyArray)
+		LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		while (cursor.nextEntry >= currLeaf->numKeys || isDeletedSlot(currLeaf->ridArray[cursor.nextEntry]))
+		{
+			if (cursor.nextEntry < currLeaf->numKeys)
 			{
-				if (key < currKey)
-				{
-					break;
-				}
-				index++;
+				cursor.nextEntry++;
+				continue;
 			}
-
-			// check whether the next node is a leaf or not
-			bool isNextLeaf = false;
-			if (currNode->level == 1)
+			if (!moveToNextLeaf<T>(cursor))
 			{
-				isNextLeaf = true;
+				throw IndexScanCompletedException();
 			}
+			currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		}
+
+		if (!cursor.satisfiesHigh<T>(currLeaf->keyArray[cursor.nextEntry]))
+		{
+			releaseScanLeaf(cursor);
+			throw IndexScanCompletedException();
+		}
 
-			// recursive call. check if splitting has occurred
-			KeyPagePair *pairToAdd = recursiveInsert(key, rid, isNextLeaf, currNode->pageNoArray[index]);
-			if (pairToAdd != nullptr)
+		const RecordId &slot = currLeaf->ridArray[cursor.nextEntry];
+		if (isPostingSlot(slot))
+		{
+			readPostingRids(cursor, slot, &outRid, 1);
+			if (cursor.postingPos < 0)
 			{
-				// check if there is space for the key page pair in the current array
+				cursor.nextEntry++;
 			}
+			return;
 		}
-		else // insert into leaf
+		outRid = slot;
+		if (outIncluded != NULL)
 		{
-			LeafNodeInt *currNode;
-			currNode = reinterpret_cast<LeafNodeInt *>(temp);
+			memcpy(outIncluded, leafIncluded<T>(currLeaf, cursor.nextEntry), includedSize);
+		}
+		cursor.nextEntry++;
+	}
 
-			// check if there is enough space available on the leaf
-			// I.E NO SPLITTING
-			if (currNode->numKeys + 1 <= INTARRAYLEAFSIZE)
+	template <class T>
+	void BTreeIndex::scanPrevTyped(BTreeScanCursor &cursor, RecordId &outRid, char *outIncluded)
+	{
+		LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		while (cursor.nextEntry < 0 || isDeletedSlot(currLeaf->ridArray[cursor.nextEntry]))
+		{
+			if (cursor.nextEntry >= 0)
 			{
-				int i = 0;
-				// find where to insert
-				while (i < currNode->numKeys)
-				{
-					if (currNode->keyArray[i] > key)
-					{
-						// Shift contents of keyarray
-						for (int l = currNode->numKeys; l > i; l--)
-						{
-							currNode->keyArray[l] = currNode->keyArray[l - 1];
-						}
-						// shift contents of ridArray
-						for (int k = currNode->numKeys; k > i; k--)
-						{
-							currNode->ridArray[k] = currNode->ridArray[k - 1];
-						}
-
-						// after contents shifted, exit
-						break;
-					}
-					i += 1;
-				}
-
-				// insert key and rid at specified positions
-				currNode->keyArray[i] = key;
-				currNode->ridArray[i] = rid;
-				currNode->numKeys += 1;
-
-				// unpin page and return
-				this->bufMgr->unPinPage(this->file, currPageId, true);
-				return nullptr;
+				cursor.nextEntry--;
+				continue;
 			}
-			else // SPLITTING TIME BABY
+			if (!moveToPrevLeaf<T>(cursor))
 			{
-				// remember with leaf nodes, we COPY up instead of pushing up
-				// create sibling
-				Page *newSibPage;
-				LeafNodeInt *newSibNode;
-				PageId sibId;
-				this->bufMgr->allocPage(this->file, sibId, newSibPage);
-				newSibNode = reinterpret_cast<LeafNodeInt *>(newSibPage);
-				newSibNode->numKeys = 0;
-
-				// copy contents of old array into new array
-				for (int i = INTARRAYLEAFSIZE / 2; i < INTARRAYLEAFSIZE)
-				{
-					newSibNode->keyArray[i - (INTARRAYLEAFSIZE / 2)] = currNode->keyArray[i];
-					newSibNode->ridArray[i - (INTARRAYLEAFSIZE / 2)] = currNode->ridArray[i];
-					currNode->numKeys -= 1;
-					newSibNode->numKeys += 1;
-				}
-
-				// have new sibling point to original nodes neighbor
-				newSibNode->rightSibPageNo = currNode->rightSibPageNo;
-				currNode->rightSibPageNo = sibId;
-
-				// now we insert the value as we did before
-				if (newSibNode->keyArray[0] > key) // insert into orig sib
-				{
-					int i = 0;
-					// find where to insert
-					while (i < currNode->numKeys)
-					{
-						if (currNode->keyArray[i] > key)
-						{
-							// Shift contents of keyarray
-							for (int l = currNode->numKeys; l > i; l--)
-							{
-								currNode->keyArray[l] = currNode->keyArray[l - 1];
-							}
-							// shift contents of ridArray
-							for (int k = currNode->numKeys; k > i; k--)
-							{
-								currNode->ridArray[k] = currNode->ridArray[k - 1];
-							}
-
-							// after contents shifted, exit
-							break;
-						}
-						i += 1;
-					}
-
-					// insert key and rid at specified positions
-					currNode->keyArray[i] = key;
-					currNode->ridArray[i] = rid;
-					currNode->numKeys += 1;
-				}
-				else // insert into new sib
-				{
-					int i = 0;
-					// find where to insert
-					while (i < newSibNode->numKeys)
-					{
-						if (newSibNode->keyArray[i] > key)
-						{
-							// Shift contents of keyarray
-							for (int l = newSibNode->numKeys; l > i; l--)
-							{
-								newSibNode->keyArray[l] = newSibNode->keyArray[l - 1];
-							}
-							// shift contents of ridArray
-							for (int k = newSibNode->numKeys; k > i; k--)
-							{
-								newSibNode->ridArray[k] = newSibNode->ridArray[k - 1];
-							}
-
-							// after contents shifted, exit
-							break;
-						}
-						i += 1;
-					}
-
-					// insert key and rid at specified positions
-					newSibNode->keyArray[i] = key;
-					newSibNode->ridArray[i] = rid;
-					newSibNode->numKeys += 1;
-				}
-
-				// close both nodes and push up inserted values
-				KeyPagePair *pair;
-				pair->key = newSibNode->keyArray[0];
-				pair->pageId = sibId;
+				throw IndexScanCompletedException();
+			}
+			currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		}
 
-				// unpinPages
-				this->bufMgr->unPinPage(this->file, currPageId, true);
-				this->bufMgr->unPinPage(this->file, sibId, true);
+		if (!cursor.satisfiesLow<T>(currLeaf->keyArray[cursor.nextEntry]))
+		{
+			releaseScanLeaf(cursor);
+			throw IndexScanCompletedException();
+		}
 
-				return pair;
+		const RecordId &slot = currLeaf->ridArray[cursor.nextEntry];
+		if (isPostingSlot(slot))
+		{
+			readPostingRids(cursor, slot, &outRid, 1);
+			if (cursor.postingPos < 0)
+			{
+				cursor.nextEntry--;
 			}
+			return;
 		}
-
-		// unpin page. HAVE TO MOVE TO BEFORE RETURNS ONCE IMPLEMENTED
-		this->bufMgr->unPinPage(this->file, currPageId, false);
+		outRid = slot;
+		if (outIncluded != NULL)
+		{
+			memcpy(outIncluded, leafIncluded<T>(currLeaf, cursor.nextEntry), includedSize);
+		}
+		cursor.nextEntry--;
 	}
 
-	// -----------------------------------------------------------------------------
-	// BTreeIndex::startScan
-	// -----------------------------------------------------------------------------
-
-	void BTreeIndex::startScan(const void *lowValParm,
-							   const Operator lowOpParm,
-							   const void *highValParm,
-							   const Operator highOpParm)
+	template <class T>
+	bool BTreeIndex::moveToNextLeaf(BTreeScanCursor &cursor)
 	{
-		if (!(lowOpParm == GT || lowOpParm == GTE) ||
-			!(highOpParm == LT || highOpParm == LTE))
+		LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		PageId next = currLeaf->rightSibPageNo;
+		releaseScanLeaf(cursor);
+		if (next == Page::INVALID_NUMBER)
 		{
-			throw BadOpcodesException();
+			return false;
 		}
+		fetchScanLeaf(cursor, next);
+		cursor.nextEntry = 0;
 
-		lowValInt = *(int *)lowValParm;
-		highValInt = *(int *)highValParm;
-		lowValDouble = 1.0 * lowValInt;
-		highValDouble = 1.0 * highValInt;
-		lowValString = std::to_string(lowValInt);
-		highValString = std::to_string(highValInt);
-		lowOp = lowOpParm;
-		highOp = highOpParm;
-
-		if (lowValInt > highValInt)
+		// the scan keeps going, so read further ahead
+		if (cursor.readAheadPending > 0)
 		{
-			throw BadScanrangeException();
+			cursor.readAheadPending--;
 		}
+		cursor.readAheadDepth = std::min<int>(cursor.readAheadDepth * 2, readAheadLeaves);
+		readAhead<T>(cursor);
+		return true;
+	}
 
-		scanExecuting = true;
-
-		int lb = lowValInt;
-		int ub = highValInt;
-		if (lowOp == GT)
+	template <class T>
+	bool BTreeIndex::moveToPrevLeaf(BTreeScanCursor &cursor)
+	{
+		const PageId currNo = cursor.currentPageNum;
+		PageId prev = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData)->leftSibPageNo;
+		releaseScanLeaf(cursor);
+		if (prev == Page::INVALID_NUMBER)
 		{
-			lb++;
+			return false;
 		}
-		if (highOp == LT)
+		fetchScanLeaf(cursor, prev);
+
+		// a left link not yet moved over by a split skips the new leaves, which all
+		// lie between it and the leaf we came from
+		LeafNode<T> *prevLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+		while (prevLeaf->rightSibPageNo != currNo && prevLeaf->rightSibPageNo != Page::INVALID_NUMBER)
 		{
-			ub--;
+			prev = prevLeaf->rightSibPageNo;
+			releaseScanLeaf(cursor);
+			fetchScanLeaf(cursor, prev);
+			prevLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
 		}
+		cursor.nextEntry = prevLeaf->numKeys - 1;
+		return true;
+	}
 
-		Page *temp;
-		NonLeafNodeInt *curr;
-		bufMgr->readPage(file, rootPageNum, temp);
-		curr = reinterpret_cast<NonLeafNodeInt *>(temp);
-		int currNo = rootPageNum;
-		int next;
-		while (curr->level == 0)
+	template <class T>
+	void BTreeIndex::startReadAhead(BTreeScanCursor &cursor, const DescentPath &path, const PageId leafNo)
+	{
+		cursor.readAheadPageNum = Page::INVALID_NUMBER;
+		cursor.readAheadPending = 0;
+		cursor.readAheadDepth = std::min<int>(SCAN_READAHEAD_MIN, readAheadLeaves);
+		if (readAheadLeaves == 0 || path.depth == 0)
 		{
-			next = curr->pageNoArray[nodeOccupancy];
-			for (int i = 0; i < nodeOccupancy; i++)
-			{
-				if (lb < curr->keyArray[i])
-				{
-					next = curr->pageNoArray[i];
-					break;
-				}
-			}
-			if (next == -1)
-			{
-				scanExecuting = false;
-				throw NoSuchKeyFoundException();
-			}
-			bufMgr->unPinPage(file, currNo, false);
-
-			currNo = next;
-			bufMgr->readPage(file, currNo, temp);
-			curr = reinterpret_cast<NonLeafNodeInt *>(temp);
+			return;
 		}
 
-		next = curr->pageNoArray[nodeOccupancy];
-		for (int i = 0; i < nodeOccupancy; i++)
+		// the leaves to come are listed after this one in its parent
+		const PageId parentNo = path.pageNos[path.depth - 1];
+		Page *temp;
+		const bool cached = readNode(parentNo, temp);
+		NonLeafNode<T> *parent = reinterpret_cast<NonLeafNode<T> *>(temp);
+		OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(parentNo) : NULL;
+		int pos;
+		while (true)
 		{
-			if (lb < curr->keyArray[i])
+			const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+			const int numKeys = clampNumKeys(parent->numKeys, KeyTraits<T>::NONLEAFSIZE);
+			pos = std::find(parent->pageNoArray, parent->pageNoArray + numKeys + 1, leafNo) - parent->pageNoArray;
+			pos = pos <= numKeys ? pos : -1;
+			if (latch == NULL || latch->validate(version))
 			{
-				next = curr->pageNoArray[i];
 				break;
 			}
 		}
-		if (next == -1)
+		if (!cached)
 		{
-			scanExecuting = false;
-			throw NoSuchKeyFoundException();
+			bufMgr->unPinPage(file, parentNo, false);
 		}
-		bufMgr->unPinPage(file, currNo, false);
 
-		currNo = next;
-		bufMgr->readPage(file, currNo, temp);
-		LeafNodeInt *currLeaf = reinterpret_cast<LeafNodeInt *>(temp);
-		while (currLeaf->rightSibPageNo != 0)
+		if (pos >= 0)
+		{
+			cursor.readAheadPageNum = parentNo;
+			cursor.readAheadPos = pos + 1;
+			readAhead<T>(cursor);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::readAhead(BTreeScanCursor &cursor)
+	{
+		const int maxBatch = 64;
+		PageId pageNos[maxBatch];
+		while (cursor.readAheadPageNum != Page::INVALID_NUMBER && cursor.readAheadPending < cursor.readAheadDepth)
 		{
-			for (int i = 0; i < leafOccupancy; i++)
+			const PageId parentNo = cursor.readAheadPageNum;
+			const int want = std::min(cursor.readAheadDepth - cursor.readAheadPending, maxBatch);
+			Page *temp;
+			const bool cached = readNode(parentNo, temp);
+			NonLeafNode<T> *parent = reinterpret_cast<NonLeafNode<T> *>(temp);
+			OptimisticLatch *latch = nodeLatches != NULL ? &nodeLatches->latchFor(parentNo) : NULL;
+
+			int numKeys;
+			int count;
+			int pos;
+			bool pastHigh;
+			PageId rightNo;
+			bool rightInRange;
+			while (true)
 			{
-				if (currLeaf->keyArray[i] > ub)
+				const std::uint64_t version = latch != NULL ? latch->readLock() : 0;
+				numKeys = clampNumKeys(parent->numKeys, KeyTraits<T>::NONLEAFSIZE);
+				count = 0;
+				pastHigh = false;
+				for (pos = cursor.readAheadPos; count < want && pos <= numKeys; pos++)
 				{
-					scanExecuting = false;
-					throw NoSuchKeyFoundException();
+					// the leaf holds keys from the separator on its left up
+					if (pos > 0 && !cursor.satisfiesHigh<T>(parent->keyArray[pos - 1]))
+					{
+						pastHigh = true;
+						break;
+					}
+					pageNos[count++] = parent->pageNoArray[pos];
 				}
-				if (currLeaf->keyArray[i] >= lb)
+				rightNo = parent->rightSibPageNo;
+				rightInRange = rightNo != Page::INVALID_NUMBER && cursor.satisfiesHigh<T>(parent->highKey);
+				if (latch == NULL || latch->validate(version))
 				{
-					currentPageNum = currNo;
-					currentPageData = temp;
-					nextEntry = i;
-					return;
+					break;
 				}
 			}
-			next = currLeaf->rightSibPageNo;
-			bufMgr->unPinPage(file, currNo, false);
-			currNo = next;
-			bufMgr->readPage(file, currNo, temp);
-			currLeaf = reinterpret_cast<LeafNodeInt *>(temp);
-		}
-		for (int i = 0; i < leafOccupancy; i++)
-		{
-			if (currLeaf->keyArray[i] > ub)
+			if (!cached)
 			{
-				scanExecuting = false;
-				throw NoSuchKeyFoundException();
+				bufMgr->unPinPage(file, parentNo, false);
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				bufMgr->prefetchPage(file, pageNos[i]);
 			}
-			if (currLeaf->keyArray[i] >= lb)
+			cursor.readAheadPending += count;
+			cursor.readAheadPos = pos;
+			if (pastHigh)
 			{
-				currentPageNum = currNo;
-				currentPageData = temp;
-				nextEntry = i;
-				return;
+				cursor.readAheadPageNum = Page::INVALID_NUMBER;
+			}
+			else if (pos > numKeys)
+			{
+				// carry on in the next node of the level
+				cursor.readAheadPageNum = rightInRange ? rightNo : Page::INVALID_NUMBER;
+				cursor.readAheadPos = 0;
 			}
 		}
-		scanExecuting = false;
-		throw NoSuchKeyFoundException();
 	}
 
+
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::scanNext
+	// BTreeIndex::scanNextBatch
 	// -----------------------------------------------------------------------------
 
-	void BTreeIndex::scanNext(RecordId &outRid)
+	std::size_t BTreeIndex::scanNextBatch(RecordId *outRids, const std::size_t maxRids, void *outIncluded)
 	{
-		if (!scanExecuting)
+		return scanCursor.scanNextBatch(outRids, maxRids, outIncluded);
+	}
+
+	std::size_t BTreeIndex::scanNextBatch(BTreeScanCursor &cursor, RecordId *outRids, const std::size_t maxRids, void *outIncluded)
+	{
+		char *included = includedSize > 0 ? reinterpret_cast<char *>(outIncluded) : NULL;
+		switch (attributeType)
 		{
-			throw ScanNotInitializedException();
+		case INTEGER:
+			if (packedLeaves)
+			{
+				return scanNextBatchTyped<PackedIntKey>(cursor, outRids, maxRids, included);
+			}
+			return scanNextBatchTyped<int>(cursor, outRids, maxRids, included);
+		case DOUBLE:
+			return scanNextBatchTyped<double>(cursor, outRids, maxRids, included);
+		case STRING:
+			return scanNextBatchTyped<StringKey>(cursor, outRids, maxRids, included);
+		case COMPOSITE:
+			return scanNextBatchTyped<CompositeKey>(cursor, outRids, maxRids, included);
 		}
-		if (nextEntry == -1)
+		return 0;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::scanNextBatchTyped(BTreeScanCursor &cursor, RecordId *outRids, const std::size_t maxRids, char *outIncluded)
+	{
+		if (cursor.order == DESCENDING)
 		{
-			throw IndexScanCompletedException();
+			return scanPrevBatchTyped<T>(cursor, outRids, maxRids, outIncluded);
 		}
-		LeafNodeInt *currLeaf = reinterpret_cast<LeafNodeInt *>(currentPageData);
-		outRid = currLeaf->ridArray[nextEntry];
-		int ub = highValInt;
-		if (highOp == LT)
+
+		std::size_t count = 0;
+		while (count < maxRids && cursor.currentPageNum != Page::INVALID_NUMBER)
 		{
-			ub--;
+			LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+			if (cursor.nextEntry >= currLeaf->numKeys)
+			{
+				moveToNextLeaf<T>(cursor);
+				continue;
+			}
+
+			// if the last key of the leaf is in range, so is everything before it.
+			// Otherwise the range ends in this leaf.
+			int end = currLeaf->numKeys;
+			bool lastLeaf = false;
+			if (!cursor.satisfiesHigh<T>(currLeaf->keyArray[end - 1]))
+			{
+				const T high = cursor.scanHighVal<T>();
+				end = cursor.highOp == LT ? nodeLowerBound<T>(currLeaf->keyArray, end, high)
+										  : nodeUpperBound<T>(currLeaf->keyArray, end, high);
+				lastLeaf = true;
+			}
+
+			if (currLeaf->numDeleted == 0 && currLeaf->numPostings == 0)
+			{
+				const std::size_t available = end > cursor.nextEntry ? end - cursor.nextEntry : 0;
+				const std::size_t n = std::min(available, maxRids - count);
+				std::copy(currLeaf->ridArray + cursor.nextEntry, currLeaf->ridArray + cursor.nextEntry + n, outRids + count);
+				if (outIncluded != NULL)
+				{
+					memcpy(outIncluded + count * includedSize, leafIncluded<T>(currLeaf, cursor.nextEntry), n * includedSize);
+				}
+				cursor.nextEntry += n;
+				count += n;
+			}
+			else
+			{
+				// filter out lazily deleted slots and expand posting lists one at a time
+				while (cursor.nextEntry < end && count < maxRids)
+				{
+					const RecordId &slot = currLeaf->ridArray[cursor.nextEntry];
+					if (isPostingSlot(slot))
+					{
+						count += readPostingRids(cursor, slot, outRids + count, maxRids - count);
+						if (cursor.postingPos >= 0)
+						{
+							continue;
+						}
+					}
+					else if (!isDeletedSlot(slot))
+					{
+						if (outIncluded != NULL)
+						{
+							memcpy(outIncluded + count * includedSize, leafIncluded<T>(currLeaf, cursor.nextEntry), includedSize);
+						}
+						outRids[count++] = slot;
+					}
+					cursor.nextEntry++;
+				}
+			}
+
+			if (lastLeaf && cursor.nextEntry >= end)
+			{
+				releaseScanLeaf(cursor);
+			}
 		}
-		nextEntry = (nextEntry + 1) % leafOccupancy;
-		if (nextEntry == 0)
+		return count;
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::scanPrevBatchTyped(BTreeScanCursor &cursor, RecordId *outRids, const std::size_t maxRids, char *outIncluded)
+	{
+		std::size_t count = 0;
+		while (count < maxRids && cursor.currentPageNum != Page::INVALID_NUMBER)
 		{
-			if (currLeaf->rightSibPageNo == 0)
+			LeafNode<T> *currLeaf = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+			if (cursor.nextEntry < 0)
 			{
-				bufMgr->unPinPage(file, currentPageNum, false);
-				nextEntry = -1;
-				return;
+				moveToPrevLeaf<T>(cursor);
+				continue;
 			}
-			int next = currLeaf->rightSibPageNo;
-			bufMgr->unPinPage(file, currentPageNum, false);
-			currentPageNum = next;
-			bufMgr->readPage(file, currentPageNum, currentPageData);
-			currLeaf = reinterpret_cast<LeafNodeInt *>(currentPageData);
 
-			if (currLeaf->keyArray[nextEntry] > ub)
+			// if the first key of the leaf is in range, so is everything after it.
+			// Otherwise the range ends in this leaf.
+			int begin = 0;
+			bool lastLeaf = false;
+			if (!cursor.satisfiesLow<T>(currLeaf->keyArray[0]))
 			{
-				bufMgr->unPinPage(file, currentPageNum, false);
-				nextEntry = -1;
-				return;
+				const T low = cursor.scanLowVal<T>();
+				begin = cursor.lowOp == GT ? nodeUpperBound<T>(currLeaf->keyArray, currLeaf->numKeys, low)
+										   : nodeLowerBound<T>(currLeaf->keyArray, currLeaf->numKeys, low);
+				lastLeaf = true;
+			}
+
+			if (currLeaf->numDeleted == 0 && currLeaf->numPostings == 0)
+			{
+				const std::size_t available = cursor.nextEntry >= begin ? cursor.nextEntry + 1 - begin : 0;
+				const std::size_t n = std::min(available, maxRids - count);
+				std::reverse_copy(currLeaf->ridArray + cursor.nextEntry + 1 - n, currLeaf->ridArray + cursor.nextEntry + 1, outRids + count);
+				for (std::size_t j = 0; outIncluded != NULL && j < n; j++)
+				{
+					memcpy(outIncluded + (count + j) * includedSize, leafIncluded<T>(currLeaf, cursor.nextEntry - j), includedSize);
+				}
+				cursor.nextEntry -= n;
+				count += n;
+			}
+			else
+			{
+				while (cursor.nextEntry >= begin && count < maxRids)
+				{
+					const RecordId &slot = currLeaf->ridArray[cursor.nextEntry];
+					if (isPostingSlot(slot))
+					{
+						count += readPostingRids(cursor, slot, outRids + count, maxRids - count);
+						if (cursor.postingPos >= 0)
+						{
+							continue;
+						}
+					}
+					else if (!isDeletedSlot(slot))
+					{
+						if (outIncluded != NULL)
+						{
+							memcpy(outIncluded + count * includedSize, leafIncluded<T>(currLeaf, cursor.nextEntry), includedSize);
+						}
+						outRids[count++] = slot;
+					}
+					cursor.nextEntry--;
+				}
+			}
+
+			if (lastLeaf && cursor.nextEntry < begin)
+			{
+				releaseScanLeaf(cursor);
 			}
 		}
+		return count;
 	}
 
 	// -----------------------------------------------------------------------------
@@ -517,15 +5829,20 @@ namespace badgerdb
 	//
 	void BTreeIndex::endScan()
 	{
-		if (!scanExecuting)
-			throw ScanNotInitializedException("No scan in progress!");
+		scanCursor.endScan();
+	}
+
+	void BTreeIndex::endScan(BTreeScanCursor &cursor)
+	{
+		// release the leaf the scan is sitting on
+		if (cursor.currentPageNum != Page::INVALID_NUMBER)
+		{
+			releaseScanLeaf(cursor);
+		}
 
 		// Set all values to null
-		this->scanExecuting = false;
-		this->highValInt = -1;
-		this->lowValInt = -1;
-		this->nextEntry = -1;
-		this->currentPageData = 0;
-		this->currentPageNum = -1;
+		cursor.scanExecuting = false;
+		cursor.nextEntry = -1;
+		cursor.readAheadPageNum = Page::INVALID_NUMBER;
 	}
 }
@@ -12,11 +12,21 @@
 #include "string.h"
 #include <sstream>
 #include <climits>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "optimistic_latch.h"
+#include "node_cache.h"
+#include "bit_packing.h"
 
 namespace badgerdb
 {
@@ -28,7 +38,8 @@ enum Datatype
 {
 	INTEGER = 0,
 	DOUBLE = 1,
-	STRING = 2
+	STRING = 2,
+	COMPOSITE = 3
 };
 
 /**
@@ -42,266 +53,2248 @@ enum Operator
 	GT		/* Greater Than */
 };
 
+/**
+ * @brief Order in which a scan hands out its entries. Passed to BTreeIndex::startScan() method.
+ */
+enum ScanOrder
+{
+	ASCENDING,	/* From the low bound up, following right sibling links */
+	DESCENDING	/* From the high bound down, following left sibling links */
+};
+
+/**
+ * @brief How BTreeIndex::deleteEntry() removes an entry.
+ */
+enum DeleteMode
+{
+	LAZY,	/* Mark the slot deleted; the leaf is compacted when it would next split */
+	MERGE	/* Remove the slot now, merging or redistributing nodes that become underfull */
+};
+
+
+/**
+ * @brief Number of bytes of a STRING attribute that are used as the index key.
+ */
+const  int STRINGSIZE = 10;
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+//                                                  sibling ptrs      numKeys, numDeleted, numPostings   high key           key               rid
+const  int INTARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - 3 * sizeof( int ) - sizeof( int ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                                     sibling ptrs      numKeys, numDeleted, numPostings     high key             key                 rid
+const  int DOUBLEARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - 3 * sizeof( int ) - sizeof( double ) ) / ( sizeof( double ) + sizeof( RecordId ) );
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+//                                                     sibling ptrs      numKeys, numDeleted, numPostings          high key                        key                    rid
+const  int STRINGARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - 3 * sizeof( int ) - STRINGSIZE * sizeof( char ) ) / ( STRINGSIZE * sizeof( char ) + sizeof( RecordId ) );
+
+/**
+ * @brief Most attributes a COMPOSITE key is made of.
+ */
+const  int MAX_KEY_COLUMNS = 4;
+
+/**
+ * @brief Number of bytes of a COMPOSITE key. The columns of a key take 4 bytes per INTEGER,
+ * 8 per DOUBLE and STRINGSIZE per STRING, and must fit in it together.
+ */
+const  int COMPOSITESIZE = 24;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for COMPOSITE key.
+ */
+//                                                        sibling ptrs      numKeys, numDeleted, numPostings         high key                key              rid
+const  int COMPOSITEARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - 3 * sizeof( int ) - COMPOSITESIZE ) / ( COMPOSITESIZE + sizeof( RecordId ) );
+
+/**
+ * @brief Number of 32 bit words of a packed INTEGER leaf that hold its bit packed columns, all of it but the
+ * header, see PackedLeafHeader.
+ */
+const  int PACKEDLEAFWORDS = ( Page::SIZE - 8 * sizeof( std::uint32_t ) ) / sizeof( std::uint32_t );
+
+/**
+ * @brief Number of entries a packed INTEGER leaf holds whatever their values. At full width a key and a page
+ * number take a word each and a slot number half a word, and the slot column may end in a half empty row.
+ */
+const  int PACKEDLEAFMINSIZE = ( PACKEDLEAFWORDS - PACK_LANES / 2 ) / ( 5 * PACK_LANES / 2 ) * PACK_LANES;
+
+/**
+ * @brief Most entries of a packed INTEGER leaf, however narrow they pack. Either half of a leaf that
+ * splits, the new entry included, has no more than PACKEDLEAFMINSIZE of them, so it always fits.
+ */
+const  int PACKEDLEAFSIZE = 2 * ( PACKEDLEAFMINSIZE - 1 );
+
+/**
+ * @brief Number of record ids on a page of a posting list.
+ */
+//                                         next page          numRids            rid
+const  int POSTINGSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof( int ) ) / sizeof( RecordId );
+
+/**
+ * @brief Fewest duplicates of a key in a full leaf that are moved out to a posting list.
+ * A posting list page is then at least a quarter full.
+ */
+const  int POSTING_MIN_RUN = POSTINGSIZE / 4;
+
+/**
+ * @brief Most attributes a covering index can include in its leaf entries.
+ */
+const  int MAX_INCLUDED_ATTRS = 4;
+
+/**
+ * @brief Most bytes of included attribute values per leaf entry.
+ */
+const  int MAX_INCLUDED_SIZE = 64;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ */
+//                                                      level     numKeys, numMessages   extra pageNo     extra count               high key     sibling ptr                key       pageNo             count
+const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - 2 * sizeof( int ) - sizeof( PageId ) - sizeof( std::uint32_t ) - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) + sizeof( std::uint32_t ) );
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ * One slot is given up for the alignment padding after the level member.
+ */
+//                                                         level     numKeys, numMessages   extra pageNo     extra count                high key        sibling ptr                  key          pageNo             count
+const  int DOUBLEARRAYNONLEAFSIZE = ( ( Page::SIZE - sizeof( int ) - 2 * sizeof( int ) - sizeof( PageId ) - sizeof( std::uint32_t ) - sizeof( double ) - sizeof( PageId ) ) / ( sizeof( double ) + sizeof( PageId ) + sizeof( std::uint32_t ) ) ) - 1;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key.
+ */
+//                                                         level     numKeys, numMessages   extra pageNo     extra count                       high key              sibling ptr                        key                 pageNo             count
+const  int STRINGARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - 2 * sizeof( int ) - sizeof( PageId ) - sizeof( std::uint32_t ) - STRINGSIZE * sizeof( char ) - sizeof( PageId ) ) / ( STRINGSIZE * sizeof( char ) + sizeof( PageId ) + sizeof( std::uint32_t ) );
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for COMPOSITE key.
+ */
+//                                                            level     numKeys, numMessages   extra pageNo     extra count               high key       sibling ptr            key             pageNo             count
+const  int COMPOSITEARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - 2 * sizeof( int ) - sizeof( PageId ) - sizeof( std::uint32_t ) - COMPOSITESIZE - sizeof( PageId ) ) / ( COMPOSITESIZE + sizeof( PageId ) + sizeof( std::uint32_t ) );
+
+/**
+ * @brief Fixed width key used for STRING attributes. Only the first STRINGSIZE
+ * characters of the attribute are indexed; shorter values are padded with NULs.
+ *
+ * The characters are kept normalized: the first eight read as a big-endian
+ * unsigned integer and the last two as another, so that keys compare in
+ * bytewise order with two integer comparisons instead of a memcmp.
+*/
+struct __attribute__((packed)) StringKey{
+  /**
+   * Characters 0 to 7, the first one in the most significant byte.
+   */
+	std::uint64_t prefix;
+
+  /**
+   * Characters 8 and 9, the first one in the most significant byte.
+   */
+	std::uint16_t tail;
+
+  /**
+   * Build a key from the first STRINGSIZE characters of a char string.
+   */
+	static StringKey fromChars( const char* str )
+	{
+		unsigned char chars[ STRINGSIZE ];
+		strncpy( reinterpret_cast<char*>( chars ), str, STRINGSIZE );
+
+		StringKey k;
+		std::uint64_t prefix = 0;
+		for ( int i = 0; i < 8; i++ )
+		{
+			prefix = ( prefix << 8 ) | chars[ i ];
+		}
+		k.prefix = prefix;
+		k.tail = static_cast<std::uint16_t>( ( chars[ 8 ] << 8 ) | chars[ 9 ] );
+		return k;
+	}
+
+  /**
+   * Write the STRINGSIZE characters of the key to str, undoing fromChars.
+   */
+	void toChars( char* str ) const
+	{
+		for ( int i = 0; i < 8; i++ )
+		{
+			str[ i ] = static_cast<char>( prefix >> ( 56 - 8 * i ) );
+		}
+		str[ 8 ] = static_cast<char>( tail >> 8 );
+		str[ 9 ] = static_cast<char>( tail );
+	}
+};
+
+static_assert( sizeof( StringKey ) == STRINGSIZE, "StringKey must hold exactly STRINGSIZE characters" );
+
+inline bool operator<( const StringKey& k1, const StringKey& k2 )
+{
+	const std::uint64_t p1 = k1.prefix;
+	const std::uint64_t p2 = k2.prefix;
+	return p1 < p2 || ( p1 == p2 && k1.tail < k2.tail );
+}
+
+inline bool operator==( const StringKey& k1, const StringKey& k2 )
+{
+	return k1.prefix == k2.prefix && k1.tail == k2.tail;
+}
+
+inline bool operator!=( const StringKey& k1, const StringKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Attribute of the base relation that is one column of a COMPOSITE key.
+ */
+struct KeyColumn{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute, INTEGER, DOUBLE or STRING.
+   */
+	Datatype type;
+};
+
+/**
+ * @brief Fixed width key used for COMPOSITE indexes, the columns of the key
+ * concatenated, most significant first, with the unused end left zero.
+ *
+ * Each column is normalized so that the whole key compares in bytewise order:
+ * integers and doubles are stored big-endian with their sign bit flipped, and
+ * negative doubles with all bits flipped. A key is then ordered column by
+ * column with a single memcmp.
+*/
+struct CompositeKey{
+	unsigned char bytes[ COMPOSITESIZE ];
+};
+
+inline bool operator<( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, COMPOSITESIZE ) < 0;
+}
+
+inline bool operator==( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, COMPOSITESIZE ) == 0;
+}
+
+inline bool operator!=( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Key of an INTEGER index with packed leaves, see BTreeBuildOptions::packedLeaves. It is
+ * stored like an int and only tells the leaf code of such an index apart from that of a plain one.
+*/
+struct PackedIntKey{
+	int value;
+};
+
+inline bool operator<( const PackedIntKey& k1, const PackedIntKey& k2 )
+{
+	return k1.value < k2.value;
+}
+
+inline bool operator==( const PackedIntKey& k1, const PackedIntKey& k2 )
+{
+	return k1.value == k2.value;
+}
+
+inline bool operator!=( const PackedIntKey& k1, const PackedIntKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Per key type constants of the B+Tree node layouts. Only specialized
+ * for the key types that back a Datatype.
+*/
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int>{
+	static const Datatype TYPE = INTEGER;
+	static const int LEAFSIZE = INTARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = INTARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<double>{
+	static const Datatype TYPE = DOUBLE;
+	static const int LEAFSIZE = DOUBLEARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = DOUBLEARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<StringKey>{
+	static const Datatype TYPE = STRING;
+	static const int LEAFSIZE = STRINGARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = STRINGARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<CompositeKey>{
+	static const Datatype TYPE = COMPOSITE;
+	static const int LEAFSIZE = COMPOSITEARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = COMPOSITEARRAYNONLEAFSIZE;
+};
+
+/**
+ * The leaves of a packed index are only laid out this way once decoded, see PackedLeafHeader.
+ */
+template <>
+struct KeyTraits<PackedIntKey>{
+	static const Datatype TYPE = INTEGER;
+	static const int LEAFSIZE = PACKEDLEAFSIZE;
+	static const int NONLEAFSIZE = INTARRAYNONLEAFSIZE;
+};
+
+/**
+ * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
+ * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
+ */
+template <class T>
+class RIDKeyPair{
+public:
+	RecordId rid;
+	T key;
+	void set( RecordId r, T k)
+	{
+		rid = r;
+		key = k;
+	}
+};
+
+/**
+ * @brief Structure to store a key page pair which is used to pass the key and page to functions that make 
+ * any modifications to the non leaf pages of the tree.
+*/
+template <class T>
+class PageKeyPair{
+public:
+	PageId pageNo;
+	T key;
+
+  /**
+   * Number of entries under pageNo.
+   */
+	std::uint32_t count;
+
+	void set( int p, T k)
+	{
+		pageNo = p;
+		key = k;
+	}
+};
+
+/**
+ * @brief Most non-leaf levels a tree can have. Every non-leaf node below the root has at least two
+ * children, so a file of 2^32 pages cannot hold more.
+ */
+const int MAX_TREE_HEIGHT = 32;
+
+/**
+ * @brief Non-leaf node passed by an insert on its way down, kept pinned until the insert is done.
+*/
+struct PinnedPathNode{
+	PageId pageNo;
+	Page* page;
+
+  /**
+   * Position in pageNoArray of the child the insert went down to.
+   */
+	int index;
+};
+
+/**
+ * @brief Non-leaf nodes passed by findNode on its way down, root first. Kept on the stack, so that
+ * a descent allocates nothing.
+*/
+struct DescentPath{
+	PageId pageNos[MAX_TREE_HEIGHT];
+	int depth;
+
+	DescentPath() : depth( 0 ) {}
+};
+
+/**
+ * @brief Insert or delete of an entry waiting in the buffer of a non-leaf node
+ * until it is flushed down towards the leaves.
+*/
+template <class T>
+class BufferedMessage{
+public:
+	T key;
+	RecordId rid;
+
+  /**
+   * True to delete the entry, false to insert it.
+   */
+	bool isDelete;
+
+	void set( T k, RecordId r, bool d)
+	{
+		key = k;
+		rid = r;
+		isDelete = d;
+	}
+};
+
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compares to see if the first pair has
+ * a smaller rid.pageNo value.
+*/
+template <class T>
+bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
+{
+	if( r1.key != r2.key )
+		return r1.key < r2.key;
+	else
+		return r1.rid.page_number < r2.rid.page_number;
+}
+
+/**
+ * @brief Record id and key of an entry together with the values of the attributes
+ * a covering index includes, for bulk loading such an index.
+ */
+template <class T>
+class IncludedRIDKeyPair : public RIDKeyPair<T>{
+public:
+	char included[ MAX_INCLUDED_SIZE ];
+};
+
+/**
+ * @brief Attribute of the base relation whose value a covering index keeps next to each key.
+ */
+struct IncludedAttr{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int attrByteOffset;
+
+  /**
+   * Length of the attribute in bytes.
+   */
+	int length;
+};
+
+/**
+ * @brief Default fraction of each node filled when a new index is bulk loaded.
+ * Leaves some room so that the first inserts after the build do not split every node.
+ */
+const double BULKLOAD_FILLFACTOR = 0.9;
+
+/**
+ * @brief Default memory, in bytes, for sorting the entries of a new index before
+ * sorted runs are spilled to disk.
+ */
+const std::size_t BULKLOAD_SORTBUDGET = 64 * 1024 * 1024;
+
+/**
+ * @brief Default number of non-leaf pages of the upper levels that an open index keeps pinned
+ * in the buffer pool and reads directly.
+ */
+const std::uint32_t NODECACHE_PAGES = 16;
+
+/**
+ * @brief Default for the most leaves a range scan asks the buffer manager to read ahead of itself.
+ */
+const std::uint32_t SCAN_READAHEAD = 16;
+
+/**
+ * @brief Leaves read ahead when a scan starts. Doubled at every leaf the scan moves on to, up to the limit.
+ */
+const int SCAN_READAHEAD_MIN = 2;
+
+/**
+ * @brief Fewest keys a non-leaf node keeps for itself next to its message buffer.
+ */
+const int BUFFER_MIN_KEYS = 8;
+
+/**
+ * @brief Most buckets of the equi-depth histogram of the keys of an index.
+ */
+const int HISTOGRAM_BUCKETS = 64;
+
+/**
+ * @brief Bits of a key hash that pick the register of the distinct key sketch it goes to.
+ */
+const int SKETCH_PRECISION = 12;
+
+/**
+ * @brief Number of registers of the distinct key sketch, a HyperLogLog with a standard error of about 1.6%.
+ */
+const int SKETCH_REGISTERS = 1 << SKETCH_PRECISION;
+
+/**
+ * @brief Number of bytes a key takes on the statistics page, enough for the widest key type.
+ */
+const int STATS_KEYSIZE = COMPOSITESIZE;
+
+/**
+ * @brief Number of shards the statistics changes of concurrent inserts and deletes are spread over, see StatsDelta.
+ */
+const int STATS_SHARDS = 16;
+
+/**
+ * @brief Default number of threads BTreeIndex::verifyIndex checks subtrees on.
+ */
+const int VERIFY_THREADS = 4;
+
+/**
+ * @brief Default number of buffer pool frames BTreeIndex::verifyIndex reads the pages it misses into.
+ */
+const std::uint32_t VERIFY_FRAMES = 64;
+
+/**
+ * @brief Most problems listed in an IndexVerifyReport.
+ */
+const std::size_t VERIFY_MAX_ERRORS = 100;
+
+/**
+ * @brief Options for building a new index from its base relation, passed to the
+ * BTreeIndex constructor. Only concurrent, cachedNodes, readAhead and rebuildCounts apply when an existing index file is opened,
+ * whose included attributes, message buffer and leaf format are read back from the file.
+ */
+struct BTreeBuildOptions{
+  /**
+   * Fraction, in (0, 1], of the key slots of every leaf and non-leaf that bulk loading fills.
+   */
+	double fillFactor;
+
+  /**
+   * Memory, in bytes, for sorting the (key, rid) pairs of the relation. Larger inputs are sorted externally.
+   */
+	std::size_t sortBudget;
+
+  /**
+   * Allow insertEntry and scans on cursors from openScan to be called from several threads at once.
+   * Non-leaf nodes are traversed with optimistic lock coupling and scans read private copies of leaves.
+   */
+	bool concurrent;
+
+  /**
+   * Number of non-leaf pages, taken from the root down level by level, that stay pinned while the index
+   * is open so that descents read them without a buffer manager lookup. 0 turns the cache off.
+   */
+	std::uint32_t cachedNodes;
+
+  /**
+   * Most leaves a range scan has read into the buffer pool in the background ahead of the leaf it is on.
+   * 0 turns read-ahead off.
+   */
+	std::uint32_t readAhead;
+
+  /**
+   * Attributes whose values are stored in the leaves next to each key, in this order, so that
+   * scans can hand them out without reading the base relation. At most MAX_INCLUDED_ATTRS of them
+   * and MAX_INCLUDED_SIZE bytes in all. Every included byte costs leaf fanout.
+   */
+	std::vector<IncludedAttr> included;
+
+  /**
+   * Fraction, in [0, 1), of the key slots of every non-leaf node given to a buffer of pending inserts
+   * and deletes, as in a B-epsilon tree. insertEntry and deleteEntry only add a message to the root, and
+   * a full buffer moves the messages for one of its children down a level at once, so that random
+   * inserts dirty leaves in batches. 0 builds a plain B+Tree. Buffered indexes cannot be concurrent
+   * or include attributes, and apply their deletes LAZY.
+   */
+	double bufferFraction;
+
+  /**
+   * Bit pack the leaves of an INTEGER index, see PackedLeafHeader, so that a leaf holds up to PACKEDLEAFSIZE
+   * entries instead of INTARRAYLEAFSIZE when its keys and record ids are close together. Fewer leaves mean a
+   * smaller file and fewer pages read by scans, but a leaf is decoded whenever it is read and encoded again when
+   * changed. Packed indexes cannot be concurrent, buffered or include attributes. They keep no posting lists,
+   * and remove LAZY deletes right away without merging leaves.
+   */
+	bool packedLeaves;
+
+  /**
+   * Rebuild the entry counts of an existing index that does not keep them, when it is opened neither
+   * concurrent nor buffered. Without it the counts stay invalid and opening the index writes nothing,
+   * as when only reading or verifying it.
+   */
+	bool rebuildCounts;
+
+	BTreeBuildOptions()
+		: fillFactor( BULKLOAD_FILLFACTOR ), sortBudget( BULKLOAD_SORTBUDGET ), concurrent( false ),
+			cachedNodes( NODECACHE_PAGES ), readAhead( SCAN_READAHEAD ), bufferFraction( 0 ), packedLeaves( false ),
+			rebuildCounts( true )
+	{
+	}
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+ * to the following structure to store or retrieve information from it.
+ * Contains the relation name for which the index is created, the byte offset
+ * of the key value on which the index is made, the type of the key and the page no
+ * of the root page. Root page starts as page 2 but since a split can occur
+ * at the root the root page may get moved up and get a new page no.
+*/
+struct IndexMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built, COMPOSITE for an index on several.
+   */
+	Datatype attrType;
+
+  /**
+   * Number of attributes the key is made of, 1 unless attrType is COMPOSITE.
+   */
+	int numKeyColumns;
+
+  /**
+   * Attributes the key is made of, most significant first.
+   */
+	KeyColumn keyColumns[ MAX_KEY_COLUMNS ];
+
+  /**
+   * Page number of root page of the B+ Tree inside the file index file.
+   */
+	PageId rootPageNo;
+
+  /**
+   * First page of the list of freed pages, which are reused before the file is grown.
+   */
+	PageId freeListHead;
+
+  /**
+   * Number of attributes included in the leaf entries.
+   */
+	int numIncluded;
+
+  /**
+   * Attributes included in the leaf entries.
+   */
+	IncludedAttr included[ MAX_INCLUDED_ATTRS ];
+
+  /**
+   * Whether the entry counts of the non-leaf nodes are up to date. They are not kept in
+   * concurrent mode, and are rebuilt when the index is next opened without it.
+   */
+	int countsValid;
+
+  /**
+   * Number of key slots of every non-leaf node that hold its message buffer, 0 if there is none.
+   */
+	int bufferSlots;
+
+  /**
+   * Page number of the statistics page, see KeyStatsPage.
+   */
+	PageId statsPageNo;
+
+  /**
+   * Whether the leaves are bit packed, see BTreeBuildOptions::packedLeaves.
+   */
+	int packedLeaves;
+
+  /**
+   * Whether the index has ever been opened for concurrent inserts. Those may leave the leftSibPageNo
+   * of a leaf at a page other than the leaf on its left, so verifyIndex only checks them if this is 0.
+   */
+	int writtenConcurrently;
+};
+
+/**
+ * @brief Layout of an index page that was freed by deleteEntry and sits on the free list.
+*/
+struct FreePageInfo{
+  /**
+   * Next page on the free list.
+   */
+	PageId nextFreePageNo;
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
+node they are. The level member of each non leaf structure seen below is the height of the node above
+the leaf nodes: 1 if the nodes at this level are just above the leaf nodes, 2 for their parents, and so on.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes. Templated on the key type so that
+ * every Datatype gets its own fanout.
+ * Nodes at every level are chained left to right and carry a high key, as in a B-link tree,
+ * so that a traversal reaching a node after it was split can move right to the node now holding its key.
+*/
+template <class T>
+struct NonLeafNode{
+  /**
+   * Height of the node above the leaves. 1 if its children are leaf nodes.
+   */
+	int level;
+
+  /**
+   * Stores keys.
+   */
+	T keyArray[ KeyTraits<T>::NONLEAFSIZE ];
+
+  /**
+   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   */
+	PageId pageNoArray[ KeyTraits<T>::NONLEAFSIZE + 1 ];
+
+  /**
+   * Number of live entries under each child in pageNoArray, record ids on posting lists included,
+   * so that ranks are found on one path down the tree. Only kept up to date while
+   * IndexMetaInfo::countsValid is set.
+   */
+	std::uint32_t countArray[ KeyTraits<T>::NONLEAFSIZE + 1 ];
+
+  // current number of keys in the key array
+  int numKeys;
+
+  /**
+   * Number of messages in the buffer of the node, see BTreeBuildOptions::bufferFraction. They take the
+   * key slots after the node's own keys, and the child slots after its own children hold their record ids.
+   */
+	int numMessages;
+
+  /**
+   * Upper bound of the keys under this node. Keys greater than it, or equal to it when inserting,
+   * have moved to the right sibling. Meaningless when there is no right sibling.
+   */
+	T highKey;
+
+  /**
+   * Page number of the node on the right side at the same level, Page::INVALID_NUMBER for the rightmost node.
+   */
+	PageId rightSibPageNo;
+};
+
+
+/**
+ * @brief Structure for all leaf nodes. Templated on the key type so that
+ * every Datatype gets its own fanout.
+*/
+template <class T>
+struct LeafNode{
+  /**
+   * Stores keys.
+   */
+	T keyArray[ KeyTraits<T>::LEAFSIZE ];
+
+  /**
+   * Stores RecordIds.
+   */
+	RecordId ridArray[ KeyTraits<T>::LEAFSIZE ];
+
+  /**
+   * Upper bound of the keys in this leaf, as for NonLeafNode::highKey. Meaningless when there is no right sibling.
+   */
+	T highKey;
+
+  /**
+   * Page number of the leaf on the right side.
+	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the leaf on the left side, for scans in DESCENDING order.
+   * In concurrent mode it may lag behind splits and point further left than the left neighbour.
+   */
+	PageId leftSibPageNo;
+
+  // current number of keys inf the key array
+  int numKeys;
+
+  // number of slots deleted lazily and not compacted away yet. Their rids have page_number Page::INVALID_NUMBER.
+  int numDeleted;
+
+  // number of slots holding a posting list instead of a single rid, see PostingPage.
+  int numPostings;
+};
+
+/**
+ * @brief Page of a posting list, which holds the record ids of a key with many
+ * duplicates outside the leaves. The leaf keeps a single slot for the key, whose
+ * record id has slot_number Page::INVALID_SLOT and the first page of the list as
+ * page_number.
+ *
+ * Pages only ever get record ids appended, publishing numRids last, so that they
+ * can be read without a latch. New pages go to the front of the list.
+ */
+struct PostingPage{
+  /**
+   * Record ids of the key, in no particular order.
+   */
+	RecordId ridArray[ POSTINGSIZE ];
+
+  /**
+   * Next page of the list, or Page::INVALID_NUMBER.
+   */
+	PageId nextPageNo;
+
+  /**
+   * Number of record ids in ridArray. Never 0, a page that runs empty leaves the list.
+   */
+	int numRids;
+};
+
+/**
+ * @brief Statistics page of an index, referenced from the meta page, which describes the keys
+ * for selectivity estimates without reading any leaves. Keys are stored in their typed form in
+ * the first bytes of STATS_KEYSIZE wide slots.
+ *
+ * A full refresh, on bulk build or BTreeIndex::refreshStatistics, recomputes everything from the
+ * leaves. In between, inserts and deletes adjust the entry and bucket counts. Inserts also widen the
+ * key range, widen the last bucket past the largest key and add their key to the sketch, which deletes
+ * cannot take out again.
+ */
+struct KeyStatsPage{
+  /**
+   * Number of entries in the index, record ids of duplicate keys counted one by one.
+   */
+	std::uint64_t numEntries;
+
+  /**
+   * Number of histogram buckets in use, 0 when the index is empty.
+   */
+	int numBuckets;
+
+  /**
+   * Smallest key in the index. It may be smaller than any key left after deletes.
+   */
+	unsigned char minKey[ STATS_KEYSIZE ];
+
+  /**
+   * Largest key in the index. It may be larger than any key left after deletes.
+   */
+	unsigned char maxKey[ STATS_KEYSIZE ];
+
+  /**
+   * Largest key of each bucket, ascending. Bucket b holds the keys above the bound of bucket b - 1
+   * up to its own, and the first bucket the keys from minKey up.
+   */
+	unsigned char bucketBounds[ HISTOGRAM_BUCKETS ][ STATS_KEYSIZE ];
+
+  /**
+   * Number of entries in each bucket.
+   */
+	std::uint64_t bucketCounts[ HISTOGRAM_BUCKETS ];
+
+  /**
+   * Registers of a HyperLogLog sketch of the distinct keys, each the longest run of leading
+   * zero bits seen, plus one, among the hashes of the keys that went to it.
+   */
+	std::uint8_t sketch[ SKETCH_REGISTERS ];
+};
+
+static_assert( sizeof( KeyStatsPage ) <= Page::SIZE, "Statistics must fit in a page" );
+
+/**
+ * @brief Changes to the statistics made in concurrent mode by the threads of one shard. Inserts and deletes
+ * only write their own shard, under its own latch, and the shards are folded into the KeyStatsPage whenever
+ * it is read, refreshed or the index is closed.
+ */
+struct StatsDelta{
+  /**
+   * Serializes the threads of the shard with each other and with folding.
+   */
+	std::mutex latch;
+
+  /**
+   * Entries inserted less entries deleted.
+   */
+	std::int64_t numEntries;
+
+  /**
+   * Entries inserted less entries deleted, by histogram bucket.
+   */
+	std::int64_t bucketCounts[ HISTOGRAM_BUCKETS ];
+
+  /**
+   * Whether minKey and maxKey hold the range of the keys inserted.
+   */
+	bool hasRange;
+
+  /**
+   * Smallest key inserted.
+   */
+	unsigned char minKey[ STATS_KEYSIZE ];
+
+  /**
+   * Largest key inserted.
+   */
+	unsigned char maxKey[ STATS_KEYSIZE ];
+
+  /**
+   * Sketch registers of the keys inserted, see KeyStatsPage::sketch.
+   */
+	std::uint8_t sketch[ SKETCH_REGISTERS ];
+
+  /**
+   * Whether anything changed since the shard was last folded.
+   */
+	bool changed;
+
+  /**
+   * Keeps the latch of the next shard off the cache line of the end of this one.
+   */
+	char padding[ 64 ];
+
+	StatsDelta()
+	{
+		clear();
+	}
+
+  /**
+   * Forget the changes, once they have been folded.
+   */
+	void clear()
+	{
+		numEntries = 0;
+		std::fill( bucketCounts, bucketCounts + HISTOGRAM_BUCKETS, 0 );
+		hasRange = false;
+		std::fill( sketch, sketch + SKETCH_REGISTERS, 0 );
+		changed = false;
+	}
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+*/
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+*/
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+*/
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+*/
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+*/
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+*/
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert( sizeof( NonLeafNodeInt ) <= Page::SIZE && sizeof( LeafNodeInt ) <= Page::SIZE,
+		"INTEGER B+Tree nodes must fit in a page" );
+static_assert( sizeof( NonLeafNodeDouble ) <= Page::SIZE && sizeof( LeafNodeDouble ) <= Page::SIZE,
+		"DOUBLE B+Tree nodes must fit in a page" );
+/**
+ * @brief Structure for all non-leaf nodes when the key is COMPOSITE.
+*/
+typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+
+/**
+ * @brief Structure for all leaf nodes when the key is COMPOSITE.
+*/
+typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+static_assert( sizeof( NonLeafNodeString ) <= Page::SIZE && sizeof( LeafNodeString ) <= Page::SIZE,
+		"STRING B+Tree nodes must fit in a page" );
+static_assert( sizeof( NonLeafNodeComposite ) <= Page::SIZE && sizeof( LeafNodeComposite ) <= Page::SIZE,
+		"COMPOSITE B+Tree nodes must fit in a page" );
+
+/**
+ * @brief Header of a leaf page of an INTEGER index with packed leaves, see BTreeBuildOptions::packedLeaves.
+ * The rest of the page holds three bit packed columns one after the other, see bit_packing.h: the keys less
+ * minKey, the page numbers of the record ids less minPageNo and their slot numbers less minSlot, each only
+ * as wide as its largest value needs. The key column is in key order and is searched without decoding it.
+ *
+ * Leaves are decoded into a LeafNode<PackedIntKey> to be read, and encoded again once changed. They never
+ * hold lazily deleted slots or posting lists.
+*/
+struct PackedLeafHeader{
+  /**
+   * Upper bound of the keys in this leaf, as for LeafNode::highKey.
+   */
+	int highKey;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the leaf on the left side.
+   */
+	PageId leftSibPageNo;
+
+  // current number of entries
+  int numKeys;
+
+  /**
+   * Smallest key, which the key column is relative to.
+   */
+	int minKey;
+
+  /**
+   * Smallest page number of the record ids, which the page number column is relative to.
+   */
+	PageId minPageNo;
+
+  /**
+   * Smallest slot number of the record ids, which the slot number column is relative to.
+   */
+	std::uint16_t minSlot;
+
+  /**
+   * Bit widths of the key, page number and slot number columns.
+   */
+	std::uint8_t keyBits;
+	std::uint8_t pageBits;
+	std::uint8_t slotBits;
+};
+
+static_assert( sizeof( PackedLeafHeader ) + PACKEDLEAFWORDS * sizeof( std::uint32_t ) == Page::SIZE,
+		"Packed leaf columns must take the rest of the page" );
+
+/**
+ * @brief Structure for the non-leaf nodes of an INTEGER index with packed leaves, laid out as NonLeafNodeInt.
+*/
+typedef NonLeafNode<PackedIntKey> NonLeafNodePacked;
+
+/**
+ * @brief Decoded leaf of an INTEGER index with packed leaves. It is larger than a page.
+*/
+typedef LeafNode<PackedIntKey> LeafNodePacked;
+
+static_assert( sizeof( NonLeafNodePacked ) == sizeof( NonLeafNodeInt ), "Packed INTEGER non-leaf nodes must be laid out as plain ones" );
+
+
+/**
+ * @brief Outcome of BTreeIndex::verifyIndex.
+*/
+struct IndexVerifyReport{
+  /**
+   * Number of non-leaf pages checked.
+   */
+	std::size_t numNonLeafPages;
+
+  /**
+   * Number of leaf pages checked.
+   */
+	std::size_t numLeafPages;
+
+  /**
+   * Number of posting list pages checked.
+   */
+	std::size_t numPostingPages;
+
+  /**
+   * Number of live entries found in the leaves, record ids on posting lists included.
+   */
+	std::size_t numEntries;
+
+  /**
+   * Number of levels of the tree, the leaves included.
+   */
+	int height;
+
+  /**
+   * One line per problem found, naming the page it is on. After VERIFY_MAX_ERRORS of them, a last line
+   * tells how many more there were.
+   */
+	std::vector<std::string> errors;
+
+	IndexVerifyReport()
+		: numNonLeafPages( 0 ), numLeafPages( 0 ), numPostingPages( 0 ), numEntries( 0 ), height( 0 )
+	{
+	}
+
+  /**
+   * Whether no problem was found.
+   */
+	bool ok() const
+	{
+		return errors.empty();
+	}
+};
+
+/**
+ * @brief What BTreeIndex::verifyIndex found at the edges of a subtree it checked, to check the
+ * subtree against the subtrees on either side of it. Levels are counted up from the leaves at 0.
+*/
+template <class T>
+struct VerifiedSubtree{
+  /**
+   * Leftmost and rightmost page of each level, Page::INVALID_NUMBER where the subtree could not be followed.
+   */
+	std::vector<PageId> firstPageNo;
+	std::vector<PageId> lastPageNo;
+
+  /**
+   * Right sibling of the rightmost page of each level.
+   */
+	std::vector<PageId> lastRightSibPageNo;
+
+  /**
+   * Left sibling of the leftmost leaf.
+   */
+	PageId firstLeftSibPageNo;
+
+  /**
+   * Whether the leaves hold any keys, those of deleted slots included, and the smallest and largest of them.
+   */
+	bool hasKeys;
+	T minKey;
+	T maxKey;
+
+  /**
+   * Number of live entries, record ids on posting lists included.
+   */
+	std::uint64_t numEntries;
+
+	explicit VerifiedSubtree( const int height )
+		: firstPageNo( height, PageId( Page::INVALID_NUMBER ) ), lastPageNo( height, PageId( Page::INVALID_NUMBER ) ),
+			lastRightSibPageNo( height, PageId( Page::INVALID_NUMBER ) ), firstLeftSibPageNo( Page::INVALID_NUMBER ),
+			hasKeys( false ), numEntries( 0 )
+	{
+	}
+};
+
+/**
+ * @brief State shared by the threads of one BTreeIndex::verifyIndex, see btree.cpp.
+*/
+struct IndexVerifyState;
+
+class BTreeIndex;
+
+/**
+ * @brief State of one range scan over a BTreeIndex. Each cursor keeps its own
+ * bounds and its own pinned leaf, so any number of cursors can be open on one
+ * index at the same time. Cursors are returned by BTreeIndex::openScan and can
+ * be moved but not copied. A cursor must be ended or destroyed before its index.
+*/
+class BTreeScanCursor {
+
+ private:
+
+  /**
+   * Index being scanned. NULL if the cursor never had a scan.
+   */
+	BTreeIndex	*index;
+
+  /**
+   * True if an index scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+	int			nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+	PageId	currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+	Page		*currentPageData;
+
+  /**
+   * Copy of the current leaf that currentPageData points to when the index is in concurrent mode.
+   * No page is pinned by the cursor then.
+   */
+	std::unique_ptr<Page>	leafCopy;
+
+  /**
+   * Decoded copy of the current leaf that currentPageData points to when the index has packed leaves.
+   * No page is pinned by the cursor then either.
+   */
+	std::unique_ptr<LeafNodePacked>	packedLeaf;
+
+  /**
+   * Record ids of the posting list page being read, copied out of the page.
+   */
+	std::vector<RecordId>	postingRids;
+
+  /**
+   * Next entry of postingRids to hand out, or -1 if the cursor is not inside a posting list.
+   */
+	int			postingPos;
+
+  /**
+   * Page of the posting list that comes after the one in postingRids.
+   */
+	PageId	postingNextPageNo;
+
+  /**
+   * Non-leaf node, just above the leaves, listing the next leaf to read ahead. Page::INVALID_NUMBER once
+   * there is nothing left to read ahead within the scan range.
+   */
+	PageId	readAheadPageNum;
+
+  /**
+   * Position of the next leaf to read ahead in readAheadPageNum.
+   */
+	int			readAheadPos;
+
+  /**
+   * Leaves asked for that the scan has not reached yet.
+   */
+	int			readAheadPending;
+
+  /**
+   * Number of leaves to keep asked for ahead of the scan. Grows as the scan keeps moving to new leaves.
+   */
+	int			readAheadDepth;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+	StringKey	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+	StringKey highValString;
+
+  /**
+   * Low COMPOSITE value for scan.
+   */
+	CompositeKey	lowValComposite;
+
+  /**
+   * High COMPOSITE value for scan.
+   */
+	CompositeKey	highValComposite;
+	
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+	Operator	highOp;
+
+  /**
+   * Direction of the scan. In DESCENDING order nextEntry counts down and -1 means the leaf is used up.
+   */
+	ScanOrder	order;
+
+  /**
+   * Remember the scan bounds in the member for the key type T.
+   */
+	template <class T>
+	void setScanRange(const T& lowVal, const T& highVal);
+
+  /**
+   * High bound of the scan for key type T.
+   */
+	template <class T>
+	T scanHighVal() const;
+
+  /**
+   * True if key satisfies the high bound of the scan.
+   */
+	template <class T>
+	bool satisfiesHigh(const T& key) const;
+
+  /**
+   * Low bound of the scan for key type T.
+   */
+	template <class T>
+	T scanLowVal() const;
+
+  /**
+   * True if key satisfies the low bound of the scan.
+   */
+	template <class T>
+	bool satisfiesLow(const T& key) const;
+
+	BTreeScanCursor(const BTreeScanCursor&) = delete;
+	BTreeScanCursor& operator=(const BTreeScanCursor&) = delete;
+
+	friend class BTreeIndex;
+
+ public:
+
+  /**
+   * Construct a cursor with no scan.
+   */
+	BTreeScanCursor();
+
+  /**
+   * Take over the scan of other, leaving other with no scan.
+   */
+	BTreeScanCursor(BTreeScanCursor&& other);
+
+  /**
+   * End the scan of this cursor, if any, and take over the scan of other.
+   */
+	BTreeScanCursor& operator=(BTreeScanCursor&& other);
+
+  /**
+   * Ends the scan, if still executing. Does not throw.
+   */
+	~BTreeScanCursor();
+
+  /**
+   * True if a scan has been started on this cursor and not ended yet.
+   */
+	bool isExecuting() const
+	{
+		return scanExecuting;
+	}
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param outIncluded	If not NULL, receives the BTreeIndex::getIncludedSize() bytes of included attribute values of the entry
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	void scanNext(RecordId& outRid, void* outIncluded = NULL);
+
+  /**
+	 * Fetch the record ids of up to maxRids next index entries that match the scan.
+	 * Whole runs of matching entries are copied out of each leaf with a single bound check per leaf.
+   * @param outRids	Array receiving the record ids
+   * @param maxRids	Capacity of outRids
+   * @param outIncluded	If not NULL, receives the included attribute values of each entry, BTreeIndex::getIncludedSize() bytes apiece
+   * @return  Number of record ids returned; 0 once the scan is completed
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids, void* outIncluded = NULL);
+
+  /**
+	 * Terminate the scan. Unpin any pinned pages.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	void endScan();
+};
+
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. startScan, scanNext and endScan drive one scan of the index itself;
+ * any number of further scans can be run concurrently through openScan.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+	std::atomic<PageId>	rootPageNum;
+
+  /**
+   * Page number of the rightmost leaf, which ascending keys are appended to without a descent.
+   * Page::INVALID_NUMBER until it is known, for an index opened from its file.
+   */
+	std::atomic<PageId>	rightmostLeafPageNum;
+
+  /**
+   * Whether the last insert went to the rightmost leaf. Other inserts only try it first while this is set.
+   */
+	std::atomic<bool>	lastInsertRightmost;
+
+  /**
+   * First page on the free list of the index file.
+   */
+	PageId	freeListHead;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+  /**
+   * Attributes the key is made of, a single one unless attributeType is COMPOSITE.
+   */
+	std::vector<KeyColumn>	keyColumns;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key and the included attributes.
+   */
+	int			leafOccupancy;
+
+  /**
+   * Whether the leaves are bit packed, see BTreeBuildOptions::packedLeaves. The typed methods then run
+   * for PackedIntKey, and a leaf may hold fewer than leafOccupancy entries when they do not pack narrowly.
+   */
+	bool		packedLeaves;
+
+  /**
+   * Attributes whose values are kept in the leaf entries.
+   */
+	std::vector<IncludedAttr>	includedAttrs;
+
+  /**
+   * Bytes of included attribute values per leaf entry, 0 if the index includes none. The values of
+   * a leaf's entries are packed behind its leafOccupancy record ids, in the unused end of ridArray.
+   */
+	int			includedSize;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key and the message buffer.
+   */
+	int			nodeOccupancy;
+
+  /**
+   * Number of messages the buffer of a non-leaf node holds, 0 if the index does not buffer them.
+   * The buffer takes the key slots past nodeOccupancy.
+   */
+	int			bufferCapacity;
+
+
+  /**
+   * Cursor used by startScan/scanNext/endScan.
+   */
+	BTreeScanCursor	scanCursor;
+
+  /**
+   * Version latches of the index pages in concurrent mode. NULL otherwise.
+   */
+	OptimisticLatchTable	*nodeLatches;
+
+  /**
+   * Pinned frames of the upper non-leaf pages, read by descents without going through bufMgr. NULL if disabled.
+   */
+	NodeCache	*nodeCache;
+
+  /**
+   * Most leaves a scan reads ahead, from BTreeBuildOptions::readAhead.
+   */
+	std::uint32_t	readAheadLeaves;
+
+  /**
+   * Whether the non-leaf entry counts are up to date, see IndexMetaInfo::countsValid.
+   */
+	bool		countsValid;
+
+  /**
+   * Whether the index has ever been opened in concurrent mode, see IndexMetaInfo::writtenConcurrently.
+   */
+	bool		writtenConcurrently;
+
+  /**
+   * Serializes changes to the meta page and the free list in concurrent mode.
+   */
+	std::recursive_mutex	metaLatch;
+
+  /**
+   * Page number of the statistics page.
+   */
+	PageId	statsPageNum;
+
+  /**
+   * Statistics of the keys, on the statistics page, which stays pinned while the index is open.
+   */
+	KeyStatsPage	*stats;
+
+  /**
+   * Serializes updates to stats by inserts with each other and with readers, and folding statsDeltas into it.
+   */
+	std::mutex	statsLatch;
+
+  /**
+   * Whether stats changed since the statistics page was pinned, so that it is only written back if it did.
+   * Guarded by statsLatch.
+   */
+	bool		statsDirty;
+
+  /**
+   * STATS_SHARDS shards of statistics changes in concurrent mode, NULL otherwise.
+   */
+	StatsDelta	*statsDeltas;
+
+  /**
+   * Number of histogram buckets when statsDeltas were last started over. The shards find the bucket of a key
+   * among the bounds below the last of them, which folding never changes.
+   */
+	int		deltaBuckets;
+
+
+  /**
+   * Allocate a page for a node, taking it from the free list if there is one.
+   */
+	void allocIndexPage(PageId& pageNo, Page*& page);
+
+  /**
+   * Put a pinned page on the free list and unpin it.
+   */
+	void freeIndexPage(const PageId pageNo, Page* page);
+
+  /**
+   * Write the root page number and free list head to the meta page.
+   */
+	void writeMetaInfo();
+
+  /**
+   * Open the index file named after the relation and the key columns, or create and bulk load it, for the constructors.
+   * @throws  BadIndexInfoException If the index file does not match, or the key columns are not valid
+   */
+	void openIndex(const std::string& relationName, std::string& outIndexName, BufMgr* bufMgrIn,
+				   const std::vector<KeyColumn>& columns, const Datatype attrType, const BTreeBuildOptions& buildOptions);
+
+  /**
+   * The part of openIndex after the index file is opened or created: pin the statistics page, bring the meta page
+   * and entry counts up to date for the way the index is used, and fill nodeCache. openIndex closes the file again
+   * if this throws.
+   */
+	void finishOpenIndex(const BTreeBuildOptions& buildOptions);
+
+  /**
+   * Take over the key columns.
+   * @throws  BadIndexInfoException If there are none or too many, or a COMPOSITE key does not fit in COMPOSITESIZE bytes
+   */
+	void setKeyColumns(const KeyColumn* columns, const int numColumns);
+
+  /**
+   * Take over the included attributes and shrink leafOccupancy to leave room for their values.
+   * @throws  BadIndexInfoException If they do not fit in a leaf entry
+   */
+	void setIncludedAttrs(const IncludedAttr* attrs, const int numAttrs);
+
+  /**
+   * Give the last slots of every non-leaf node to its message buffer and shrink nodeOccupancy to the rest.
+   * @throws  BadIndexInfoException If the nodes would be left too small, or the index is concurrent or covering
+   */
+	void setMessageBuffer(const int slots);
+
+  /**
+   * Switch to packed leaves, with leafOccupancy the most entries a packed leaf holds.
+   * @throws  BadIndexInfoException If the index is not a plain INTEGER one, that is concurrent, covering or buffered
+   */
+	void setPackedLeaves(const bool packed);
+
+  /**
+   * Copy the values of the included attributes out of record into out, packed in includedAttrs order.
+   */
+	void copyIncluded(const char* record, char* out) const;
+
+  /**
+   * Included attribute values of entry i of a leaf.
+   */
+	template <class T>
+	char* leafIncluded(LeafNode<T>* node, const int i) const;
+
+  /**
+   * Move the entries [first, last) of leaf from to position dest of leaf to, keys, record ids and
+   * included values alike. The two ranges may overlap when from and to are the same leaf.
+   */
+	template <class T>
+	void moveLeafEntries(LeafNode<T>* from, const int first, const int last, LeafNode<T>* to, const int dest);
+
+  /**
+   * The leaf on a pinned page. A packed leaf is decoded into scratch, which is allocated when first needed,
+   * and has to be written back with storeLeaf once changed. Other leaves are used in place.
+   */
+	template <class T>
+	LeafNode<T>* openLeaf(Page* page, std::unique_ptr<LeafNode<T> >& scratch) const;
+
+  /**
+   * A leaf to be filled in on a newly allocated page, to be written with storeLeaf, as for openLeaf.
+   */
+	template <class T>
+	LeafNode<T>* newLeaf(Page* page, std::unique_ptr<LeafNode<T> >& scratch) const;
+
+  /**
+   * Write a leaf from openLeaf or newLeaf back to its page. Only packed leaves need it.
+   */
+	template <class T>
+	void storeLeaf(const LeafNode<T>* leaf, Page* page) const;
+
+  /**
+   * Whether an entry for key and rid, or the first numKeys entries of from, can go into leaf as well.
+   * For plain leaves that only depends on the number of entries, for packed ones on how wide they pack.
+   */
+	template <class T>
+	bool leafHasRoom(const LeafNode<T>* leaf, const T& key, const RecordId& rid) const;
+
+	template <class T>
+	bool leafHasRoom(const LeafNode<T>* leaf, const LeafNode<T>* from, const int numKeys) const;
+
+  /**
+   * Create the index file and bulk load it from the relation, for the constructor.
+   */
+	void createIndex(const std::string& relationName, const std::string& outIndexName, const BTreeBuildOptions& buildOptions);
+
+  /**
+   * Pin up to maxPages non-leaf pages, from the root down level by level, into nodeCache.
+   */
+	template <class T>
+	void fillNodeCache(const std::uint32_t maxPages);
+
+  /**
+   * Pin pageNo on behalf of nodeCache and add it, if there is room.
+   */
+	void cacheNode(const PageId pageNo);
+
+  /**
+   * Unpin the pages the index keeps pinned while it is open, the pages of nodeCache and the statistics page.
+   */
+	void unpinHeldPages();
+
+  /**
+   * Read a page that is not written to, straight from nodeCache when it is there.
+   * @return  true if the page came from the cache, in which case it must not be unpinned
+   */
+	bool readNode(const PageId pageNo, Page*& page);
+
+	// TYPED HELPERS. The public methods switch on attributeType once and call
+	// the instantiation for the key type, so comparisons inside are never type checked.
+	// An INTEGER index with packed leaves runs the PackedIntKey instantiation.
+
+  /**
+   * Convert a key passed through the public interface to the key type T. A COMPOSITE key is
+   * passed as the values of its columns back to back, see the BTreeIndex constructor.
+   */
+	template <class T>
+	T keyFromPtr(const void* key) const;
+
+  /**
+   * Write a key of type T out in the form keyFromPtr takes it in.
+   */
+	template <class T>
+	void keyToPtr(const T& key, void* out) const;
+
+  /**
+   * Key of type T of a record of the base relation.
+   */
+	template <class T>
+	T keyFromRecord(const char* record) const;
+
+  /**
+   * Initialize an empty tree: a root non-leaf at level 1 with a single empty leaf child.
+   */
+	template <class T>
+	void initEmptyTree();
+
+  /**
+   * Build the tree bottom up from the sorted (key, rid) pairs of the base relation.
+   * Leaves are written left to right, then each non-leaf level is built over the one below it.
+   *
+   * @param relationName  Name of the base relation
+   * @param runPrefix     Prefix for the sorted runs spilled to disk
+   * @param options       Fill factor and sort budget
+   */
+	template <class T>
+	void bulkLoad(const std::string & relationName, const std::string & runPrefix, const BTreeBuildOptions & options);
+
+  /**
+   * bulkLoad over sorted entries of type Entry, a RIDKeyPair or, for an index with included attributes, an IncludedRIDKeyPair.
+   */
+	template <class T, class Entry>
+	void bulkLoadEntries(const std::string & relationName, const std::string & runPrefix, const BTreeBuildOptions & options);
+
+  /**
+   * Insert the pair <key,rid>, as a message to the root for an index with a message buffer.
+   * included points at includedSize bytes of included attribute values, and is NULL if there are none.
+   */
+	template <class T>
+	void insertKey(const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Insert the pair <key,rid> straight into the leaves, growing a new root if the old root got split.
+   * The descent keeps the nodes it passes pinned in a PinnedPathNode array, so that each page is read
+   * from the buffer pool once, and separators of split nodes are added to them bottom up in a loop.
+   */
+	template <class T>
+	void insertIntoTree(const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Insert <key,rid> in concurrent mode. Non-leaf nodes are read optimistically, and a split
+   * latches the node being split and then its parent, one at a time.
+   */
+	template <class T>
+	void insertKeyLinked(const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Insert <key,rid> straight into the rightmost leaf if key belongs there and the leaf has room.
+   * @return false, with nothing changed, otherwise
+   */
+	template <class T>
+	bool appendToLastLeaf(const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Latch the node at pageNo for writing, moving right while key is beyond its high key.
+   * @param pageNo    Node to start at; set to the node that was latched
+   * @param page      Set to the pinned page of the latched node
+   * @return the latched node
+   */
+	template <class T, class Node>
+	Node* latchCovering(PageId& pageNo, Page*& page, const T& key);
+
+  /**
+   * Latch the parent of childNo for writing, starting at pageNo and moving right until it is found.
+   * If the node that covers key, or the last node of the level, does not hold it, childNo was split off by
+   * another thread that has yet to post it, and the search starts over at pageNo until it has.
+   * @param key       Separator of the page split off childNo
+   * @param index     Set to the position of key in the latched node: after childNo, and after the separators
+   *                  below key of pages split off childNo since
+   */
+	template <class T>
+	NonLeafNode<T>* latchParent(PageId& pageNo, Page*& page, const PageId childNo, const T& key, int& index);
+
+  /**
+   * @brief Go down to the node at the given level that holds key, moving right past nodes split
+   * since their parent was read. Reads are validated against the node versions in concurrent mode.
+   *
+   * @param key       Key to look for
+   * @param level     Level to stop at, 0 for the leaves
+   * @param leftmost  True for the leftmost node that may hold key, false for the one inserts go to
+   * @param path      If not NULL, the non-leaf nodes passed on the way down are appended
+   * @return page number of the node found
+   */
+	template <class T>
+	PageId findNode(const T& key, const int level, const bool leftmost, DescentPath* path);
+
+  /**
+   * Make a new root above the old one and pushUp.
+   * @param oldRoot   The old root if the caller has it pinned, NULL to read it
+   */
+	template <class T>
+	void growRoot(const PageKeyPair<T>& pushUp, const NonLeafNode<T>* oldRoot);
+
+  /**
+   * Split a full leaf while adding <key,rid> to it. A separator before the first key of the new right sibling is copied up.
+   * Keys appended past the end of the rightmost leaf, or before the start of the leftmost one, are split off on their
+   * own so that sequential inserts leave full leaves behind.
+   * The leaf right of the new sibling still points back at nodeNo, see linkLeftSib.
+   */
+	template <class T>
+	void splitLeaf(const PageId nodeNo, LeafNode<T>* node, const T& key, const RecordId rid, const char* included, PageKeyPair<T>& pushUp);
+
+  /**
+   * Point the leaf to the right of leafNo back at it, if it still points at oldLeftNo. Called once nothing is latched.
+   */
+	template <class T>
+	void linkLeftSib(const PageId leafNo, const PageId oldLeftNo);
+
+
+  /**
+   * Remove the pair <key,rid> if it is in the index, as a message to the root for an index with a message buffer.
+   * @return false if it was not found
+   */
+	template <class T>
+	bool deleteKey(const T& key, const RecordId rid, const DeleteMode mode);
+
+  /**
+   * Remove the pair <key,rid> straight from the leaves, dropping the root if it is left with a single child.
+   * @return false if it was not found
+   */
+	template <class T>
+	bool deleteFromTree(const T& key, const RecordId rid, const DeleteMode mode);
+
+  /**
+   * Message i of the buffer of node.
+   */
+	template <class T>
+	BufferedMessage<T> getMessage(const NonLeafNode<T>* node, const int i) const;
+
+  /**
+   * Store msg as message i of the buffer of node.
+   */
+	template <class T>
+	void setMessage(NonLeafNode<T>* node, const int i, const BufferedMessage<T>& msg) const;
+
+  /**
+   * Add msg to the buffer of the root, and flush the buffer if that filled it.
+   */
+	template <class T>
+	void bufferMessage(const BufferedMessage<T>& msg);
+
+  /**
+   * Take the messages of the node at pageNo that go to its child with the most of them, and move
+   * them into the buffer of that child, flushing it first if they do not fit, or apply them to the
+   * leaves if the child is a leaf.
+   */
+	template <class T>
+	void flushBuffer(const PageId pageNo);
+
+  /**
+   * Apply a message taken out of the buffers to the leaves.
+   */
+	template <class T>
+	void applyMessage(const BufferedMessage<T>& msg);
+
+  /**
+   * Apply every buffered message with a key in [lowVal, highVal] to the leaves, every message at all
+   * if the bounds are NULL.
+   */
+	template <class T>
+	void flushRange(const T* lowVal, const T* highVal);
+
+  /**
+   * Take the messages with a key in [lowVal, highVal] out of the node at pageNo and the non-leaf nodes
+   * below it, appending those of each level to byLevel[level] in the order they were buffered.
+   */
+	template <class T>
+	void takeMessages(const PageId pageNo, const T* lowVal, const T* highVal, std::vector<std::vector<BufferedMessage<T> > >& byLevel);
+
+  /**
+   * Messages buffered for key on its way down the tree, oldest first.
+   */
+	template <class T>
+	void pendingMessages(const T& key, std::vector<BufferedMessage<T> >& out);
+
+  /**
+   * Record ids of key with the messages buffered for it applied to those in the leaves.
+   * @return false, leaving rids alone, if no message is buffered for key
+   */
+	template <class T>
+	bool lookupPending(const T& key, std::vector<RecordId>& rids);
+
+  /**
+   * @brief Recursive delete function for the BTree. Looks for the entry in every child
+   * whose range can hold key, since duplicates may span several leaves.
+   *
+   * @param key       Key to delete
+   * @param rid       Record ID of the entry
+   * @param isLeaf    True if currPageId is a leaf node
+   * @param currPageId  Page of the node to delete from
+   * @param mode      LAZY or MERGE
+   * @param found     Set to true if the entry was found and deleted
+   * @return true if the node is now underfull and has to be fixed by its parent
+   */
+	template <class T>
+	bool recursiveDelete(const T& key, const RecordId rid, const bool isLeaf, const PageId currPageId, const DeleteMode mode, bool& found);
+
+  /**
+   * Merge the underfull child at index of node with a sibling, or move entries over from the sibling.
+   * @return true if node is now underfull itself
+   */
+	template <class T>
+	bool fixUnderflow(NonLeafNode<T>* node, const int index);
+
+  /**
+   * Remove the lazily deleted slots of a leaf.
+   */
+	template <class T>
+	void compactLeaf(LeafNode<T>* node);
+
+  /**
+   * Move the longest run of duplicates of a full leaf out to a posting list, if it is at least
+   * POSTING_MIN_RUN long. Called when the leaf would have to be split otherwise.
+   * Never done in an index with included attributes, whose entries carry values of their own.
+   */
+	template <class T>
+	void collapseDuplicates(LeafNode<T>* node);
+
+  /**
+   * Make room for <key,rid> in a leaf and insert it, compacting the leaf and collapsing its
+   * duplicates if it is full.
+   * @return false, with the leaf possibly rearranged, if the leaf has to be split
+   */
+	template <class T>
+	bool insertWithoutSplit(LeafNode<T>* node, const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Add rid to the posting list of slot, which gets a new first page when that one is full.
+   */
+	void appendToPosting(RecordId& slot, const RecordId rid);
+
+  /**
+   * Remove rid from the posting list of slot, freeing pages that run empty.
+   * @return false if rid is not on the list. slot.page_number is Page::INVALID_NUMBER once the list is empty.
+   */
+	bool removeFromPosting(RecordId& slot, const RecordId rid);
+
+  /**
+   * Write a posting list page holding rids, in front of nextPageNo.
+   * @return page number of the new page
+   */
+	PageId writePostingPage(const RecordId* rids, const int numRids, const PageId nextPageNo);
+
+  /**
+   * Copy the record ids of a posting list page.
+   * @return page number of the next page of the list
+   */
+	PageId readPostingPage(const PageId pageNo, std::vector<RecordId>& rids);
+
+  /**
+   * Number of record ids on the posting list of slot.
+   */
+	std::uint32_t postingListSize(const RecordId& slot);
+
+  /**
+   * Find record id rank of the posting list of slot.
+   * @return false, with the size of the list taken off rank, if the list is shorter
+   */
+	bool findInPosting(const RecordId& slot, std::size_t& rank, RecordId& outRid);
+
+  /**
+   * Number of live entries in the slots [0, end) of a leaf, counting every record id of a posting list.
+   */
+	template <class T>
+	std::uint32_t countLeafEntries(const LeafNode<T>* node, const int end);
+
+  /**
+   * Count an entry appended to the last leaf in the last child of every non-leaf above it.
+   */
+	template <class T>
+	void countAppended();
+
+  /**
+   * Recompute the entry counts of the subtree at pageNo.
+   * @param isLeaf    True if pageNo is a leaf node
+   * @return number of entries in the subtree
+   */
+	template <class T>
+	std::uint32_t rebuildCounts(const PageId pageNo, const bool isLeaf);
 
-/**
- * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
- */
-//                                                     level     extra pageNo                  key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
+  /**
+   * Number of entries with a key less than key, or less than or equal if inclusive, from one descent.
+   */
+	template <class T>
+	std::size_t rankOf(const T& key, const bool inclusive);
 
-/**
- * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
- * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
- */
-template <class T>
-class RIDKeyPair{
-public:
-	RecordId rid;
-	T key;
-	void set( RecordId r, T k)
-	{
-		rid = r;
-		key = k;
-	}
-};
+  /**
+   * Find entry k, counting from 0, in ascending key order. With valid entry counts it is found from
+   * one descent, otherwise by walking the leaves from the first.
+   * @return  false if the index holds k entries or fewer
+   */
+	template <class T>
+	bool entryAtRank(const std::size_t k, T& outKey, RecordId& outRid);
 
-/**
- * @brief Structure to store a key page pair which is used to pass the key and page to functions that make 
- * any modifications to the non leaf pages of the tree.
-*/
-template <class T>
-class PageKeyPair{
-public:
-	PageId pageNo;
-	T key;
-	void set( int p, T k)
-	{
-		pageNo = p;
-		key = k;
-	}
-};
+  /**
+   * Call visit with the key and number of entries of every live leaf slot, in key order.
+   */
+	template <class T>
+	void visitLeafSlots(const std::function<void(const T&, std::uint32_t)>& visit);
 
-/**
- * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
-*/
-template <class T>
-bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
-{
-	if( r1.key != r2.key )
-		return r1.key < r2.key;
-	else
-		return r1.rid.page_number < r2.rid.page_number;
-}
+  /**
+   * Recompute the statistics from the leaves, see refreshStatistics.
+   */
+	template <class T>
+	void rebuildStats();
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
- * to the following structure to store or retrieve information from it.
- * Contains the relation name for which the index is created, the byte offset
- * of the key value on which the index is made, the type of the key and the page no
- * of the root page. Root page starts as page 2 but since a split can occur
- * at the root the root page may get moved up and get a new page no.
-*/
-struct IndexMetaInfo{
   /**
-   * Name of base relation.
+   * Account in the statistics for an entry with key that was just inserted. A bucket that grew to twice
+   * the depth of an equi-depth bucket is split at its median, which the entry counts are needed to find.
    */
-	char relationName[20];
+	template <class T>
+	void noteInserted(const T& key);
 
   /**
-   * Offset of attribute, over which index is built, inside the record stored in pages.
+   * Account in the statistics for an entry with key that was just deleted.
    */
-	int attrByteOffset;
+	template <class T>
+	void noteDeleted(const T& key);
 
   /**
-   * Type of the attribute over which index is built.
+   * Split histogram bucket b in two with the same number of entries each, merging the two adjacent
+   * buckets with the fewest entries between them first if every bucket is in use.
    */
-	Datatype attrType;
+	template <class T>
+	void splitBucket(int b);
 
   /**
-   * Page number of root page of the B+ Tree inside the file index file.
+   * Typed estimateRange, see estimateRange.
    */
-	PageId rootPageNo;
-};
+	template <class T>
+	double estimateRangeTyped(const T& lowVal, const Operator lowOp, const T& highVal, const Operator highOp);
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
-node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
-at this level are just above the leaf nodes. Otherwise set to 0.
-*/
+  /**
+   * Typed getKeyRange, see getKeyRange.
+   */
+	template <class T>
+	bool getKeyRangeTyped(void* outMin, void* outMax);
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
-*/
-struct NonLeafNodeInt{
   /**
-   * Level of the node in the tree.
+   * Fold the changes of every shard of statsDeltas into stats. The caller holds statsLatch.
    */
-	int level;
+	void foldStatsDeltas();
 
   /**
-   * Stores keys.
+   * Typed foldStatsDeltas, see foldStatsDeltas.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+	template <class T>
+	void foldStatsDeltasTyped();
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   * Typed verifyIndex, see verifyIndex.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
+	template <class T>
+	void verifyTyped(IndexVerifyState& state);
 
-  // current number of keys in the key array
-  int numKeys;
-};
+  /**
+   * Check the subtree at pageNo, whose keys must lie in [low, high], and describe its edges in out.
+   * The children of a node above level 1 are checked on threads of their own while state has any to spare.
+   * @param ring    Ring of frames of the calling thread, which the pages are read through
+   * @param level   Level the node must be at, 0 for a leaf
+   * @param low     Smallest key the subtree may hold, NULL if there is none
+   * @param high    Largest key the subtree may hold, NULL if there is none
+   */
+	template <class T>
+	void verifySubtree(IndexVerifyState& state, BufRing& ring, const PageId pageNo, const int level, const T* low, const T* high, VerifiedSubtree<T>& out);
 
+  /**
+   * Check the leaf at pageNo and its posting lists, as for verifySubtree.
+   */
+	template <class T>
+	void verifyLeaf(IndexVerifyState& state, BufRing& ring, const PageId pageNo, const T* low, const T* high, VerifiedSubtree<T>& out);
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
-*/
-struct LeafNodeInt{
   /**
-   * Stores keys.
+   * Check the pages of the posting list of a slot of leaf leafNo.
+   * @return number of record ids on the list
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	std::uint64_t verifyPostingList(IndexVerifyState& state, BufRing& ring, const PageId leafNo, const RecordId& slot);
 
   /**
-   * Stores RecordIds.
+   * Typed countRange, see countRange.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	template <class T>
+	std::size_t countRangeTyped(const T& lowVal, const Operator lowOp, const T& highVal, const Operator highOp);
 
   /**
-   * Page number of the leaf on the right side.
-	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * Typed selectKth, see selectKth.
    */
-	PageId rightSibPageNo;
+	template <class T>
+	bool selectKthTyped(const std::size_t k, void* outKey, RecordId& outRid);
 
-  // current number of keys inf the key array
-  int numKeys;
-};
+  /**
+   * Remove key index and the child to its right from a non-leaf node.
+   */
+	template <class T>
+	void removeFromNonLeaf(NonLeafNode<T>* node, const int index);
 
-struct KeyPagePair{
-  int key;
-  PageId pageId;
-}
+  /**
+   * Insert <key,rid> into a leaf node that has room for it, keeping keys sorted.
+   * Goes to the posting list of key instead if the leaf has one where key would be inserted.
+   */
+	template <class T>
+	void insertIntoLeaf(LeafNode<T>* node, const T& key, const RecordId rid, const char* included);
 
+  /**
+   * Insert a separator key and its right child into a non-leaf node that has room for it,
+   * right after child index, the node the new child was split from.
+   */
+	template <class T>
+	void insertIntoNonLeaf(NonLeafNode<T>* node, const int index, const PageKeyPair<T>& pair);
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
-*/
-class BTreeIndex {
+  /**
+   * Split a full non-leaf node while adding pair to it after child index. The middle key is pushed up.
+   */
+	template <class T>
+	void splitNonLeaf(NonLeafNode<T>* node, const int index, const PageKeyPair<T>& pair, PageKeyPair<T>& pushUp);
 
- private:
+  /**
+   * Typed lookup, see lookup.
+   */
+	template <class T>
+	bool lookupTyped(const T& key, RecordId& outRid);
 
   /**
-   * File object for the index file.
+   * Typed lookupAll, see lookupAll.
    */
-	File		*file;
+	template <class T>
+	std::size_t lookupAllTyped(const T& key, const std::function<void(const RecordId&)>& callback);
 
   /**
-   * Buffer Manager Instance.
+   * lookupAllTyped over the leaves alone, leaving out buffered messages.
    */
-	BufMgr	*bufMgr;
+	template <class T>
+	std::size_t lookupInLeaves(const T& key, const std::function<void(const RecordId&)>& callback);
 
   /**
-   * Page number of meta page.
+   * Typed lookupBatch, see lookupBatch.
    */
-	PageId	headerPageNum;
+	template <class T>
+	std::size_t lookupBatchTyped(const void* const* keys, const std::size_t numKeys, RecordId* outRids);
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Resolve sorted probes (key, position in outRids) that all fall under the node at pageNo.
+   * Each child is visited once with the run of probes it covers; probes beyond the node go to its right sibling.
+   * @param isLeaf    True if pageNo is a leaf node
    */
-	PageId	rootPageNum;
+	template <class T>
+	void lookupBatchNode(PageId pageNo, const bool isLeaf, const std::pair<T, std::size_t>* probes, std::size_t numProbes, RecordId* outRids);
 
   /**
-   * Datatype of attribute over which index is built.
+   * Copy out the record ids of up to maxRids live entries equal to key from one leaf.
+   * In concurrent mode the leaf is read again until no writer got in the way.
+   * @param nextPageNo  Set to the leaf that may hold more entries equal to key, or Page::INVALID_NUMBER
+   * @return  Number of record ids copied
    */
-	Datatype	attributeType;
+	template <class T>
+	int lookupInLeaf(const PageId pageNo, const T& key, RecordId* outRids, const int maxRids, PageId& nextPageNo);
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Copy up to maxRids record ids of the posting list of slot to outRids, going on where the cursor left off.
+   * The cursor's postingPos is back to -1 once the whole list has been handed out.
+   * @return number of record ids copied
    */
-	int 		attrByteOffset;
+	std::size_t readPostingRids(BTreeScanCursor& cursor, const RecordId& slot, RecordId* outRids, const std::size_t maxRids);
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Make pageNo the current leaf of cursor, either pinning it or copying it.
    */
-	int			leafOccupancy;
+	void fetchScanLeaf(BTreeScanCursor& cursor, const PageId pageNo);
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Let go of the current leaf of cursor.
    */
-	int			nodeOccupancy;
+	void releaseScanLeaf(BTreeScanCursor& cursor);
 
+  /**
+   * Position cursor on the first entry satisfying the scan bounds, in the order of the scan.
+   */
+	template <class T>
+	void startScanTyped(BTreeScanCursor& cursor, const T& lowVal, const T& highVal);
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Position a DESCENDING scan on the last entry satisfying the scan bounds.
+   */
+	template <class T>
+	void startScanDescending(BTreeScanCursor& cursor, const T& highVal);
 
   /**
-   * True if an index scan has been started.
+   * scanNext for key type T in DESCENDING order.
    */
-	bool		scanExecuting;
+	template <class T>
+	void scanPrevTyped(BTreeScanCursor& cursor, RecordId& outRid, char* outIncluded);
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * scanNextBatch for key type T in DESCENDING order.
    */
-	int			nextEntry;
+	template <class T>
+	std::size_t scanPrevBatchTyped(BTreeScanCursor& cursor, RecordId* outRids, const std::size_t maxRids, char* outIncluded);
 
   /**
-   * Page number of current page being scanned.
+   * Release the leaf cursor is on and move it to the left sibling, positioned on its last entry.
+   * @return false, with nothing pinned, if there is no left sibling
    */
-	PageId	currentPageNum;
+	template <class T>
+	bool moveToPrevLeaf(BTreeScanCursor& cursor);
 
   /**
-   * Current Page being scanned.
+   * scanNext for key type T.
    */
-	Page		*currentPageData;
+	template <class T>
+	void scanNextTyped(BTreeScanCursor& cursor, RecordId& outRid, char* outIncluded);
 
   /**
-   * Low INTEGER value for scan.
+   * scanNextBatch for key type T.
    */
-	int			lowValInt;
+	template <class T>
+	std::size_t scanNextBatchTyped(BTreeScanCursor& cursor, RecordId* outRids, const std::size_t maxRids, char* outIncluded);
 
   /**
-   * Low DOUBLE value for scan.
+   * Release the leaf cursor is on and move it to the right sibling.
+   * @return false, with nothing pinned, if there is no right sibling
    */
-	double	lowValDouble;
+	template <class T>
+	bool moveToNextLeaf(BTreeScanCursor& cursor);
 
   /**
-   * Low STRING value for scan.
+   * Set up read-ahead for a scan that starts on leafNo, which findNode reached through path.
    */
-	std::string	lowValString;
+	template <class T>
+	void startReadAhead(BTreeScanCursor& cursor, const DescentPath& path, const PageId leafNo);
 
   /**
-   * High INTEGER value for scan.
+   * Ask bufMgr to prefetch leaves after the current one, until readAheadDepth of them are pending
+   * or the next one starts past the high bound of the scan.
    */
-	int			highValInt;
+	template <class T>
+	void readAhead(BTreeScanCursor& cursor);
 
   /**
-   * High DOUBLE value for scan.
+   * Begin a scan on cursor, ending the scan it had open if any.
    */
-	double	highValDouble;
+	void startScan(BTreeScanCursor& cursor, const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp, const ScanOrder order);
 
   /**
-   * High STRING value for scan.
+   * Start a scan on cursor over the keys whose first numColumns columns equal prefix, see startPrefixScan.
    */
-	std::string highValString;
-	
+	void startPrefixScan(BTreeScanCursor& cursor, const void* prefix, const int numColumns, const ScanOrder order);
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Fetch the next record id of the scan open on cursor, and its included attribute values unless outIncluded is NULL.
    */
-	Operator	lowOp;
+	void scanNext(BTreeScanCursor& cursor, RecordId& outRid, void* outIncluded);
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Fetch the next batch of record ids of the scan open on cursor, and their included attribute values unless outIncluded is NULL.
    */
-	Operator	highOp;
+	std::size_t scanNextBatch(BTreeScanCursor& cursor, RecordId* outRids, const std::size_t maxRids, void* outIncluded);
+
+  /**
+   * Terminate the scan open on cursor and unpin its leaf.
+   */
+	void endScan(BTreeScanCursor& cursor);
+
+	friend class BTreeScanCursor;
 
 	
  public:
@@ -309,16 +2302,37 @@ class BTreeIndex {
   /**
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
-	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * If not, create it and bulk load the entries for every tuple in the base relation, read using FileScan class.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
+   * @param buildOptions				Fill factor and sort budget used if the index has to be built
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const BTreeBuildOptions & buildOptions = BTreeBuildOptions());
+
+
+  /**
+   * BTreeIndex Constructor for a COMPOSITE index, whose key is made of several attributes and ordered by
+	 * the first, then the second, and so on. The index file is named after the relation and the offsets of
+	 * the attributes joined by '+'. Keys are passed to and returned from the index as the values of the
+	 * attributes back to back, in the order of keyColumns: 4 bytes per INTEGER, 8 per DOUBLE and STRINGSIZE
+	 * characters per STRING.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param keyColumns					Attributes the key is made of, most significant first
+   * @param buildOptions				Fill factor and sort budget used if the index has to be built
+   * @throws  BadIndexInfoException If there are no key columns or more than MAX_KEY_COLUMNS, or they take more than COMPOSITESIZE bytes
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn, const std::vector<KeyColumn> & keyColumns,
+						const BTreeBuildOptions & buildOptions = BTreeBuildOptions());
 	
 
   /**
@@ -336,21 +2350,166 @@ class BTreeIndex {
 	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
 	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
 	 * Make sure to unpin pages as soon as you can.
+	 * In concurrent mode this may be called from several threads at once, and alongside scans on cursors from openScan.
+	 * With a message buffer the entry only goes into the buffer of the root, see BTreeBuildOptions::bufferFraction.
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * @param record	The record itself, which the values of the included attributes are copied from. Needed only,
+   *								and then required, if the index has included attributes.
+   * @throws  BadIndexInfoException If the index has included attributes and record is NULL
 	**/
-	void insertEntry(const void* key, const RecordId rid);
+	void insertEntry(const void* key, const RecordId rid, const void* record = NULL);
 
   /**
-   * @brief Recursive insert function for the BTree
-   * 
-   * @param key 
-   * @param rid 
-   * @param isLeaf 
-   * @param currPage 
-   * @return KeyPagePair - KeyPagePair in which to push up
-   */
-  KeyPagePair* recursiveInsert(int key, const RecordId rid, const bool isLeaf, PageId currPage)
+	 * Delete the entry <key,rid>.
+	 * With LAZY, the slot is only marked deleted: scans skip it, and it is compacted away the next time the
+	 * leaf would split. With MERGE, the slot is removed and a leaf or non-leaf left less than half full is
+	 * merged with or gets entries from a sibling, which may cascade up to the root. Pages emptied by merges
+	 * go to the free list of the index file and are reused by later splits.
+	 * With a message buffer the entry is looked up, and only a message is added to the root if it is found.
+	 * The message is applied LAZY whatever the mode.
+	 * Scans open on the index must be ended before entries are deleted, and no other thread may use the index meanwhile.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is being deleted
+   * @param mode		LAZY or MERGE
+   * @return  false if there is no such entry in the index
+	**/
+	bool deleteEntry(const void* key, const RecordId rid, const DeleteMode mode = MERGE);
+
+
+  /**
+	 * Find a record id whose key equals key. Goes down the tree once and leaves nothing pinned.
+	 * Cheaper than a scan over [key, key], and safe to call concurrently with inserts in concurrent mode.
+	 * Messages buffered on the way down for key are applied to what the leaves hold.
+   * @param key			Key to look for, pointer to integer/double/char string
+   * @param outRid	Record id of a matching entry returned in this
+   * @return  false if there is no entry with this key
+	**/
+	bool lookup(const void* key, RecordId& outRid);
+
+
+  /**
+	 * Call callback with the record id of every entry whose key equals key, in index order.
+	 * Nothing is pinned while callback runs, so it may use the buffer manager.
+   * @param key			Key to look for, pointer to integer/double/char string
+   * @param callback	Called once per matching entry
+   * @return  Number of matching entries
+	**/
+	std::size_t lookupAll(const void* key, const std::function<void(const RecordId&)>& callback);
+
+
+  /**
+	 * Look up a batch of keys at once, with the same result per key as lookup.
+	 * The keys are sorted and looked up in one pass over the tree, so a page holding several of
+	 * them is read once for all of them instead of once per key.
+   * @param keys			Array of numKeys pointers to integer/double/char string keys, in any order
+   * @param numKeys		Number of keys
+   * @param outRids		Array of numKeys record ids. outRids[i] receives a match of keys[i], or a record
+   *									id with page_number Page::INVALID_NUMBER if there is none.
+   * @return  Number of keys found
+	**/
+	std::size_t lookupBatch(const void* const* keys, const std::size_t numKeys, RecordId* outRids);
+
+
+  /**
+	 * Count the entries whose keys fall in a range, with the same bounds as startScan.
+	 * The non-leaf nodes know the number of entries under each child, so the count comes from two
+	 * descents without reading any leaves in between. In concurrent mode and with a message buffer the
+	 * counts are not kept, and the entries are scanned instead.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @return  Number of entries in the range, record ids of duplicate keys counted one by one
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	std::size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
+  /**
+	 * Find entry k, counting from 0, in ascending key order, the order of a full scan.
+	 * Found from one descent, like countRange, and by walking the leaves from the first in concurrent mode
+	 * or, once every buffered message is flushed to the leaves, with a message buffer.
+   * @param k				Position of the entry
+   * @param outKey	Receives the key of the entry: an integer, a double, STRINGSIZE characters without a terminating NUL,
+   *								or the columns of a COMPOSITE key
+   * @param outRid	Record id of the entry returned in this
+   * @return  false if the index holds k entries or fewer
+	**/
+	bool selectKth(const std::size_t k, void* outKey, RecordId& outRid);
+
+
+  /**
+	 * Number of entries in the index, record ids of duplicate keys counted one by one.
+	 * Read from the statistics page without reading the tree.
+	**/
+	std::size_t getEntryCount();
+
+
+  /**
+	 * Estimate of the number of distinct keys in the index, from a HyperLogLog sketch kept on the statistics page.
+	 * Keys of deleted entries still count until the next refreshStatistics.
+	**/
+	double estimateDistinctKeys();
+
+
+  /**
+	 * Smallest and largest key in the index, kept on the statistics page. After deletes they may lie
+	 * outside the keys that are left until the next refreshStatistics.
+   * @param outMin	Receives the smallest key, in the form selectKth returns keys in
+   * @param outMax	Receives the largest key
+   * @return  false, leaving outMin and outMax alone, if the index is empty
+	**/
+	bool getKeyRange(void* outMin, void* outMax);
+
+
+  /**
+	 * Estimate the number of entries in a range, with the same bounds as startScan, from the equi-depth
+	 * histogram on the statistics page. Meant for choosing between a range scan and a FileScan of the relation
+	 * without reading any leaves: the selectivity of the range is the estimate over getEntryCount.
+	 * Keys are taken to be spread evenly inside a bucket, and a bucket the range overlaps is taken to
+	 * hold at least the average number of entries per distinct key in it.
+	 * In concurrent mode and with a message buffer, buckets are not split as they grow, so the estimate
+	 * degrades until the next refreshStatistics.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @return  Estimated number of entries in the range, from 0 to getEntryCount
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	double estimateRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
+  /**
+	 * Recompute the statistics from the leaves: the entry count, key range, distinct key sketch and
+	 * histogram buckets of equal depth. Done on bulk build; afterwards only needed to bring the key range
+	 * and sketch back in line after many deletes, or the histogram after many inserts in concurrent mode
+	 * or with a message buffer, whose messages are flushed to the leaves first.
+	 * No other thread may use the index meanwhile.
+	**/
+	void refreshStatistics();
+
+
+  /**
+	 * Check the structure of the index: that the keys are in order inside every leaf and non-leaf and from each
+	 * leaf to the next, that every subtree stays between the separators around it and the high keys agree with
+	 * them, that the rightSibPageNo chain of every level, and leftSibPageNo of the leaves, link the nodes in key
+	 * order, that numKeys and the other slot counts are in bounds and agree with the slots, that every node is at
+	 * the level below its parent, and that no page is reachable twice or also on the free list. The entry counts
+	 * of the non-leaf nodes, the posting lists and the entry count of the statistics page are checked as well.
+	 * Meant for an index file that is to be trusted after a crash without being rebuilt.
+	 *
+	 * Subtrees are checked on several threads, which read the pages they miss at the same time, each into a ring
+	 * of buffer pool frames of its own. The check evicts only as many pages of other users as the rings have
+	 * frames, and each thread has a single page pinned at a time. No other thread may use the index meanwhile.
+   * @param numThreads		Most threads to check subtrees on at once, at least 1
+   * @param bufferFrames	Frames of the rings of all threads together, at least one per thread
+   * @return  Report of what was checked and the problems found
+	**/
+	IndexVerifyReport verifyIndex(const int numThreads = VERIFY_THREADS, const std::uint32_t bufferFrames = VERIFY_FRAMES);
 
 
   /**
@@ -360,25 +2519,84 @@ class BTreeIndex {
 	 * If another scan is already executing, that needs to be ended here.
 	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
 	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * In DESCENDING order the scan starts from the high bound instead and hands out entries in decreasing key order.
+	 * Messages buffered for keys in the range are first flushed to the leaves.
    * @param lowVal	Low value of range, pointer to integer / double / char string
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
    * @param highOp	High operator (LT/LTE)
+   * @param order		ASCENDING or DESCENDING
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
 	**/
-	void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp, const ScanOrder order = ASCENDING);
+
+
+  /**
+	 * Begin a filtered scan of the index on a new cursor, with the same semantics as startScan.
+	 * Scans opened this way are independent of each other and of startScan, each keeps its own leaf pinned.
+	 * In concurrent mode each cursor copies its leaf instead, and cursors can be used from different threads.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param order		ASCENDING or DESCENDING
+   * @return  Cursor positioned on the first entry of the scan
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	BTreeScanCursor openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp, const ScanOrder order = ASCENDING);
+
+
+  /**
+	 * Begin a scan of the entries whose keys start with prefix, the values of the first numColumns key columns.
+	 * For a COMPOSITE index on (a, b), a prefix of one column finds every entry with a given a, ordered by b.
+	 * Otherwise the same as startScan, which can also bound the column after the prefix.
+   * @param prefix	Values of the leading columns, in the form keys are passed in
+   * @param numColumns	Number of leading columns in prefix, from 1 to the number of key columns
+   * @param order		ASCENDING or DESCENDING
+   * @throws  BadIndexInfoException If numColumns is out of range
+	 * @throws  NoSuchKeyFoundException If no key starts with prefix.
+	**/
+	void startPrefixScan(const void* prefix, const int numColumns, const ScanOrder order = ASCENDING);
+
+
+  /**
+	 * Begin a scan of the entries whose keys start with prefix on a new cursor, see startPrefixScan and openScan.
+   * @param prefix	Values of the leading columns, in the form keys are passed in
+   * @param numColumns	Number of leading columns in prefix, from 1 to the number of key columns
+   * @param order		ASCENDING or DESCENDING
+   * @return  Cursor positioned on the first entry of the scan
+   * @throws  BadIndexInfoException If numColumns is out of range
+	 * @throws  NoSuchKeyFoundException If no key starts with prefix.
+	**/
+	BTreeScanCursor openPrefixScan(const void* prefix, const int numColumns, const ScanOrder order = ASCENDING);
 
 
   /**
 	 * Fetch the record id of the next index entry that matches the scan.
 	 * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
    * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param outIncluded	If not NULL, receives the getIncludedSize() bytes of included attribute values of the entry
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
 	**/
-	void scanNext(RecordId& outRid);  // returned record id
+	void scanNext(RecordId& outRid, void* outIncluded = NULL);  // returned record id
+
+
+  /**
+	 * Fetch the record ids of up to maxRids next index entries that match the scan.
+	 * Unlike scanNext, the end of the scan is signalled by the return value instead of an exception,
+	 * and whole runs of matching entries are copied out of each leaf with a single bound check per leaf.
+   * @param outRids	Array receiving the record ids
+   * @param maxRids	Capacity of outRids
+   * @param outIncluded	If not NULL, receives the included attribute values of each entry, getIncludedSize() bytes apiece
+   * @return  Number of record ids returned; 0 once the scan is completed
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	std::size_t scanNextBatch(RecordId* outRids, const std::size_t maxRids, void* outIncluded = NULL);
 
 
   /**
@@ -386,6 +2604,16 @@ class BTreeIndex {
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	void endScan();
+
+
+  /**
+	 * Number of bytes of included attribute values kept with each entry, 0 if the index includes no attributes.
+	 * The values of BTreeBuildOptions::included are packed in that order.
+	**/
+	int getIncludedSize() const
+	{
+		return includedSize;
+	}
 	
 };
 
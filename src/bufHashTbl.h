@@ -40,7 +40,8 @@ struct hashBucket {
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* @warning This class is not threadsafe. Calls for pages of different buckets, see hash(),
+* touch different chains and may run at the same time.
 */
 class BufHashTbl
 {
@@ -54,8 +55,10 @@ class BufHashTbl
 	 */
   hashBucket**  ht;
 
+ public:
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo,
+	 * which is the bucket the page goes to
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
@@ -63,7 +66,6 @@ class BufHashTbl
 	 */
   int	 hash(const File* file, const PageId pageNo);
 
- public:
 	/**
    * Constructor of BufHashTbl class
 	 */
@@ -96,6 +98,16 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Same as lookup, but for callers to whom a miss is no error.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference
+   * @return false if the page entry is not found in the hash table
+	 */
+  bool find(const File* file, const PageId pageNo, FrameId &frameNo);
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
@@ -13,6 +13,7 @@
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
 
 namespace badgerdb { 
 
@@ -21,7 +22,7 @@ namespace badgerdb {
 //----------------------------------------
 
 BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+	: numBufs(bufs), prefetchFile(NULL), prefetchStop(false) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -40,6 +41,17 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
 
 BufMgr::~BufMgr() {
+  // stop the prefetch thread before the pool goes away
+  {
+    std::lock_guard<std::mutex> guard(prefetchLatch);
+    prefetchStop = true;
+  }
+  prefetchCond.notify_all();
+  if (prefetchThread.joinable())
+  {
+    prefetchThread.join();
+  }
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
@@ -59,7 +71,7 @@ void BufMgr::allocBuf(FrameId & frame)
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
-  // Assumes non-concurrent access to buffer manager
+  // Called with clockLatch held by loadPage or allocPage
   std::uint32_t numScanned = 0;
   bool found = 0;
 
@@ -72,18 +84,17 @@ void BufMgr::allocBuf(FrameId & frame)
     // if invalid, use frame
     if (! bufDescTable[clockHand].valid)
     {
+      found = true;
       break;
     }
 
     // is valid, check referenced bit
     if (! bufDescTable[clockHand].refbit)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // check to see if someone has it pinned, again under the latch of its stripe before it goes
+      if (bufDescTable[clockHand].pinCnt == 0 && evictBuf(bufDescTable[clockHand]))
       {
         // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
         found = true;
         break;
       }
@@ -97,18 +108,10 @@ void BufMgr::allocBuf(FrameId & frame)
   }
   
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  if (!found)
   {
     throw BufferExceededException();
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
-  {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
-  }
 
 	//Reset all the BufDesc entry for the frame before returning the frame
   bufDescTable[clockHand].Clear();
@@ -117,43 +120,189 @@ void BufMgr::allocBuf(FrameId & frame)
   frame = clockHand;
 } // end allocBuf
 
+bool BufMgr::evictBuf(BufDesc & desc)
+{
+  StripeLatch& stripe = stripeOf(desc.file, desc.pageNo);
+  std::lock_guard<std::mutex> guard(stripe.latch);
+  if (desc.pinCnt > 0)
+  {
+    return false;
+  }
+
+  // flush any existing changes to disk if necessary
+  if (desc.dirty)
+  {
+    bufStats.diskwrites++;
+    {
+      std::lock_guard<std::mutex> ioGuard(ioLatch);
+      desc.file->writePage(desc.pageNo, bufPool[desc.frameNo]);
+    }
+    stripe.writeBacks++;
+  }
+
+  // remove previous entry from hash table
+  hashTable->remove(desc.file, desc.pageNo);
+  desc.Clear();
+  return true;
+}
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::allocRingBuf(BufRing & ring, FrameId & frame)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  // Called with clockLatch held by loadPage
+  if (ring.frames.size() < ring.capacity)
+  {
+    allocBuf(frame);
+    ring.frames.push_back(frame);
+    return;
+  }
+
+  const std::uint32_t pos = ring.next;
+  ring.next = (ring.next + 1) % ring.capacity;
+  BufDesc* desc = &bufDescTable[ring.frames[pos]];
+  if (desc->valid && (desc->pinCnt > 0 || desc->refbit || !evictBuf(*desc)))
+  {
+    // someone else has the page, which stays, and the ring moves on to a frame of the clock's choosing
+    allocBuf(frame);
+    ring.frames[pos] = frame;
+    return;
+  }
+
+  desc->Clear();
+  frame = desc->frameNo;
+}
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+bool BufMgr::pinIfPresent(File* file, const PageId pageNo, const bool refer, FrameId & frame, std::uint64_t & writeBacks)
+{
+  StripeLatch& stripe = stripeOf(file, pageNo);
+  std::lock_guard<std::mutex> guard(stripe.latch);
+  writeBacks = stripe.writeBacks;
+  if (!hashTable->find(file, pageNo, frame))
+  {
+    return false;
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+
+  bufDescTable[frame].pinCnt++;
+
+  // set the referenced bit, only writing the frame's line when it was clear
+  if (refer && !bufDescTable[frame].refbit)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    bufDescTable[frame].refbit = true;
+  }
+  return true;
+}
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+FrameId BufMgr::loadPage(File* file, const PageId pageNo, BufRing* ring, std::istream* reader, std::uint64_t writeBacks)
+{
+  StripeLatch& stripe = stripeOf(file, pageNo);
+  while (true)
+  {
+    // the frame is pinned but left out of the hash table while the page is read, so the clock passes it by
+    FrameId frameNo = 0;
+    {
+      std::lock_guard<std::mutex> guard(clockLatch);
+      if (ring != NULL)
+      {
+        allocRingBuf(*ring, frameNo);
+      }
+      else
+      {
+        allocBuf(frameNo);
+      }
+      bufStats.diskreads++;
+      bufDescTable[frameNo].Set(file, pageNo);
+      if (ring != NULL)
+      {
+        bufDescTable[frameNo].refbit = false;
+      }
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    try
+    {
+      if (reader == NULL || !file->readPage(*reader, pageNo, bufPool[frameNo]))
+      {
+        std::lock_guard<std::mutex> ioGuard(ioLatch);
+        bufPool[frameNo] = file->readPage(pageNo);
+      }
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> guard(clockLatch);
+      bufDescTable[frameNo].Clear();
+      throw;
+    }
+
+    FrameId otherNo = 0;
+    bool present = true;
+    {
+      std::lock_guard<std::mutex> guard(stripe.latch);
+      if (hashTable->find(file, pageNo, otherNo))
+      {
+        // another thread may have read the page in meanwhile, then its frame is used
+        bufDescTable[otherNo].pinCnt++;
+        if (ring == NULL && !bufDescTable[otherNo].refbit)
+        {
+          bufDescTable[otherNo].refbit = true;
+        }
+      }
+      else
+      {
+        present = false;
+        if (stripe.writeBacks == writeBacks)
+        {
+          hashTable->insert(file, pageNo, frameNo);
+          return frameNo;
+        }
+        // the page may have been read in, changed and written out again since it was missed
+        writeBacks = stripe.writeBacks;
+      }
+    }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    {
+      std::lock_guard<std::mutex> guard(clockLatch);
+      bufDescTable[frameNo].Clear();
+    }
+    if (present)
+    {
+      return otherNo;
+    }
   }
 }
 
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufRing& ring)
+{
+  FrameId frameNo = 0;
+  std::uint64_t writeBacks = 0;
+  if (!pinIfPresent(file, pageNo, false, frameNo, writeBacks))
+  {
+    if (ring.readerFile != file)
+    {
+      ring.reader = file->openReader();
+      ring.readerFile = file;
+    }
+    frameNo = loadPage(file, pageNo, &ring, ring.reader.get(), writeBacks);
+  }
+  page = &bufPool[frameNo];
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+  // check to see if it is already in the buffer pool
+  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  FrameId frameNo = 0;
+  std::uint64_t writeBacks = 0;
+  if (!pinIfPresent(file, pageNo, true, frameNo, writeBacks))
+  {
+    //not in the buffer pool, must allocate a new page
+    frameNo = loadPage(file, pageNo, NULL, NULL, writeBacks);
+  }
+  page = &bufPool[frameNo];
+}
+
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  std::lock_guard<std::mutex> guard(stripeOf(file, pageNo).latch);
+
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
@@ -170,6 +319,8 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  std::lock_guard<std::mutex> guard(clockLatch);
+
   FrameId frameNo;
 
   // alloc a new frame
@@ -177,31 +328,121 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  {
+    std::lock_guard<std::mutex> ioGuard(ioLatch);
+    bufPool[frameNo] = file->allocatePage(pageNo);
+  }
   page = &bufPool[frameNo];
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
 
   // insert in the hash table
+  std::lock_guard<std::mutex> stripeGuard(stripeOf(file, pageNo).latch);
   hashTable->insert(file, pageNo, frameNo);
 }
 
+void BufMgr::prefetchPage(File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(prefetchLatch);
+
+  // keep at most a quarter of the pool on its way in
+  if (prefetchStop || prefetchQueue.size() > numBufs / 4)
+  {
+    return;
+  }
+  if (!prefetchThread.joinable())
+  {
+    prefetchThread = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchQueue.push_back(std::make_pair(file, pageNo));
+  prefetchCond.notify_all();
+}
+
+void BufMgr::prefetchLoop()
+{
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  while (true)
+  {
+    while (!prefetchStop && prefetchQueue.empty())
+    {
+      prefetchCond.wait(lock);
+    }
+    if (prefetchStop)
+    {
+      return;
+    }
+    File* file = prefetchQueue.front().first;
+    const PageId pageNo = prefetchQueue.front().second;
+    prefetchQueue.pop_front();
+    prefetchFile = file;
+    lock.unlock();
+
+    // same as a readPage miss, but the page is left unpinned
+    try
+    {
+      FrameId frameNo = 0;
+      std::uint64_t writeBacks = 0;
+      if (!pinIfPresent(file, pageNo, false, frameNo, writeBacks))
+      {
+        loadPage(file, pageNo, NULL, NULL, writeBacks);
+      }
+      unPinPage(file, pageNo, false);
+    }
+    catch (const BadgerDbException &e)
+    {
+      // no frame to spare or no such page, it was only a hint
+    }
+
+    lock.lock();
+    prefetchFile = NULL;
+    prefetchCond.notify_all();
+  }
+}
+
 void BufMgr::flushFile(const File* file) 
 {
+  // nothing may be read into the pool for this file behind our back
+  {
+    std::unique_lock<std::mutex> lock(prefetchLatch);
+    for (std::deque<std::pair<File*, PageId> >::iterator it = prefetchQueue.begin(); it != prefetchQueue.end();)
+    {
+      if (it->first == file)
+      {
+        it = prefetchQueue.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    while (prefetchFile == file)
+    {
+      prefetchCond.wait(lock);
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(clockLatch);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
 		{
+	    StripeLatch& stripe = stripeOf(file, tmpbuf->pageNo);
+	    std::lock_guard<std::mutex> stripeGuard(stripe.latch);
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
 	    if (tmpbuf->dirty == true)
 			{
 				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+				{
+					std::lock_guard<std::mutex> ioGuard(ioLatch);
+					tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+				}
 				tmpbuf->dirty = false;
+				stripe.writeBacks++;
     	}
 
     	hashTable->remove(file,tmpbuf->pageNo);
@@ -214,22 +455,31 @@ void BufMgr::flushFile(const File* file)
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
+  std::lock_guard<std::mutex> guard(clockLatch);
+
 	//Deallocate from file altogether
   //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    StripeLatch& stripe = stripeOf(file, pageNo);
+    std::lock_guard<std::mutex> stripeGuard(stripe.latch);
+    FrameId frameNo = 0;
+    hashTable->lookup(file, pageNo, frameNo);
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+    // clear the page
+    bufDescTable[frameNo].Clear();
 
-	hashTable->remove(file, pageNo);
+    hashTable->remove(file, pageNo);
+    stripe.writeBacks++;
+  }
 
   // deallocate it in the file	
+  std::lock_guard<std::mutex> ioGuard(ioLatch);
   file->deletePage(pageNo);
 }
 
 void BufMgr::printSelf(void) 
 {
+  std::lock_guard<std::mutex> guard(clockLatch);
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
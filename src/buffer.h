@@ -9,7 +9,14 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace badgerdb {
 
@@ -18,6 +25,13 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* @brief Number of latches the buffer pool hash table is split over, by bucket. A page is found, pinned
+* and unpinned under the latch of its bucket alone, so that threads using different pages do not wait
+* for each other.
+*/
+const int BUF_STRIPES = 64;
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -42,9 +56,10 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Number of times this page has been pinned. Changed under the latch of the page's bucket,
+   * and read by the clock without it.
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
@@ -59,7 +74,7 @@ class BufDesc {
 	/**
    * Has this buffer frame been reference recently
 	 */
-  bool refbit;
+  std::atomic<bool> refbit;
 
 	/**
    * Initialize buffer frame for a new user
@@ -155,6 +170,52 @@ struct BufStats
 };
 
 
+/**
+* @brief Frames that one thread reading many pages, such as a thread of BTreeIndex::verifyIndex, reads
+* the pages it misses into over and over, instead of taking a new frame from the clock for each of them.
+* Reading a whole file this way evicts at most as many pages of other users as the ring has frames.
+* The pages are read through a stream of the ring's own, without holding any latch of the buffer manager,
+* so that threads with rings of their own read at the same time. Other members are only touched under the
+* clock latch.
+*/
+class BufRing {
+	friend class BufMgr;
+
+	/**
+   * Frames the ring has taken so far, at most capacity of them
+	 */
+  std::vector<FrameId> frames;
+
+	/**
+   * Most frames the ring takes
+	 */
+  std::uint32_t capacity;
+
+	/**
+   * Position in frames of the frame the next miss goes to, once all of them are taken
+	 */
+  std::uint32_t next;
+
+	/**
+   * File reader is open on, NULL until the first miss
+	 */
+  const File* readerFile;
+
+	/**
+   * Stream of the ring's own on readerFile
+	 */
+  std::shared_ptr<std::istream> reader;
+
+ public:
+	/**
+   * Constructor of BufRing class, for a ring of at least one frame
+	 */
+  explicit BufRing(const std::uint32_t numFrames)
+		: capacity(numFrames > 0 ? numFrames : 1), next(0), readerFile(NULL)
+	{
+  }
+};
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
 */
@@ -186,6 +247,84 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Latch of the hash table buckets of a stripe, a cache line apart from the next.
+	 */
+  struct StripeLatch
+  {
+    std::mutex latch;
+
+    /**
+     * Number of pages of the stripe written out and removed from the pool, so that a page read from disk
+     * without the latch can tell whether a newer copy might have been written meanwhile.
+     */
+    std::uint64_t writeBacks;
+
+    char padding[64 - sizeof(std::mutex) - sizeof(std::uint64_t)];
+
+    StripeLatch() : writeBacks(0) {}
+  };
+
+	/**
+   * Latches of the BUF_STRIPES stripes of the hash table. A page is only entered, found, pinned, unpinned or
+   * removed under the latch of its stripe, and its frame's dirty bit only changed under it.
+	 */
+  StripeLatch stripes[BUF_STRIPES];
+
+	/**
+   * Serializes the clock, and changes to which page a frame holds. Taken before any stripe latch.
+	 */
+  std::mutex clockLatch;
+
+	/**
+   * Serializes reads and writes through the streams of the files, which are shared by all File objects of
+   * a file. Taken after any other latch.
+	 */
+  std::mutex ioLatch;
+
+	/**
+   * Latch of the stripe the page is in.
+	 */
+  StripeLatch& stripeOf(const File* file, const PageId pageNo)
+  {
+    return stripes[static_cast<std::uint32_t>(hashTable->hash(file, pageNo)) % BUF_STRIPES];
+  }
+
+	/**
+   * Guards the prefetch queue and prefetchFile. Never taken while holding any other latch.
+	 */
+  std::mutex prefetchLatch;
+
+	/**
+   * Signalled when pages are queued, when a prefetch completes and when the prefetch thread has to stop.
+	 */
+  std::condition_variable prefetchCond;
+
+	/**
+   * Pages waiting to be read in by the prefetch thread.
+	 */
+  std::deque<std::pair<File*, PageId> > prefetchQueue;
+
+	/**
+   * File of the page the prefetch thread is reading in, NULL if it is idle.
+	 */
+  const File* prefetchFile;
+
+	/**
+   * Tells the prefetch thread to exit.
+	 */
+  bool prefetchStop;
+
+	/**
+   * Reads queued pages in the background. Started by the first prefetchPage call.
+	 */
+  std::thread prefetchThread;
+
+	/**
+   * Body of the prefetch thread.
+	 */
+  void prefetchLoop();
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
@@ -195,13 +334,60 @@ class BufMgr
   }
 
 	/**
-	 * Allocate a free frame.  
+	 * Allocate a free frame. Called with clockLatch held.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Take the page of a frame out of the pool if it is not pinned, writing it out first if it is dirty.
+	 * Called with clockLatch held, and done under the latch of the page's stripe, where nobody can pin it meanwhile.
+	 *
+	 * @param desc   	Frame holding a valid page
+	 * @return false, leaving the frame alone, if the page is pinned
+	 */
+  bool evictBuf(BufDesc & desc);
+
+	/**
+	 * Pin the frame of a page if it is in the pool.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param refer   Whether to set the referenced bit of the frame
+	 * @param frame   Frame of the page returned via this variable
+	 * @param writeBacks  Write backs of the page's stripe so far, returned via this variable
+	 * @return false if the page is not in the pool
+	 */
+  bool pinIfPresent(File* file, const PageId pageNo, const bool refer, FrameId & frame, std::uint64_t & writeBacks);
+
+	/**
+	 * Read a page that was not in the pool into a new frame, from ring if not NULL, and enter it in the hash table
+	 * pinned. The page is read through reader if it is not NULL, holding no latch, or else under ioLatch. If
+	 * another thread read the page in meanwhile, or a newer copy may have been written out since the page was
+	 * missed, the frame is given back and the page looked up again.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param ring   	Ring of frames of the reader, or NULL
+	 * @param reader  Stream of the reader's own on file from File::openReader, or NULL
+	 * @param writeBacks  Write backs of the page's stripe when the page was missed
+	 * @return frame holding the page
+	 */
+  FrameId loadPage(File* file, const PageId pageNo, BufRing* ring, std::istream* reader, std::uint64_t writeBacks);
+
+	/**
+	 * Allocate a frame of ring, or a new one from allocBuf that joins the ring if the frame
+	 * that is next is pinned or has been referenced by someone else since the ring read into it.
+	 * Called with clockLatch held.
+	 *
+	 * @param ring   	Ring to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocRingBuf(BufRing & ring, FrameId & frame);
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -229,6 +415,18 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Reads the given page like readPage, except that a page not in the buffer pool is read into a frame of
+	 * ring, without holding any latch if the file can be read through a stream of the ring's own, and that the
+	 * referenced bit is left alone, so that the pages only the ring reads go first.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param ring   	Ring of frames of the reader
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufRing& ring);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -249,10 +447,21 @@ class BufMgr
 	 */
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
+	/**
+	 * Ask for a page to be read into the buffer pool in the background, left unpinned, so that a later
+	 * readPage finds it there. Only a hint: it is dropped if too many are queued already, if the page is
+	 * in the pool, or if no frame can be freed for it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 */
+  void prefetchPage(File* file, const PageId PageNo);
+
 	/**
 	 * Writes out all dirty pages of the file to disk.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned. Prefetches of pages of the file that have not started are dropped, and one
+	 * in progress is waited for, so the File object can be deleted afterwards.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
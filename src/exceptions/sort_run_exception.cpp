@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "sort_run_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+SortRunException::SortRunException(const std::string& name, const std::string& reason)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Sort run " << filename_ << " " << reason;
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,42 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a sorted run spilled to disk cannot
+ *        be written in full, or does not read back the items written to it.
+ */
+class SortRunException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a sort run exception for the given run file.
+   *
+   * @param name    Name of the run file.
+   * @param reason  What went wrong with it.
+   */
+  SortRunException(const std::string& name, const std::string& reason);
+
+  /**
+   * Returns the name of the run file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of the run file that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
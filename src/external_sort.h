@@ -0,0 +1,269 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "exceptions/sort_run_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Sorts a stream of fixed size items within a memory budget.
+ *
+ * Items are collected in memory until the budget is used up, at which point the
+ * buffer is sorted and written out as a run file. Once all items have been added,
+ * finish() is called and the items are read back in order through next(),
+ * k-way merging the runs if any were spilled. T has to be trivially copyable
+ * and ordered by operator<. A run that cannot be written, or that does not read
+ * back every item written to it, throws SortRunException rather than leaving
+ * items out of the sorted stream.
+ *
+ * @warning This class is not threadsafe.
+ */
+template <class T>
+class ExternalSorter
+{
+ public:
+  /**
+   * Constructor of ExternalSorter class
+   *
+   * @param runPrefix     Prefix of the names of the run files spilled to disk
+   * @param budgetBytes   Memory available for sorting, in bytes
+   */
+	ExternalSorter(const std::string& runPrefix, const std::size_t budgetBytes)
+		: runPrefix_(runPrefix),
+			capacity_(std::max<std::size_t>(budgetBytes / sizeof(T), 2)),
+			numItems_(0),
+			nextItem_(0),
+			numMerged_(0)
+	{
+		buffer_.reserve(capacity_);
+	}
+
+  /**
+   * Destructor of ExternalSorter class. Removes any run files.
+   */
+	~ExternalSorter()
+	{
+		runs_.clear();
+		for (std::size_t i = 0; i < runNames_.size(); i++)
+		{
+			std::remove(runNames_[i].c_str());
+		}
+	}
+
+  /**
+   * Add an item. Spills a sorted run to disk if the buffer is full.
+   */
+	void add(const T& item)
+	{
+		if (buffer_.size() == capacity_)
+		{
+			spill();
+		}
+		buffer_.push_back(item);
+		++numItems_;
+	}
+
+  /**
+   * Total number of items added.
+   */
+	std::size_t size() const
+	{
+		return numItems_;
+	}
+
+  /**
+   * Number of runs that were written to disk.
+   */
+	std::size_t numRuns() const
+	{
+		return runNames_.size();
+	}
+
+  /**
+   * Done adding items. Sorts what is left in memory and prepares the merge.
+   */
+	void finish()
+	{
+		if (runNames_.empty())
+		{
+			// everything fit in memory, hand it out from the buffer
+			std::sort(buffer_.begin(), buffer_.end());
+			return;
+		}
+
+		if (!buffer_.empty())
+		{
+			spill();
+		}
+		std::vector<T>().swap(buffer_);
+
+		// split the budget among the runs being merged
+		const std::size_t chunk = std::max<std::size_t>(capacity_ / runNames_.size(), 1);
+		for (std::size_t i = 0; i < runNames_.size(); i++)
+		{
+			runs_.push_back(std::shared_ptr<RunReader>(new RunReader(runNames_[i], runSizes_[i], chunk)));
+			T item;
+			if (runs_[i]->next(item))
+			{
+				heap_.push(HeapEntry(item, i));
+			}
+		}
+	}
+
+  /**
+   * Fetch the next item in sorted order.
+   *
+   * @param out   Next item returned in this
+   * @return false once all items have been returned
+   */
+	bool next(T& out)
+	{
+		if (runNames_.empty())
+		{
+			if (nextItem_ == buffer_.size())
+			{
+				return false;
+			}
+			out = buffer_[nextItem_++];
+			return true;
+		}
+
+		if (heap_.empty())
+		{
+			if (numMerged_ != numItems_)
+			{
+				throw SortRunException(runPrefix_, "merge handed out fewer items than were added");
+			}
+			return false;
+		}
+		HeapEntry top = heap_.top();
+		heap_.pop();
+		out = top.item;
+		++numMerged_;
+
+		T item;
+		if (runs_[top.run]->next(item))
+		{
+			heap_.push(HeapEntry(item, top.run));
+		}
+		return true;
+	}
+
+ private:
+  /**
+   * Reads a run file of a known number of items back in chunks.
+   */
+	class RunReader
+	{
+	 public:
+		RunReader(const std::string& name, const std::size_t numItems, const std::size_t chunk)
+			: name_(name),
+				stream_(name.c_str(), std::ios::in | std::ios::binary),
+				remaining_(numItems),
+				chunk_(chunk),
+				pos_(0)
+		{
+			if (!stream_.is_open())
+			{
+				throw SortRunException(name_, "cannot be opened");
+			}
+		}
+
+		bool next(T& out)
+		{
+			if (pos_ == buffer_.size())
+			{
+				if (remaining_ == 0)
+				{
+					return false;
+				}
+				const std::size_t count = std::min(chunk_, remaining_);
+				buffer_.resize(count);
+				stream_.read(reinterpret_cast<char*>(&buffer_[0]), count * sizeof(T));
+				if (static_cast<std::size_t>(stream_.gcount()) != count * sizeof(T))
+				{
+					throw SortRunException(name_, "is shorter than was written");
+				}
+				remaining_ -= count;
+				pos_ = 0;
+			}
+			out = buffer_[pos_++];
+			return true;
+		}
+
+	 private:
+		std::string name_;
+		std::ifstream stream_;
+		std::vector<T> buffer_;
+		std::size_t remaining_;
+		std::size_t chunk_;
+		std::size_t pos_;
+	};
+
+  /**
+   * Head item of a run during the merge.
+   */
+	struct HeapEntry
+	{
+		T item;
+		std::size_t run;
+
+		HeapEntry(const T& i, const std::size_t r) : item(i), run(r) {}
+
+		// reversed so that the priority queue hands out the smallest item
+		bool operator<(const HeapEntry& rhs) const
+		{
+			return rhs.item < item;
+		}
+	};
+
+  /**
+   * Sort the buffer and write it out as a new run.
+   */
+	void spill()
+	{
+		std::sort(buffer_.begin(), buffer_.end());
+
+		std::ostringstream name;
+		name << runPrefix_ << ".run" << runNames_.size();
+		runNames_.push_back(name.str());
+		runSizes_.push_back(buffer_.size());
+
+		// a full disk or an I/O error shows up as a failed stream, at the latest when it is closed
+		std::ofstream out(name.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&buffer_[0]), buffer_.size() * sizeof(T));
+		out.close();
+		if (!out)
+		{
+			throw SortRunException(name.str(), "cannot be written");
+		}
+		buffer_.clear();
+	}
+
+	std::string runPrefix_;
+	std::size_t capacity_;
+	std::size_t numItems_;
+	std::size_t nextItem_;
+	std::size_t numMerged_;
+	std::vector<T> buffer_;
+	std::vector<std::string> runNames_;
+	std::vector<std::size_t> runSizes_;
+	std::vector<std::shared_ptr<RunReader> > runs_;
+	std::priority_queue<HeapEntry> heap_;
+};
+
+}
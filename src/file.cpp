@@ -64,6 +64,15 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
+PageId File::getEndPageNo() {
+  const FileHeader& header = readHeader();
+  return header.num_pages;
+}
+
+std::shared_ptr<std::istream> File::openReader() const {
+  return std::shared_ptr<std::istream>(new std::ifstream(filename_.c_str(), std::ios::in | std::ios::binary));
+}
+
 File::File(const std::string& name, const bool create_new) : filename_(name) {
   openIfNeeded(create_new);
 
@@ -119,6 +128,7 @@ FileHeader File::readHeader() const {
   FileHeader header;
   stream_->seekg(0 /* pos */, std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  checkStream(Page::INVALID_NUMBER);
   return header;
 }
 
@@ -126,6 +136,14 @@ void File::writeHeader(const FileHeader& header) {
   stream_->seekp(0 /* pos */, std::ios::beg);
   stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
   stream_->flush();
+  checkStream(Page::INVALID_NUMBER);
+}
+
+void File::checkStream(const PageId page_number) const {
+  if (!*stream_) {
+    stream_->clear();
+    throw InvalidPageException(page_number, filename_);
+  }
 }
 
 
@@ -250,6 +268,7 @@ Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
   stream_->read(&page.data_[0], Page::DATA_SIZE);
+  checkStream(page_number);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -319,12 +338,14 @@ void PageFile::writePage(const PageId page_number, const PageHeader& header,
   stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
   stream_->write(&new_page.data_[0], Page::DATA_SIZE);
   stream_->flush();
+  checkStream(page_number);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  checkStream(page_number);
   return header;
 }
 
@@ -382,13 +403,26 @@ Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
 	stream_->seekg(pagePosition(page_number), std::ios::beg);
 	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	checkStream(page_number);
 	return page;
 }
 
+bool BlobFile::readPage(std::istream& reader, const PageId page_number, Page& page) const {
+	reader.clear();
+	reader.seekg(pagePosition(page_number), std::ios::beg);
+	reader.read(reinterpret_cast<char*>(&page), Page::SIZE);
+	if (!reader) {
+		reader.clear();
+		throw InvalidPageException(page_number, filename_);
+	}
+	return true;
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
 	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
 	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
 	stream_->flush();
+	checkStream(new_page_number);
 }
 
 //delePage should not be called for a blob_file, not supported
@@ -134,6 +134,24 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page like readPage, but through a stream of its own on the
+   * file that openReader returned, so that several threads can read pages at once.
+   *
+   * @param reader        Stream from openReader, used by one thread at a time.
+   * @param page_number   Number of page to read.
+   * @param page          Receives the page.
+   * @return  false, leaving page alone, if the file cannot be read that way.
+   */
+  virtual bool readPage(std::istream& reader, const PageId page_number, Page& page) const { return false; }
+
+  /**
+   * Opens a read only stream of its own on the file, for readPage(reader, ...).
+   *
+   * @return  The stream.
+   */
+  std::shared_ptr<std::istream> openReader() const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -164,6 +182,13 @@ class File {
    */
 	PageId getFirstPageNo();
 
+ 	/**
+   * Returns the page number one past the last page of the file, which the next allocated page gets.
+   *
+   * @return  Page number past the end of the file.
+   */
+	PageId getEndPageNo();
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -210,6 +235,16 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
+  /**
+   * Checks that the last seek, read or write on the stream of this file went
+   * through. If not, the stream is cleared, so that later calls are not
+   * failed too, and an exception is thrown.
+   *
+   * @param page_number   Number of page that was accessed.
+   * @throws  InvalidPageException  If the stream failed.
+   */
+  void checkStream(const PageId page_number) const;
+
   typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
 
@@ -458,6 +493,17 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads a page through a stream from openReader.
+   *
+   * @param reader        Stream from openReader, used by one thread at a time.
+   * @param page_number   Number of page to read.
+   * @param page          Receives the page.
+   * @return  true.
+   * @throws  InvalidPageException  If the page is past the end of the file.
+   */
+  bool readPage(std::istream& reader, const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
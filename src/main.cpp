@@ -6,7 +6,16 @@
  */
 
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sys/wait.h>
 #include "btree.h"
+#include "external_sort.h"
+#include "node_search.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
@@ -19,6 +28,9 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/sort_run_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 #define checkPassFail(a, b)                                               \
 	{                                                                     \
@@ -42,7 +54,7 @@ using namespace badgerdb;
 const std::string relationName = "relA";
 // If the relation size is changed then the second parameter 2 chechPassFail may need to be changed to number of record that are expected to be found during the scan, else tests will erroneously be reported to have failed.
 const int relationSize = 5000;
-std::string intIndexName, doubleIndexName, stringIndexName;
+std::string intIndexName, doubleIndexName, stringIndexName, compositeIndexName;
 
 // This is the structure for tuples in the base relation
 
@@ -69,12 +81,56 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int countScanResults(BTreeIndex *index);
+int interleavedScans(BTreeIndex *index);
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const std::size_t batchSize);
+int pointLookups(BTreeIndex *index, int lowVal, int highVal);
+int batchLookups(BTreeIndex *index, int lowVal, int highVal);
+int reverseScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const std::size_t batchSize);
+int coveringScan(BTreeIndex *index, int lowVal, int highVal, const Operator highOp, const std::size_t batchSize, const ScanOrder order);
+int rankedEntries(BTreeIndex *index, int first, int last);
+int prefixScan(BTreeIndex *index, int tenant, const ScanOrder order);
+int estimateError(BTreeIndex *index, int lowVal, int highVal);
+bool verifyClean(BTreeIndex *index, const int numThreads);
+int verifyTool(const std::string &indexName);
 void indexTests();
 void test1();
 void test2();
 void test3();
+void test4();
+void insertTests();
+void test5();
+void deleteTests();
+void test6();
+void concurrentTests();
+void test7();
+void coveringTests();
+void test8();
+void compositeTests();
+void test9();
+void bufferedTests();
+void test10();
+void statisticsTests();
+void test11();
+void verifyTests();
+void test12();
+void packedTests();
+void test13();
+void concurrentStressTests();
+void test14();
+void nodeSearchTests();
+void test15();
+void scanTests();
+void test16();
+void test17();
+void fileErrorTests();
 void errorTests();
 void deleteRelation();
+void removeIndex(const std::string &indexName);
 
 int main(int argc, char **argv)
 {
@@ -137,6 +193,20 @@ int main(int argc, char **argv)
 	test1();
 	test2();
 	test3();
+	test4();
+	test5();
+	test6();
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
 	errorTests();
 
 	delete bufMgr;
@@ -177,6 +247,156 @@ void test3()
 	deleteRelation();
 }
 
+void test4()
+{
+	// Bulk load an index over tuples valued 0 to relationSize and grow it with insertEntry
+	std::cout << "--------------------" << std::endl;
+	std::cout << "insertEntry after bulk load" << std::endl;
+	createRelationRandom();
+	insertTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test5()
+{
+	// Bulk load an index over tuples valued 0 to relationSize and shrink it with deleteEntry
+	std::cout << "--------------------" << std::endl;
+	std::cout << "deleteEntry after bulk load" << std::endl;
+	createRelationRandom();
+	deleteTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test6()
+{
+	// Insert into and scan an index from several threads at once
+	std::cout << "--------------------" << std::endl;
+	std::cout << "concurrent insertEntry and scans" << std::endl;
+	createRelationRandom();
+	concurrentTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test7()
+{
+	// Scan the included attributes of a covering index instead of the relation
+	std::cout << "--------------------" << std::endl;
+	std::cout << "covering index" << std::endl;
+	createRelationRandom();
+	coveringTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test8()
+{
+	// Index the integer and double fields together and scan by the leading one
+	std::cout << "--------------------" << std::endl;
+	std::cout << "composite index" << std::endl;
+	createRelationRandom();
+	compositeTests();
+	removeIndex(compositeIndexName);
+	deleteRelation();
+}
+
+void test9()
+{
+	// Delete and insert through the message buffers of the non-leaf nodes
+	std::cout << "--------------------" << std::endl;
+	std::cout << "buffered index" << std::endl;
+	createRelationRandom();
+	bufferedTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test10()
+{
+	// Estimate the size of ranges from the statistics page instead of the leaves
+	std::cout << "--------------------" << std::endl;
+	std::cout << "index statistics" << std::endl;
+	createRelationRandom();
+	statisticsTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test11()
+{
+	// Check the structure of an index, and find the pages of one that was damaged
+	std::cout << "--------------------" << std::endl;
+	std::cout << "index verification" << std::endl;
+	createRelationRandom();
+	verifyTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test12()
+{
+	// Bit pack the leaves of an integer index, and compare it with a plain one
+	std::cout << "--------------------" << std::endl;
+	std::cout << "packed leaves" << std::endl;
+	createRelationRandom();
+	packedTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test13()
+{
+	// Insert from many threads at once into an index much larger than the buffer pool
+	std::cout << "--------------------" << std::endl;
+	std::cout << "concurrent insertEntry stress" << std::endl;
+	createRelationRandom();
+	concurrentStressTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test14()
+{
+	// Count the keys of a node below a key with the kernel the CPU gets
+	std::cout << "--------------------" << std::endl;
+	std::cout << "node search" << std::endl;
+	nodeSearchTests();
+}
+
+void test15()
+{
+	// Read one index with cursors, batches, point lookups, reverse scans and rank queries
+	std::cout << "--------------------" << std::endl;
+	std::cout << "index scans and lookups" << std::endl;
+	createRelationRandom();
+	scanTests();
+	removeIndex(intIndexName);
+	deleteRelation();
+}
+
+void test16()
+{
+	// Create indexes on the double and string fields and perform the same scans as on the integer one
+	std::cout << "--------------------" << std::endl;
+	std::cout << "double and string indexes" << std::endl;
+	createRelationRandom();
+	doubleTests();
+	removeIndex(doubleIndexName);
+	stringTests();
+	removeIndex(stringIndexName);
+	deleteRelation();
+}
+
+void test17()
+{
+	// Fail to write and read back a sort run, and read a page that is not in a file
+	std::cout << "--------------------" << std::endl;
+	std::cout << "file errors" << std::endl;
+	fileErrorTests();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -346,13 +566,7 @@ void createRelationRandom()
 void indexTests()
 {
 	intTests();
-	try
-	{
-		File::remove(intIndexName);
-	}
-	catch (const FileNotFoundException &e)
-	{
-	}
+	removeIndex(intIndexName);
 }
 
 // -----------------------------------------------------------------------------
@@ -376,9 +590,6 @@ void intTests()
 
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
 {
-	RecordId scanRid;
-	Page *curPage;
-
 	std::cout << "Scan for ";
 	if (lowOp == GT)
 	{
@@ -399,8 +610,6 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator
 	}
 	std::cout << std::endl;
 
-	int numResults = 0;
-
 	try
 	{
 		index->startScan(&lowVal, lowOp, &highVal, highOp);
@@ -411,169 +620,1734 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator
 		return 0;
 	}
 
-	while (1)
-	{
-		try
-		{
-			index->scanNext(scanRid);
-			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-			bufMgr->unPinPage(file1, scanRid.page_number, false);
-
-			if (numResults < 5)
-			{
-				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
-			}
-			else if (numResults == 5)
-			{
-				std::cout << "..." << std::endl;
-			}
-		}
-		catch (const IndexScanCompletedException &e)
-		{
-			break;
-		}
+	return countScanResults(index);
+}
 
-		numResults++;
-	}
+// -----------------------------------------------------------------------------
+// scanTests
+// -----------------------------------------------------------------------------
 
-	if (numResults >= 5)
-	{
-		std::cout << "Number of results: " << numResults << std::endl;
-	}
-	index->endScan();
-	std::cout << std::endl;
+void scanTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field and read it every way" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
 
-	return numResults;
+	checkPassFail(interleavedScans(&index), 14 + 1000 + 16)
+	checkPassFail(batchScan(&index, 25, GT, 40, LT, 5), 14)
+	checkPassFail(batchScan(&index, 3000, GTE, 4000, LT, 64), 1000)
+	checkPassFail(batchScan(&index, -1, GT, relationSize, LT, 1000), relationSize)
+	checkPassFail(pointLookups(&index, -50, 50), 50)
+	checkPassFail(pointLookups(&index, relationSize - 10, relationSize + 10), 10)
+	checkPassFail(batchLookups(&index, -100, relationSize + 100), relationSize)
+	checkPassFail(reverseScan(&index, 25, GT, 40, LT, 0), 14)
+	checkPassFail(reverseScan(&index, 20, GTE, 35, LTE, 0), 16)
+	checkPassFail(reverseScan(&index, -1, GT, relationSize, LT, 0), relationSize)
+	checkPassFail(reverseScan(&index, 3000, GTE, 4000, LT, 64), 1000)
+	checkPassFail(reverseScan(&index, 0, GT, 1, LT, 64), 0)
+	int lowVal = 25;
+	int highVal = 40;
+	checkPassFail((int)index.countRange(&lowVal, GT, &highVal, LT), 14)
+	checkPassFail((int)index.countRange(&lowVal, GTE, &highVal, LTE), 16)
+	checkPassFail((int)index.countRange(&lowVal, GT, &lowVal, LT), 0)
+	checkPassFail(rankedEntries(&index, 0, relationSize + 10), relationSize)
 }
 
 // -----------------------------------------------------------------------------
-// errorTests
+// insertTests
 // -----------------------------------------------------------------------------
 
-void errorTests()
+void insertTests()
 {
-	{
-		std::cout << "Error handling tests" << std::endl;
-		std::cout << "--------------------" << std::endl;
-		// Given error test
+	const int numInserts = 3000;
+	std::cout << "Create a B+ Tree index on the integer field and insert " << numInserts << " more keys" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
 
-		try
-		{
-			File::remove(relationName);
-		}
-		catch (const FileNotFoundException &e)
+	// reuse the record ids of the first tuples for the new keys, the bulk loaded
+	// leaves are not full so these go in without and with splits
+	int lowVal = 0;
+	int highVal = numInserts;
+	std::vector<RecordId> rids;
+	index.startScan(&lowVal, GTE, &highVal, LT);
+	try
+	{
+		RecordId scanRid;
+		while (1)
 		{
+			index.scanNext(scanRid);
+			rids.push_back(scanRid);
 		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index.endScan();
 
-		file1 = new PageFile(relationName, true);
+	for (int i = 0; i < numInserts; i++)
+	{
+		int key = relationSize + i;
+		index.insertEntry(&key, rids[i]);
+	}
 
-		// initialize all of record1.s to keep purify happy
-		memset(record1.s, ' ', sizeof(record1.s));
-		PageId new_page_number;
-		Page new_page = file1->allocatePage(new_page_number);
+	checkPassFail(intScan(&index, relationSize, GTE, relationSize + numInserts, LT), numInserts)
+	checkPassFail(intScan(&index, relationSize - 50, GTE, relationSize + 50, LT), 100)
+	checkPassFail(intScan(&index, -1, GT, relationSize + numInserts, LT), relationSize + numInserts)
 
-		// Insert a bunch of tuples into the relation.
-		for (int i = 0; i < 10; i++)
-		{
-			sprintf(record1.s, "%05d string record", i);
-			record1.i = i;
-			record1.d = (double)i;
-			std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+	// descending keys in front of the smallest one split the leftmost leaf
+	for (int i = 0; i < numInserts; i++)
+	{
+		int key = -1 - i;
+		index.insertEntry(&key, rids[i]);
+	}
+	checkPassFail(intScan(&index, -numInserts - 1, GT, 0, LT), numInserts)
+	checkPassFail(intScan(&index, -numInserts - 1, GT, relationSize + numInserts, LT), relationSize + 2 * numInserts)
 
-			while (1)
-			{
-				try
-				{
-					new_page.insertRecord(new_data);
-					break;
-				}
-				catch (const InsufficientSpaceException &e)
-				{
-					file1->writePage(new_page_number, new_page);
-					new_page = file1->allocatePage(new_page_number);
-				}
-			}
-		}
+	// many duplicates of one key move to a posting list once their leaf is full
+	const int hotKey = relationSize + numInserts;
+	for (int i = 0; i < numInserts; i++)
+	{
+		index.insertEntry(&hotKey, rids[i]);
+	}
+	std::size_t numHot = index.lookupAll(&hotKey, [](const RecordId &) {});
+	checkPassFail((int)numHot, numInserts)
+	checkPassFail(intScan(&index, hotKey - 1, GT, hotKey + 1, LT), numInserts)
+	for (int i = 0; i < numInserts / 2; i++)
+	{
+		index.deleteEntry(&hotKey, rids[i], MERGE);
+	}
+	checkPassFail(intScan(&index, hotKey, GTE, hotKey, LTE), numInserts / 2)
+	numHot = index.lookupAll(&hotKey, [](const RecordId &) {});
+	checkPassFail((int)numHot, numInserts / 2)
+	checkPassFail((int)index.countRange(&hotKey, GTE, &hotKey, LTE), numInserts / 2)
+	checkPassFail(rankedEntries(&index, relationSize + 2 * numInserts - 100, relationSize + 3 * numInserts), 100 + numInserts / 2)
+}
 
-		file1->writePage(new_page_number, new_page);
+// -----------------------------------------------------------------------------
+// deleteTests
+// -----------------------------------------------------------------------------
 
+void deleteTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field and delete from it" << std::endl;
+	std::vector<RecordId> rids;
+	{
 		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
 
-		int int2 = 2;
-		int int5 = 5;
-
-		// Scan Tests
-		std::cout << "Call endScan before startScan" << std::endl;
+		// keys are unique, so the scan hands out the record id of key i at position i
+		int lowVal = 0;
+		int highVal = relationSize;
+		index.startScan(&lowVal, GTE, &highVal, LT);
 		try
 		{
-			index.endScan();
-			std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+			RecordId scanRid;
+			while (1)
+			{
+				index.scanNext(scanRid);
+				rids.push_back(scanRid);
+			}
 		}
-		catch (const ScanNotInitializedException &e)
+		catch (const IndexScanCompletedException &e)
 		{
-			std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
 		}
+		index.endScan();
 
-		std::cout << "Call scanNext before startScan" << std::endl;
-		try
-		{
-			RecordId foo;
-			index.scanNext(foo);
-			std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
-		}
-		catch (const ScanNotInitializedException &e)
+		// the middle of the tree goes away, merging leaves and non-leaf nodes
+		int deleted = 0;
+		for (int key = 1000; key < 4000; key++)
 		{
-			std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+			deleted += index.deleteEntry(&key, rids[key], MERGE);
 		}
+		checkPassFail(deleted, 3000)
+		checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize - 3000)
+		checkPassFail(intScan(&index, 990, GTE, 4010, LT), 20)
 
-		std::cout << "Scan with bad lowOp" << std::endl;
-		try
-		{
-			index.startScan(&int2, LTE, &int5, LTE);
-			std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
-		}
-		catch (const BadOpcodesException &e)
+		// lazily deleted entries stay in their leaves but are skipped by scans
+		for (int key = 0; key < 500; key++)
 		{
-			std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+			index.deleteEntry(&key, rids[key], LAZY);
 		}
+		checkPassFail(intScan(&index, -1, GT, 1000, LT), 500)
+		checkPassFail(batchScan(&index, -1, GT, relationSize, LT, 64), relationSize - 3500)
+		checkPassFail(batchLookups(&index, 0, relationSize), relationSize - 3500)
+		checkPassFail(reverseScan(&index, -1, GT, relationSize, LT, 0), relationSize - 3500)
+		checkPassFail(reverseScan(&index, 400, GTE, 4010, LTE, 100), 511)
+		checkPassFail(rankedEntries(&index, 0, relationSize), relationSize - 3500)
+
+		// entries that are not there any more are reported as missing
+		int key = 0;
+		checkPassFail(index.deleteEntry(&key, rids[key], MERGE), false)
+		key = 2000;
+		checkPassFail(index.deleteEntry(&key, rids[key], LAZY), false)
+	}
 
-		std::cout << "Scan with bad highOp" << std::endl;
-		try
+	// the free pages are remembered in the index file and reused by inserts
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	for (int key = 0; key < 4000; key++)
+	{
+		if (key >= 500 && key < 1000)
 		{
-			index.startScan(&int2, GTE, &int5, GTE);
-			std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+			continue;
 		}
-		catch (const BadOpcodesException &e)
+		index.insertEntry(&key, rids[key]);
+	}
+	checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize)
+	checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+	checkPassFail(pointLookups(&index, 0, 1000), 1000)
+	checkPassFail(reverseScan(&index, -1, GT, relationSize, LT, 256), relationSize)
+	int lowVal = 400;
+	int highVal = 4010;
+	checkPassFail((int)index.countRange(&lowVal, GTE, &highVal, LTE), 3611)
+}
+
+// -----------------------------------------------------------------------------
+// bufferedTests
+// -----------------------------------------------------------------------------
+
+void bufferedTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field with message buffers" << std::endl;
+	const int numDeletes = 3000;
+	BTreeBuildOptions options;
+	options.bufferFraction = 0.95;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	}
+
+	// verify_index opens a buffered index as it was built, and leaves it as it is
+	checkPassFail(verifyTool(intIndexName), 0)
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		std::vector<RecordId> rids;
+		for (int key = 0; key < numDeletes; key++)
 		{
-			std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+			RecordId rid;
+			index.lookup(&key, rid);
+			rids.push_back(rid);
 		}
 
-		std::cout << "Scan with bad range" << std::endl;
-		try
+		// most of the messages are still in the buffers when the lookups run
+		int deleted = 0;
+		for (int key = 0; key < numDeletes; key++)
 		{
-			index.startScan(&int5, GTE, &int2, LTE);
-			std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+			deleted += index.deleteEntry(&key, rids[key], MERGE);
 		}
-		catch (const BadScanrangeException &e)
+		checkPassFail(deleted, numDeletes)
+		checkPassFail(pointLookups(&index, 0, numDeletes), 0)
+		int key = 0;
+		checkPassFail(index.deleteEntry(&key, rids[key], LAZY), false)
+		for (key = 0; key < numDeletes; key += 2)
 		{
-			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+			index.insertEntry(&key, rids[key]);
 		}
-
-		deleteRelation();
+		checkPassFail(pointLookups(&index, 0, numDeletes), numDeletes / 2)
+		checkPassFail(batchLookups(&index, 0, numDeletes), numDeletes / 2)
 	}
+	checkPassFail(verifyTool(intIndexName), 0)
 
+	// the buffers are kept in the index file, and go to the leaves before a scan
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	checkPassFail(pointLookups(&index, 0, numDeletes), numDeletes / 2)
+	checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize - numDeletes / 2)
+	checkPassFail(reverseScan(&index, -1, GT, numDeletes, LT, 64), numDeletes / 2)
+	int lowVal = 100;
+	int highVal = numDeletes + 100;
+	checkPassFail((int)index.countRange(&lowVal, GTE, &highVal, LT), numDeletes / 2 - 50 + 100)
+	checkPassFail(rankedEntries(&index, 0, 200), 200)
+
+	// the buffer has to leave room for keys, and is not kept by concurrent inserts
+	int errors = 0;
+	options.bufferFraction = 1;
 	try
 	{
-		File::remove(intIndexName);
+		std::string name;
+		BTreeIndex tooLarge(relationName, name, bufMgr, offsetof(tuple, d), DOUBLE, options);
 	}
-	catch (const FileNotFoundException &e)
+	catch (const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+	options.concurrent = true;
+	try
+	{
+		BTreeIndex concurrent(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	}
+	catch (const BadIndexInfoException &e)
 	{
+		errors++;
 	}
+	checkPassFail(errors, 2)
 }
 
-void deleteRelation()
+// -----------------------------------------------------------------------------
+// concurrentTests
+// -----------------------------------------------------------------------------
+
+void concurrentTests()
+{
+	const int numThreads = 4;
+	const int numInserts = 4000;
+	std::cout << "Create a concurrent B+ Tree index on the integer field and insert " << numInserts << " keys from "
+			  << numThreads << " threads" << std::endl;
+	BTreeBuildOptions options;
+	options.concurrent = true;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+	std::vector<RecordId> rids;
+	int lowVal = 0;
+	int highVal = numInserts;
+	index.startScan(&lowVal, GTE, &highVal, LT);
+	try
+	{
+		RecordId scanRid;
+		while (1)
+		{
+			index.scanNext(scanRid);
+			rids.push_back(scanRid);
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index.endScan();
+
+	// the bulk loaded keys have to stay visible to a scan running alongside the inserts
+	std::atomic<bool> inserting(true);
+	std::atomic<int> badScans(0);
+	std::thread scanner([&]() {
+		do
+		{
+			int low = 0;
+			int high = relationSize;
+			int count = 0;
+			BTreeScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+			try
+			{
+				RecordId rid;
+				while (1)
+				{
+					cursor.scanNext(rid);
+					count++;
+				}
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+			}
+			if (count != relationSize)
+			{
+				badScans++;
+			}
+		} while (inserting);
+	});
+
+	std::vector<std::thread> inserters;
+	for (int t = 0; t < numThreads; t++)
+	{
+		inserters.push_back(std::thread([&, t]() {
+			for (int i = t; i < numInserts; i += numThreads)
+			{
+				int key = relationSize + i;
+				index.insertEntry(&key, rids[i]);
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+	{
+		inserters[t].join();
+	}
+	inserting = false;
+	scanner.join();
+
+	checkPassFail(badScans, 0)
+	checkPassFail(intScan(&index, relationSize, GTE, relationSize + numInserts, LT), numInserts)
+	checkPassFail(intScan(&index, -1, GT, relationSize + numInserts, LT), relationSize + numInserts)
+	lowVal = -1;
+	highVal = relationSize + numInserts;
+	checkPassFail((int)index.countRange(&lowVal, GT, &highVal, LT), relationSize + numInserts)
+
+	// the statistics changes of the threads, kept apart, add up
+	checkPassFail((int)index.getEntryCount(), relationSize + numInserts)
+	index.getKeyRange(&lowVal, &highVal);
+	checkPassFail(highVal, relationSize + numInserts - 1)
+	checkPassFail((estimateError(&index, relationSize, relationSize + numInserts) <= 30), true)
+
+	// a thread can hold the latches of two pages whatever their numbers are
+	OptimisticLatchTable latches;
+	const PageId pageNos[] = {5, 5 + LATCHTABLE_SIZE, 5 + LATCHTABLE_SIZE * LATCHTABLE_FANOUT, ~PageId(0)};
+	for (int i = 1; i < 4; i++)
+	{
+		latches.latchFor(pageNos[0]).writeLock();
+		latches.latchFor(pageNos[i]).writeLock();
+		latches.latchFor(pageNos[i]).writeUnlock();
+		latches.latchFor(pageNos[0]).writeUnlock();
+	}
+	checkPassFail((int)latches.latchFor(pageNos[0]).readLock(), 6)
+}
+
+// -----------------------------------------------------------------------------
+// concurrentStressTests
+// -----------------------------------------------------------------------------
+
+void concurrentStressTests()
+{
+	const int numRounds = 10;
+	const int numThreads = 8;
+	const int numInserts = 5000;
+	std::cout << "Insert " << numInserts << " keys from each of " << numThreads << " threads into a concurrent B+ Tree index, "
+			  << numRounds << " times" << std::endl;
+	RecordId rid;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		int key = 0;
+		index.lookup(&key, rid);
+	}
+	removeIndex(intIndexName);
+
+	// the keys of the threads interleave and increase, so that a node split off at the right end of a level
+	// is split again by another thread before its separator is in the parent
+	for (int round = 0; round < numRounds; round++)
+	{
+		{
+			BTreeBuildOptions options;
+			options.concurrent = true;
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+			std::vector<std::thread> inserters;
+			for (int t = 0; t < numThreads; t++)
+			{
+				inserters.push_back(std::thread([&, t]() {
+					for (int i = 0; i < numInserts; i++)
+					{
+						int key = relationSize + i * numThreads + t;
+						index.insertEntry(&key, rid);
+					}
+				}));
+			}
+			for (int t = 0; t < numThreads; t++)
+			{
+				inserters[t].join();
+			}
+
+			int lowVal = -1;
+			int highVal = relationSize + numThreads * numInserts;
+			checkPassFail((int)index.countRange(&lowVal, GT, &highVal, LT), relationSize + numThreads * numInserts)
+			checkPassFail(verifyClean(&index, 4), true)
+		}
+		removeIndex(intIndexName);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// nodeSearchTests
+// -----------------------------------------------------------------------------
+
+void nodeSearchTests()
+{
+	std::cout << "Count DOUBLE keys not greater than a key, with NaN among them" << std::endl;
+
+	// a NaN is not greater than any key, nor any key greater than a NaN, in every kernel
+	const double nan = std::nan("");
+	const double keys[] = {1, 2, nan, 3, 4, nan, 5, 6, nan};
+	checkPassFail(countLessEqual<double>(keys, 9, 3.0), 6)
+	checkPassFail(countLessEqual<double>(keys, 9, nan), 9)
+	checkPassFail(countLess<double>(keys, 9, 3.0), 2)
+	checkPassFail(nodeUpperBound<double>(keys, 9, nan), 9)
+}
+
+// -----------------------------------------------------------------------------
+// interleavedScans
+// Runs two cursors and the index's own scan at the same time, taking turns.
+// Returns the total number of entries found by the three scans.
+// -----------------------------------------------------------------------------
+
+int interleavedScans(BTreeIndex *index)
+{
+	int low1 = 25, high1 = 40;
+	int low2 = 3000, high2 = 4000;
+	int low3 = 20, high3 = 35;
+
+	std::cout << "Interleaved scans for (25,40) [3000,4000) [20,35]" << std::endl;
+	BTreeScanCursor cursor1 = index->openScan(&low1, GT, &high1, LT);
+	BTreeScanCursor cursor2 = index->openScan(&low2, GTE, &high2, LT);
+	index->startScan(&low3, GTE, &high3, LTE);
+
+	int numResults = 0;
+	bool done1 = false, done2 = false, done3 = false;
+	RecordId scanRid;
+	while (!done1 || !done2 || !done3)
+	{
+		if (!done1)
+		{
+			try
+			{
+				cursor1.scanNext(scanRid);
+				numResults++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				done1 = true;
+			}
+		}
+		if (!done2)
+		{
+			try
+			{
+				cursor2.scanNext(scanRid);
+				numResults++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				done2 = true;
+			}
+		}
+		if (!done3)
+		{
+			try
+			{
+				index->scanNext(scanRid);
+				numResults++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				done3 = true;
+			}
+		}
+	}
+
+	cursor1.endScan();
+	cursor2.endScan();
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// batchScan
+// Drains a scan with scanNextBatch and checks the record ids come back in key order.
+// -----------------------------------------------------------------------------
+
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const std::size_t batchSize)
+{
+	std::cout << "Batch scan of " << batchSize << " for " << lowVal << "," << highVal << std::endl;
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	std::vector<RecordId> rids(batchSize);
+	Page *curPage;
+	int numResults = 0;
+	int prevKey = lowVal;
+	std::size_t n;
+	while ((n = index->scanNextBatch(&rids[0], batchSize)) > 0)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			bufMgr->readPage(file1, rids[i].page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(rids[i]).data()));
+			bufMgr->unPinPage(file1, rids[i].page_number, false);
+			if (myRec.i < prevKey)
+			{
+				std::cout << "Out of order key " << myRec.i << " after " << prevKey << std::endl;
+				return -1;
+			}
+			prevKey = myRec.i;
+		}
+		numResults += n;
+	}
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+	return numResults;
+}
+
+int pointLookups(BTreeIndex *index, int lowVal, int highVal)
+{
+	std::cout << "Point lookups for " << lowVal << "," << highVal << std::endl;
+	Page *curPage;
+	int numFound = 0;
+	for (int key = lowVal; key < highVal; key++)
+	{
+		RecordId rid;
+		if (!index->lookup(&key, rid))
+		{
+			continue;
+		}
+		bufMgr->readPage(file1, rid.page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(rid).data()));
+		bufMgr->unPinPage(file1, rid.page_number, false);
+		if (myRec.i != key)
+		{
+			std::cout << "Lookup of " << key << " found " << myRec.i << std::endl;
+			return -1;
+		}
+
+		// keys are unique, so lookupAll has to agree
+		std::vector<RecordId> all;
+		index->lookupAll(&key, [&all](const RecordId &r) { all.push_back(r); });
+		if (all.size() != 1 || all[0].page_number != rid.page_number || all[0].slot_number != rid.slot_number)
+		{
+			std::cout << "lookupAll of " << key << " found " << all.size() << " entries" << std::endl;
+			return -1;
+		}
+		numFound++;
+	}
+	std::cout << "Number of results: " << numFound << std::endl << std::endl;
+
+	return numFound;
+}
+
+int batchLookups(BTreeIndex *index, int lowVal, int highVal)
+{
+	std::cout << "Batch lookup for " << lowVal << "," << highVal << std::endl;
+
+	// probe in reverse, every key twice
+	std::vector<int> keys;
+	for (int key = highVal - 1; key >= lowVal; key--)
+	{
+		keys.push_back(key);
+		keys.push_back(key);
+	}
+	std::vector<const void *> keyPtrs(keys.size());
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		keyPtrs[i] = &keys[i];
+	}
+	std::vector<RecordId> rids(keys.size());
+	std::size_t numFound = index->lookupBatch(&keyPtrs[0], keys.size(), &rids[0]);
+
+	Page *curPage;
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		if (rids[i].page_number == Page::INVALID_NUMBER)
+		{
+			continue;
+		}
+		bufMgr->readPage(file1, rids[i].page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(rids[i]).data()));
+		bufMgr->unPinPage(file1, rids[i].page_number, false);
+		if (myRec.i != keys[i])
+		{
+			std::cout << "Batch lookup of " << keys[i] << " found " << myRec.i << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "Number of results: " << numFound / 2 << std::endl << std::endl;
+
+	return numFound / 2;
+}
+
+int reverseScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, const std::size_t batchSize)
+{
+	std::cout << "Descending scan of " << batchSize << " for " << lowVal << "," << highVal << std::endl;
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp, DESCENDING);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	// a batch size of 0 reads one entry at a time
+	std::vector<RecordId> rids(std::max<std::size_t>(batchSize, 1));
+	Page *curPage;
+	int numResults = 0;
+	int prevKey = highVal;
+	std::size_t n;
+	while (true)
+	{
+		if (batchSize == 0)
+		{
+			try
+			{
+				index->scanNext(rids[0]);
+				n = 1;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				break;
+			}
+		}
+		else if ((n = index->scanNextBatch(&rids[0], batchSize)) == 0)
+		{
+			break;
+		}
+
+		for (std::size_t i = 0; i < n; i++)
+		{
+			bufMgr->readPage(file1, rids[i].page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(rids[i]).data()));
+			bufMgr->unPinPage(file1, rids[i].page_number, false);
+			if (myRec.i > prevKey)
+			{
+				std::cout << "Out of order key " << myRec.i << " after " << prevKey << std::endl;
+				return -1;
+			}
+			prevKey = myRec.i;
+		}
+		numResults += n;
+	}
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// rankedEntries
+// Selects the entries at positions first to last - 1 and checks each against the
+// number of entries counted below and up to its key.
+// Returns the number of entries found, or -1 if one is out of place.
+// -----------------------------------------------------------------------------
+
+int rankedEntries(BTreeIndex *index, int first, int last)
+{
+	std::cout << "Select entries " << first << " to " << last - 1 << std::endl;
+	const int minKey = INT_MIN;
+	int numFound = 0;
+	for (int k = first; k < last; k++)
+	{
+		int key;
+		RecordId rid;
+		if (!index->selectKth(k, &key, rid))
+		{
+			continue;
+		}
+		const int below = index->countRange(&minKey, GTE, &key, LT);
+		const int upTo = index->countRange(&minKey, GTE, &key, LTE);
+		if (k < below || k >= upTo)
+		{
+			std::cout << "Entry " << k << " has key " << key << " with " << below << " to " << upTo << " entries before" << std::endl;
+			return -1;
+		}
+		numFound++;
+	}
+	std::cout << "Number of results: " << numFound << std::endl << std::endl;
+
+	return numFound;
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+	std::cout << "Create a B+ Tree index on the double field" << std::endl;
+	BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+
+	// run some tests
+	checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+	checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+	checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+	checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+	checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(doubleScan(&index, 24.5, GT, 25.5, LT), 1)
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	return countScanResults(index);
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+	std::cout << "Create a B+ Tree index on the string field" << std::endl;
+	BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+
+	// run some tests
+	checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+	checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+	checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+	checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+	checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	// keys are built the same way as the records of the relation
+	char lowValStr[64];
+	char highValStr[64];
+	sprintf(lowValStr, "%05d string record", lowVal);
+	sprintf(highValStr, "%05d string record", highVal);
+
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowValStr << "," << highValStr;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	try
+	{
+		index->startScan(lowValStr, lowOp, highValStr, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	return countScanResults(index);
+}
+
+// -----------------------------------------------------------------------------
+// countScanResults
+// Drains a started scan, printing the first few records, and ends it.
+// -----------------------------------------------------------------------------
+
+int countScanResults(BTreeIndex *index)
+{
+	RecordId scanRid;
+	Page *curPage;
+	int numResults = 0;
+
+	while (1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if (numResults < 5)
+			{
+				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+			}
+			else if (numResults == 5)
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+	if (numResults >= 5)
+	{
+		std::cout << "Number of results: " << numResults << std::endl;
+	}
+	index->endScan();
+	std::cout << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// coveringTests
+// -----------------------------------------------------------------------------
+
+void coveringTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field that includes the integer and double fields" << std::endl;
+	BTreeBuildOptions options;
+	IncludedAttr attr;
+	attr.attrByteOffset = offsetof(tuple, i);
+	attr.length = sizeof(int);
+	options.included.push_back(attr);
+	attr.attrByteOffset = offsetof(tuple, d);
+	attr.length = sizeof(double);
+	options.included.push_back(attr);
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(index.getIncludedSize(), (int)(sizeof(int) + sizeof(double)))
+		checkPassFail(coveringScan(&index, 25, 40, LTE, 0, ASCENDING), 16)
+		checkPassFail(coveringScan(&index, 0, relationSize, LTE, 100, ASCENDING), relationSize)
+		checkPassFail(coveringScan(&index, 3000, 3999, LTE, 64, DESCENDING), 1000)
+
+		// inserted entries take their included values from the record passed along
+		const int numInserts = 2000;
+		std::vector<RecordId> rids;
+		int lowVal = 0;
+		int highVal = numInserts;
+		index.startScan(&lowVal, GTE, &highVal, LT);
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				index.scanNext(scanRid);
+				rids.push_back(scanRid);
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+
+		RECORD record;
+		for (int i = 0; i < numInserts; i++)
+		{
+			record.i = relationSize + i;
+			record.d = record.i;
+			index.insertEntry(&record.i, rids[i], &record);
+		}
+		checkPassFail(coveringScan(&index, relationSize, relationSize + numInserts, LTE, 50, ASCENDING), numInserts)
+
+		// deletes move the included values along with their entries
+		for (int i = 0; i < numInserts; i += 2)
+		{
+			int key = relationSize + i;
+			index.deleteEntry(&key, rids[i], MERGE);
+		}
+		checkPassFail(coveringScan(&index, 0, relationSize + numInserts, LTE, 0, DESCENDING), relationSize + numInserts / 2)
+
+		// duplicates of the high key that span several leaves are all left out of a
+		// descending scan that excludes it, and all returned by one that includes it
+		const int numDuplicates = 1500;
+		RECORD duplicate;
+		for (int i = 0; i < 2 * numDuplicates; i++)
+		{
+			duplicate.i = relationSize + numInserts + 10 + i / numDuplicates;
+			duplicate.d = duplicate.i;
+			index.insertEntry(&duplicate.i, rids[i % numDuplicates], &duplicate);
+		}
+		const int firstKey = relationSize + numInserts + 10;
+		checkPassFail(coveringScan(&index, firstKey, firstKey + 1, LT, 0, DESCENDING), numDuplicates)
+		checkPassFail(coveringScan(&index, firstKey, firstKey + 1, LT, 100, DESCENDING), numDuplicates)
+		checkPassFail(coveringScan(&index, 0, firstKey + 1, LT, 100, DESCENDING), relationSize + numInserts / 2 + numDuplicates)
+		checkPassFail(coveringScan(&index, firstKey, firstKey, LTE, 64, DESCENDING), numDuplicates)
+		checkPassFail(coveringScan(&index, firstKey, firstKey + 1, LTE, 0, DESCENDING), 2 * numDuplicates)
+		checkPassFail(coveringScan(&index, firstKey, firstKey + 1, LT, 100, ASCENDING), numDuplicates)
+
+		int errors = 0;
+		try
+		{
+			index.insertEntry(&record.i, rids[0]);
+		}
+		catch (const BadIndexInfoException &e)
+		{
+			errors++;
+		}
+		checkPassFail(errors, 1)
+	}
+
+	// the included attributes are kept in the index file
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	checkPassFail(index.getIncludedSize(), (int)(sizeof(int) + sizeof(double)))
+	checkPassFail(coveringScan(&index, 1000, 1999, LTE, 128, ASCENDING), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// compositeTests
+// Keys of the (i, d) index are passed as an int followed by a double.
+// -----------------------------------------------------------------------------
+
+void compositeKey(char *key, int i, double d)
+{
+	memcpy(key, &i, sizeof(int));
+	memcpy(key + sizeof(int), &d, sizeof(double));
+}
+
+void compositeTests()
+{
+	std::cout << "Create a B+ Tree index on the integer and double fields" << std::endl;
+	std::vector<KeyColumn> columns(2);
+	columns[0].attrByteOffset = offsetof(tuple, i);
+	columns[0].type = INTEGER;
+	columns[1].attrByteOffset = offsetof(tuple, d);
+	columns[1].type = DOUBLE;
+	const int tenant = relationSize + 7;
+	const int numInserts = 500;
+	{
+		BTreeIndex index(relationName, compositeIndexName, bufMgr, columns);
+		char lowVal[sizeof(int) + sizeof(double)];
+		char highVal[sizeof(int) + sizeof(double)];
+		compositeKey(lowVal, 25, 25);
+		compositeKey(highVal, 40, 40);
+		checkPassFail((int)index.countRange(lowVal, GT, highVal, LT), 14)
+		compositeKey(highVal, 40, 39.5);
+		checkPassFail((int)index.countRange(lowVal, GTE, highVal, LTE), 15)
+		checkPassFail(prefixScan(&index, 25, ASCENDING), 1)
+
+		// one leading value with many entries, ordered by the second column.
+		// The slot of each record id gives its place in that order.
+		for (int t = numInserts - 1; t >= 0; t--)
+		{
+			char key[sizeof(int) + sizeof(double)];
+			compositeKey(key, tenant, t - numInserts / 2);
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = t + 1;
+			index.insertEntry(key, rid);
+		}
+		checkPassFail(prefixScan(&index, tenant, ASCENDING), numInserts)
+		checkPassFail(prefixScan(&index, tenant, DESCENDING), numInserts)
+		checkPassFail(prefixScan(&index, tenant + 1, ASCENDING), 0)
+		compositeKey(lowVal, tenant, -10);
+		compositeKey(highVal, tenant, 10);
+		checkPassFail((int)index.countRange(lowVal, GTE, highVal, LT), 20)
+
+		// keys come back in the form they are passed in
+		char key[sizeof(int) + sizeof(double)];
+		RecordId rid;
+		index.selectKth(relationSize, key, rid);
+		checkPassFail((memcmp(key, lowVal, sizeof(int)) == 0 && rid.slot_number == 1), true)
+	}
+
+	// the columns are kept in the index file, and have to fit in a key
+	BTreeIndex index(relationName, compositeIndexName, bufMgr, columns);
+	checkPassFail(prefixScan(&index, tenant, ASCENDING), numInserts)
+	int errors = 0;
+	columns.assign(3, columns[0]);
+	for (int i = 0; i < 3; i++)
+	{
+		columns[i].attrByteOffset = offsetof(tuple, s) + i * STRINGSIZE;
+		columns[i].type = STRING;
+	}
+	try
+	{
+		std::string name;
+		BTreeIndex tooWide(relationName, name, bufMgr, columns);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+	try
+	{
+		index.startPrefixScan(&tenant, 3);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+	checkPassFail(errors, 2)
+}
+
+int prefixScan(BTreeIndex *index, int tenant, const ScanOrder order)
+{
+	std::cout << "Prefix scan for " << tenant << std::endl;
+	int numResults = 0;
+	try
+	{
+		BTreeScanCursor cursor = index->openPrefixScan(&tenant, 1, order);
+		RecordId rid;
+		int prevSlot = order == ASCENDING ? 0 : INT_MAX;
+		while (1)
+		{
+			cursor.scanNext(rid);
+			if (tenant > relationSize && (order == ASCENDING ? rid.slot_number <= prevSlot : rid.slot_number >= prevSlot))
+			{
+				std::cout << "Entry " << rid.slot_number << " out of order after " << prevSlot << std::endl;
+				return -1;
+			}
+			prevSlot = rid.slot_number;
+			numResults++;
+		}
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+	return numResults;
+}
+
+int coveringScan(BTreeIndex *index, int lowVal, int highVal, const Operator highOp, const std::size_t batchSize, const ScanOrder order)
+{
+	std::cout << "Covering scan of " << batchSize << " for [" << lowVal << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+	try
+	{
+		index->startScan(&lowVal, GTE, &highVal, highOp, order);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	// a batch size of 0 reads one entry at a time. Keys are checked against the
+	// included values alone, the relation is never read.
+	const std::size_t size = index->getIncludedSize();
+	std::vector<RecordId> rids(std::max<std::size_t>(batchSize, 1));
+	std::vector<char> included(rids.size() * size);
+	int numResults = 0;
+	int prevKey = order == ASCENDING ? lowVal : highVal;
+	std::size_t n;
+	while (true)
+	{
+		if (batchSize == 0)
+		{
+			try
+			{
+				index->scanNext(rids[0], &included[0]);
+				n = 1;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				break;
+			}
+		}
+		else if ((n = index->scanNextBatch(&rids[0], batchSize, &included[0])) == 0)
+		{
+			break;
+		}
+
+		for (std::size_t i = 0; i < n; i++)
+		{
+			int key;
+			double d;
+			memcpy(&key, &included[i * size], sizeof(int));
+			memcpy(&d, &included[i * size + sizeof(int)], sizeof(double));
+			if (key < lowVal || key > highVal || (highOp == LT && key == highVal) || (order == ASCENDING ? key < prevKey : key > prevKey) || d != key)
+			{
+				std::cout << "Bad included values " << key << "," << d << " after " << prevKey << std::endl;
+				return -1;
+			}
+			prevKey = key;
+		}
+		numResults += n;
+	}
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// statisticsTests
+// -----------------------------------------------------------------------------
+
+void statisticsTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field and estimate ranges" << std::endl;
+	const int numInserts = 5000;
+	const int numDeletes = 1000;
+	const int lowest = INT_MIN;
+	const int highest = INT_MAX;
+	int numEntries;
+	int minKey;
+	int maxKey;
+	int firstKey;
+	int lastKey;
+	RecordId rid;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		numEntries = index.countRange(&lowest, GTE, &highest, LTE);
+		index.selectKth(0, &firstKey, rid);
+		index.selectKth(numEntries - 1, &lastKey, rid);
+		checkPassFail((int)index.getEntryCount(), numEntries)
+		checkPassFail(index.getKeyRange(&minKey, &maxKey), true)
+		checkPassFail(minKey, firstKey)
+		checkPassFail(maxKey, lastKey)
+		checkPassFail((std::abs(index.estimateDistinctKeys() - numEntries) < numEntries * 0.05), true)
+		checkPassFail((estimateError(&index, 1000, 1999) <= 20), true)
+		checkPassFail((estimateError(&index, 10, 10) <= 1), true)
+
+		std::vector<RecordId> rids;
+		for (int key = 0; key < numDeletes; key++)
+		{
+			index.lookup(&key, rid);
+			rids.push_back(rid);
+		}
+
+		// keys inserted past the largest one thin out as they go, so the last bucket is split
+		// as it grows, or it would spread them evenly
+		for (int i = 0; i < numInserts; i++)
+		{
+			int key = relationSize + i * i / 1000;
+			index.insertEntry(&key, rids[i % numDeletes]);
+		}
+		numEntries += numInserts;
+		checkPassFail((int)index.getEntryCount(), numEntries)
+		index.getKeyRange(&minKey, &maxKey);
+		checkPassFail(maxKey, relationSize + (numInserts - 1) * (numInserts - 1) / 1000)
+		checkPassFail((estimateError(&index, relationSize, 2 * relationSize) <= 30), true)
+		checkPassFail((estimateError(&index, 2 * relationSize, 4 * relationSize) <= 30), true)
+		checkPassFail((estimateError(&index, 0, relationSize - 1) <= 30), true)
+
+		for (int key = 0; key < numDeletes; key++)
+		{
+			numEntries -= index.deleteEntry(&key, rids[key], MERGE);
+		}
+		checkPassFail((int)index.getEntryCount(), numEntries)
+		checkPassFail((estimateError(&index, 0, 2 * numDeletes) <= 30), true)
+	}
+
+	// the statistics are kept in the index file. The key range shrinks back on a refresh.
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail((int)index.getEntryCount(), numEntries)
+		index.getKeyRange(&minKey, &maxKey);
+		checkPassFail(minKey, firstKey)
+		index.refreshStatistics();
+		checkPassFail((int)index.getEntryCount(), numEntries)
+		index.getKeyRange(&minKey, &maxKey);
+		index.selectKth(0, &firstKey, rid);
+		checkPassFail(minKey, firstKey)
+		checkPassFail((estimateError(&index, relationSize, 2 * relationSize) <= 20), true)
+		checkPassFail((estimateError(&index, -100, numDeletes + 100) <= 20), true)
+
+		int errors = 0;
+		try
+		{
+			index.estimateRange(&minKey, LT, &maxKey, LTE);
+		}
+		catch (const BadOpcodesException &e)
+		{
+			errors++;
+		}
+		try
+		{
+			index.estimateRange(&maxKey, GTE, &minKey, LTE);
+		}
+		catch (const BadScanrangeException &e)
+		{
+			errors++;
+		}
+		checkPassFail(errors, 2)
+	}
+
+	// an index whose header points past the end of its file is not opened
+	{
+		BlobFile indexFile(intIndexName, false);
+		Page headerPage = indexFile.readPage(1);
+		reinterpret_cast<IndexMetaInfo *>(&headerPage)->statsPageNo = indexFile.getEndPageNo();
+		indexFile.writePage(1, headerPage);
+	}
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(true, false)
+	}
+	catch (const BadIndexInfoException &e)
+	{
+	}
+}
+
+void verifyTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field and verify it" << std::endl;
+	const int numInserts = 5000;
+	const int numDeletes = 1000;
+	const int lowest = INT_MIN;
+	const int highest = INT_MAX;
+	RecordId rid;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(verifyClean(&index, 1), true)
+
+		// grow the index past its bulk built leaves, and merge some of them away again
+		std::vector<RecordId> rids;
+		for (int key = 0; key < numDeletes; key++)
+		{
+			index.lookup(&key, rid);
+			rids.push_back(rid);
+		}
+		for (int i = 0; i < numInserts; i++)
+		{
+			int key = (i * 7919) % relationSize;
+			index.insertEntry(&key, rids[i % numDeletes]);
+		}
+		for (int key = 0; key < numDeletes; key++)
+		{
+			index.deleteEntry(&key, rids[key], key % 2 == 0 ? MERGE : LAZY);
+		}
+		checkPassFail(verifyClean(&index, 1), true)
+		checkPassFail(verifyClean(&index, 4), true)
+		IndexVerifyReport report = index.verifyIndex(4, 1);
+		checkPassFail(report.numEntries, index.countRange(&lowest, GTE, &highest, LTE))
+		checkPassFail(report.height, 2)
+	}
+
+	// swap the first and last key of the second leaf, and point the first leaf past it
+	PageId firstLeafNo;
+	PageId secondLeafNo;
+	{
+		BlobFile indexFile(intIndexName, false);
+		Page headerPage = indexFile.readPage(1);
+		Page rootPage = indexFile.readPage(reinterpret_cast<IndexMetaInfo *>(&headerPage)->rootPageNo);
+		NonLeafNodeInt *root = reinterpret_cast<NonLeafNodeInt *>(&rootPage);
+		firstLeafNo = root->pageNoArray[0];
+		secondLeafNo = root->pageNoArray[1];
+
+		Page firstPage = indexFile.readPage(firstLeafNo);
+		reinterpret_cast<LeafNodeInt *>(&firstPage)->rightSibPageNo = root->pageNoArray[2];
+		indexFile.writePage(firstLeafNo, firstPage);
+		Page secondPage = indexFile.readPage(secondLeafNo);
+		LeafNodeInt *second = reinterpret_cast<LeafNodeInt *>(&secondPage);
+		std::swap(second->keyArray[0], second->keyArray[second->numKeys - 1]);
+		indexFile.writePage(secondLeafNo, secondPage);
+	}
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		IndexVerifyReport report = index.verifyIndex();
+		for (std::size_t i = 0; i < report.errors.size(); i++)
+		{
+			std::cout << report.errors[i] << std::endl;
+		}
+		checkPassFail(report.errors.size(), 2)
+		std::ostringstream firstLeaf;
+		std::ostringstream secondLeaf;
+		firstLeaf << "page " << firstLeafNo << ": has right sibling";
+		secondLeaf << "page " << secondLeafNo << ": has keys out of order";
+		checkPassFail((report.errors[0].compare(0, firstLeaf.str().size(), firstLeaf.str()) == 0 ||
+					   report.errors[1].compare(0, firstLeaf.str().size(), firstLeaf.str()) == 0), true)
+		checkPassFail((report.errors[0].compare(0, secondLeaf.str().size(), secondLeaf.str()) == 0 ||
+					   report.errors[1].compare(0, secondLeaf.str().size(), secondLeaf.str()) == 0), true)
+	}
+	File::remove(intIndexName);
+
+	// the left siblings of an index that has never been written concurrently are checked exactly,
+	// even once its entry counts are no longer kept
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	}
+	{
+		BlobFile indexFile(intIndexName, false);
+		Page headerPage = indexFile.readPage(1);
+		IndexMetaInfo *header = reinterpret_cast<IndexMetaInfo *>(&headerPage);
+		header->countsValid = 0;
+		indexFile.writePage(1, headerPage);
+		Page rootPage = indexFile.readPage(header->rootPageNo);
+		NonLeafNodeInt *root = reinterpret_cast<NonLeafNodeInt *>(&rootPage);
+		Page secondPage = indexFile.readPage(root->pageNoArray[1]);
+		reinterpret_cast<LeafNodeInt *>(&secondPage)->leftSibPageNo = root->pageNoArray[2];
+		indexFile.writePage(root->pageNoArray[1], secondPage);
+	}
+	checkPassFail(verifyTool(intIndexName), 1)
+	File::remove(intIndexName);
+
+	// concurrent inserts are remembered once the index is opened without them
+	BTreeBuildOptions options;
+	options.concurrent = true;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		for (int i = 0; i < numInserts; i++)
+		{
+			int key = (i * 7919) % relationSize;
+			index.insertEntry(&key, rid);
+		}
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(verifyClean(&index, 4), true)
+	}
+	checkPassFail(verifyTool(intIndexName), 0)
+	{
+		BlobFile indexFile(intIndexName, false);
+		Page headerPage = indexFile.readPage(1);
+		checkPassFail(reinterpret_cast<IndexMetaInfo *>(&headerPage)->writtenConcurrently, 1)
+	}
+}
+
+// -----------------------------------------------------------------------------
+// packedTests
+// -----------------------------------------------------------------------------
+
+void packedTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field with bit packed leaves" << std::endl;
+	const int numDeletes = 2000;
+	const int numInserts = 3000;
+	const int lowest = INT_MIN;
+	const int highest = INT_MAX;
+	std::uint64_t plainLeaves;
+	{
+		BTreeIndex plain(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		plainLeaves = plain.verifyIndex().numLeafPages;
+	}
+	File::remove(intIndexName);
+
+	BTreeBuildOptions options;
+	options.packedLeaves = true;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(verifyClean(&index, 1), true)
+		checkPassFail((index.verifyIndex().numLeafPages < plainLeaves), true)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize)
+		checkPassFail(reverseScan(&index, -1, GT, relationSize, LT, 64), relationSize)
+		checkPassFail(batchScan(&index, 1000, GTE, 3000, LT, 100), 2000)
+		checkPassFail(pointLookups(&index, 0, relationSize), relationSize)
+		checkPassFail(batchLookups(&index, 0, relationSize), relationSize)
+		checkPassFail(rankedEntries(&index, 0, 200), 200)
+
+		// lazy deletes take the entries out of packed leaves right away
+		std::vector<RecordId> rids;
+		for (int key = 0; key < numDeletes; key++)
+		{
+			RecordId rid;
+			index.lookup(&key, rid);
+			rids.push_back(rid);
+		}
+		int deleted = 0;
+		for (int key = 0; key < numDeletes; key++)
+		{
+			deleted += index.deleteEntry(&key, rids[key], key % 2 == 0 ? MERGE : LAZY);
+		}
+		checkPassFail(deleted, numDeletes)
+		checkPassFail(pointLookups(&index, 0, numDeletes), 0)
+		checkPassFail(verifyClean(&index, 1), true)
+
+		// keys and record ids far apart pack wide, so the leaves split before they are full.
+		// They point nowhere, and stay below the keys of the relation.
+		for (int i = 0; i < numInserts; i++)
+		{
+			int key = -1 - i * 700001;
+			RecordId rid;
+			rid.page_number = 1 + i * 100003;
+			rid.slot_number = 1 + i % 60000;
+			index.insertEntry(&key, rid);
+		}
+		checkPassFail(index.countRange(&lowest, GTE, &highest, LTE), std::size_t(relationSize - numDeletes + numInserts))
+		checkPassFail(verifyClean(&index, 4), true)
+		int found = 0;
+		for (int i = 0; i < numInserts; i++)
+		{
+			int key = -1 - i * 700001;
+			RecordId rid;
+			found += index.lookup(&key, rid) && rid.page_number == PageId(1 + i * 100003) && rid.slot_number == 1 + i % 60000;
+		}
+		checkPassFail(found, numInserts)
+	}
+
+	// the leaf format is kept in the index file
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(pointLookups(&index, 0, relationSize), relationSize - numDeletes)
+		checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize - numDeletes)
+		checkPassFail(reverseScan(&index, -1, GT, relationSize, LT, 64), relationSize - numDeletes)
+	}
+
+	// only plain integer indexes pack their leaves
+	File::remove(intIndexName);
+	int errors = 0;
+	try
+	{
+		std::string name;
+		BTreeIndex doubles(relationName, name, bufMgr, offsetof(tuple, d), DOUBLE, options);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+	options.concurrent = true;
+	try
+	{
+		BTreeIndex concurrent(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+	checkPassFail(errors, 2)
+}
+
+// -----------------------------------------------------------------------------
+// verifyClean
+// Verifies the index on numThreads threads and prints what was checked.
+// Returns whether no problem was found.
+// -----------------------------------------------------------------------------
+
+bool verifyClean(BTreeIndex *index, const int numThreads)
+{
+	const IndexVerifyReport report = index->verifyIndex(numThreads);
+	std::cout << "Verified " << report.numNonLeafPages << " non-leaf, " << report.numLeafPages << " leaf and "
+			  << report.numPostingPages << " posting list pages holding " << report.numEntries << " entries on "
+			  << numThreads << " threads, " << report.errors.size() << " problems" << std::endl;
+	for (std::size_t i = 0; i < report.errors.size(); i++)
+	{
+		std::cout << report.errors[i] << std::endl;
+	}
+	return report.ok();
+}
+
+// -----------------------------------------------------------------------------
+// verifyTool
+// Runs verify_index on the closed index file, which it must not change.
+// Returns the exit status of the tool, or -1 if the file was written to.
+// -----------------------------------------------------------------------------
+
+std::string fileBytes(const std::string &fileName)
+{
+	std::ifstream in(fileName.c_str(), std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int verifyTool(const std::string &indexName)
+{
+	const std::string before = fileBytes(indexName);
+	const int status = std::system(("./verify_index " + indexName).c_str());
+	if (fileBytes(indexName) != before)
+	{
+		return -1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// -----------------------------------------------------------------------------
+// estimateError
+// Estimates the entries in [lowVal, highVal] and counts them.
+// Returns the difference in tenths of a percent of all the entries, rounded up.
+// -----------------------------------------------------------------------------
+
+int estimateError(BTreeIndex *index, int lowVal, int highVal)
+{
+	const double estimate = index->estimateRange(&lowVal, GTE, &highVal, LTE);
+	const std::size_t count = index->countRange(&lowVal, GTE, &highVal, LTE);
+	const int error = static_cast<int>(std::ceil(std::abs(estimate - count) * 1000 / index->getEntryCount()));
+	std::cout << "Estimated " << estimate << " entries in [" << lowVal << "," << highVal << "], counted " << count
+			  << ", off by " << error / 10.0 << "%" << std::endl;
+	return error;
+}
+
+// -----------------------------------------------------------------------------
+// fileErrorTests
+// -----------------------------------------------------------------------------
+
+void fileErrorTests()
+{
+	// the sorter spills a run every four items
+	std::cout << "Spill a sort run that cannot be written" << std::endl;
+	try
+	{
+		ExternalSorter<int> sorter(relationName + ".missing/sort", 4 * sizeof(int));
+		for (int i = 0; i < 10; i++)
+		{
+			sorter.add(i);
+		}
+		std::cout << "SortRunException Test 1 Failed." << std::endl;
+	}
+	catch (const SortRunException &e)
+	{
+		std::cout << "SortRunException Test 1 Passed." << std::endl;
+	}
+
+	std::cout << "Merge a sort run that was cut short" << std::endl;
+	try
+	{
+		const std::string sortName = relationName + ".sort";
+		ExternalSorter<int> sorter(sortName, 4 * sizeof(int));
+		for (int i = 0; i < 10; i++)
+		{
+			sorter.add(10 - i);
+		}
+		std::ofstream truncate((sortName + ".run0").c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		truncate.close();
+		sorter.finish();
+		int item;
+		while (sorter.next(item))
+		{
+		}
+		std::cout << "SortRunException Test 2 Failed." << std::endl;
+	}
+	catch (const SortRunException &e)
+	{
+		std::cout << "SortRunException Test 2 Passed." << std::endl;
+	}
+
+	// the file stream is usable again after the failed read, and the next page goes right after the header
+	std::cout << "Read a page before the first page of a file" << std::endl;
+	{
+		const std::string blobName = relationName + ".blob";
+		BlobFile *blobFile = new BlobFile(blobName, true);
+		Page *page;
+		PageId pageNo;
+		try
+		{
+			bufMgr->readPage(blobFile, 0, page);
+			std::cout << "InvalidPageException Test 1 Failed." << std::endl;
+		}
+		catch (const InvalidPageException &e)
+		{
+			bufMgr->allocPage(blobFile, pageNo, page);
+			bufMgr->unPinPage(blobFile, pageNo, false);
+			std::cout << "InvalidPageException Test 1 " << (pageNo == 1 ? "Passed." : "Failed.") << std::endl;
+		}
+		bufMgr->flushFile(blobFile);
+		delete blobFile;
+		removeIndex(blobName);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// errorTests
+// -----------------------------------------------------------------------------
+
+void errorTests()
+{
+	{
+		std::cout << "Error handling tests" << std::endl;
+		std::cout << "--------------------" << std::endl;
+		// Given error test
+
+		try
+		{
+			File::remove(relationName);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+
+		file1 = new PageFile(relationName, true);
+
+		// initialize all of record1.s to keep purify happy
+		memset(record1.s, ' ', sizeof(record1.s));
+		PageId new_page_number;
+		Page new_page = file1->allocatePage(new_page_number);
+
+		// Insert a bunch of tuples into the relation.
+		for (int i = 0; i < 10; i++)
+		{
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+			while (1)
+			{
+				try
+				{
+					new_page.insertRecord(new_data);
+					break;
+				}
+				catch (const InsufficientSpaceException &e)
+				{
+					file1->writePage(new_page_number, new_page);
+					new_page = file1->allocatePage(new_page_number);
+				}
+			}
+		}
+
+		file1->writePage(new_page_number, new_page);
+
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+		int int2 = 2;
+		int int5 = 5;
+
+		// Scan Tests
+		std::cout << "Call endScan before startScan" << std::endl;
+		try
+		{
+			index.endScan();
+			std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+		}
+		catch (const ScanNotInitializedException &e)
+		{
+			std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+		}
+
+		std::cout << "Call scanNext before startScan" << std::endl;
+		try
+		{
+			RecordId foo;
+			index.scanNext(foo);
+			std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+		}
+		catch (const ScanNotInitializedException &e)
+		{
+			std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad lowOp" << std::endl;
+		try
+		{
+			index.startScan(&int2, LTE, &int5, LTE);
+			std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+		}
+		catch (const BadOpcodesException &e)
+		{
+			std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad highOp" << std::endl;
+		try
+		{
+			index.startScan(&int2, GTE, &int5, GTE);
+			std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+		}
+		catch (const BadOpcodesException &e)
+		{
+			std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad range" << std::endl;
+		try
+		{
+			index.startScan(&int5, GTE, &int2, LTE);
+			std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+		}
+		catch (const BadScanrangeException &e)
+		{
+			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+		}
+
+		deleteRelation();
+	}
+
+	removeIndex(intIndexName);
+}
+
+void deleteRelation()
 {
 	if (file1)
 	{
@@ -589,3 +2363,19 @@ void deleteRelation()
 	{
 	}
 }
+
+// -----------------------------------------------------------------------------
+// removeIndex
+// Removes the file of an index the tests built, if there is one.
+// -----------------------------------------------------------------------------
+
+void removeIndex(const std::string &indexName)
+{
+	try
+	{
+		File::remove(indexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+}
@@ -0,0 +1,136 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page numbers of the buffer pool frames of a few B+Tree nodes that are
+ * kept pinned for as long as the index is open, so that descents can read them
+ * without going through the buffer manager.
+ *
+ * Since the frames are the buffer pool's own, writes made through the buffer
+ * manager show up here too and nothing has to be invalidated. Pages are only
+ * ever added, by one thread at a time, and find() can run concurrently with
+ * add() without locking.
+ */
+class NodeCache
+{
+ public:
+  /**
+   * Constructor of NodeCache class
+   *
+   * @param maxPages   Most pages the cache will hold
+   */
+	explicit NodeCache(const std::uint32_t maxPages)
+		: maxPages_(maxPages),
+			numPages_(0)
+	{
+		mask_ = 1;
+		while (mask_ < 2 * maxPages)
+		{
+			mask_ <<= 1;
+		}
+		slots_.reset(new Slot[mask_]);
+		mask_--;
+	}
+
+  /**
+   * Frame of pageNo, or NULL if it is not cached.
+   */
+	Page* find(const PageId pageNo) const
+	{
+		for (std::uint32_t i = hash(pageNo);; i = (i + 1) & mask_)
+		{
+			const PageId slotPageNo = slots_[i].pageNo.load(std::memory_order_acquire);
+			if (slotPageNo == pageNo)
+			{
+				return slots_[i].page;
+			}
+			if (slotPageNo == Page::INVALID_NUMBER)
+			{
+				return NULL;
+			}
+		}
+	}
+
+  /**
+   * Remember the frame of pageNo, which the caller has pinned on behalf of the cache.
+   *
+   * @return false if the cache is full, in which case the caller keeps its pin
+   */
+	bool add(const PageId pageNo, Page* page)
+	{
+		if (numPages_ == maxPages_)
+		{
+			return false;
+		}
+		std::uint32_t i = hash(pageNo);
+		while (slots_[i].pageNo.load(std::memory_order_relaxed) != Page::INVALID_NUMBER)
+		{
+			i = (i + 1) & mask_;
+		}
+		slots_[i].page = page;
+		slots_[i].pageNo.store(pageNo, std::memory_order_release);
+		numPages_++;
+		return true;
+	}
+
+  /**
+   * Number of pages cached.
+   */
+	std::uint32_t size() const
+	{
+		return numPages_;
+	}
+
+  /**
+   * Page numbers of all cached pages, for unpinning them.
+   */
+	std::vector<PageId> pageNos() const
+	{
+		std::vector<PageId> result;
+		for (std::uint32_t i = 0; i <= mask_; i++)
+		{
+			const PageId pageNo = slots_[i].pageNo.load(std::memory_order_relaxed);
+			if (pageNo != Page::INVALID_NUMBER)
+			{
+				result.push_back(pageNo);
+			}
+		}
+		return result;
+	}
+
+ private:
+	struct Slot
+	{
+		std::atomic<PageId> pageNo;
+		Page* page;
+
+		Slot() : pageNo(Page::INVALID_NUMBER), page(NULL) {}
+	};
+
+	std::uint32_t hash(const PageId pageNo) const
+	{
+		return (pageNo * 2654435761u) & mask_;
+	}
+
+	std::uint32_t maxPages_;
+	std::uint32_t numPages_;
+	std::uint32_t mask_;
+	std::unique_ptr<Slot[]> slots_;
+};
+
+}
@@ -0,0 +1,246 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "node_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NODESEARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace badgerdb {
+
+// -----------------------------------------------------------------------------
+// Scalar kernels, used when no vector unit is available
+// -----------------------------------------------------------------------------
+
+template <class T>
+static int countLessScalar(const T* keys, const int numKeys, const T key)
+{
+	int count = 0;
+	for (int i = 0; i < numKeys; i++)
+	{
+		count += keys[i] < key;
+	}
+	return count;
+}
+
+template <class T>
+static int countLessEqualScalar(const T* keys, const int numKeys, const T key)
+{
+	int count = 0;
+	for (int i = 0; i < numKeys; i++)
+	{
+		count += !(key < keys[i]);
+	}
+	return count;
+}
+
+#ifdef NODESEARCH_X86
+
+// -----------------------------------------------------------------------------
+// SSE2 kernels. Compare a vector of keys at a time and count the set lanes of
+// the movemask.
+// -----------------------------------------------------------------------------
+
+__attribute__((target("sse2")))
+static int countLessIntSSE2(const int* keys, const int numKeys, const int key)
+{
+	const __m128i k = _mm_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= numKeys; i += 4)
+	{
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, d))));
+	}
+	return count + countLessScalar<int>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("sse2")))
+static int countLessEqualIntSSE2(const int* keys, const int numKeys, const int key)
+{
+	// keys <= key are the ones that are not greater
+	const __m128i k = _mm_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= numKeys; i += 4)
+	{
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		count += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(d, k))));
+	}
+	return count + countLessEqualScalar<int>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("sse2")))
+static int countLessDoubleSSE2(const double* keys, const int numKeys, const double key)
+{
+	const __m128d k = _mm_set1_pd(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 2 <= numKeys; i += 2)
+	{
+		const __m128d d = _mm_loadu_pd(keys + i);
+		count += __builtin_popcount(_mm_movemask_pd(_mm_cmplt_pd(d, k)));
+	}
+	return count + countLessScalar<double>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("sse2")))
+static int countLessEqualDoubleSSE2(const double* keys, const int numKeys, const double key)
+{
+	const __m128d k = _mm_set1_pd(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 2 <= numKeys; i += 2)
+	{
+		const __m128d d = _mm_loadu_pd(keys + i);
+		count += 2 - __builtin_popcount(_mm_movemask_pd(_mm_cmplt_pd(k, d)));
+	}
+	return count + countLessEqualScalar<double>(keys + i, numKeys - i, key);
+}
+
+// -----------------------------------------------------------------------------
+// AVX2 / AVX kernels, twice as wide
+// -----------------------------------------------------------------------------
+
+__attribute__((target("avx2,popcnt")))
+static int countLessIntAVX2(const int* keys, const int numKeys, const int key)
+{
+	const __m256i k = _mm256_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= numKeys; i += 8)
+	{
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, d))));
+	}
+	return count + countLessScalar<int>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int countLessEqualIntAVX2(const int* keys, const int numKeys, const int key)
+{
+	const __m256i k = _mm256_set1_epi32(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= numKeys; i += 8)
+	{
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		count += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(d, k))));
+	}
+	return count + countLessEqualScalar<int>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("avx,popcnt")))
+static int countLessDoubleAVX(const double* keys, const int numKeys, const double key)
+{
+	const __m256d k = _mm256_set1_pd(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= numKeys; i += 4)
+	{
+		const __m256d d = _mm256_loadu_pd(keys + i);
+		count += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(d, k, _CMP_LT_OQ)));
+	}
+	return count + countLessScalar<double>(keys + i, numKeys - i, key);
+}
+
+__attribute__((target("avx,popcnt")))
+static int countLessEqualDoubleAVX(const double* keys, const int numKeys, const double key)
+{
+	const __m256d k = _mm256_set1_pd(key);
+	int count = 0;
+	int i = 0;
+	for (; i + 4 <= numKeys; i += 4)
+	{
+		const __m256d d = _mm256_loadu_pd(keys + i);
+		count += 4 - __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(k, d, _CMP_LT_OQ)));
+	}
+	return count + countLessEqualScalar<double>(keys + i, numKeys - i, key);
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Runtime dispatch. The kernels are picked once, on the first search, by the
+// initializer of a function-local static, which is safe when several threads
+// search first at the same time.
+// -----------------------------------------------------------------------------
+
+typedef int (*CountIntFn)(const int*, const int, const int);
+typedef int (*CountDoubleFn)(const double*, const int, const double);
+
+struct SearchKernels
+{
+	CountIntFn countLessInt;
+	CountIntFn countLessEqualInt;
+	CountDoubleFn countLessDouble;
+	CountDoubleFn countLessEqualDouble;
+
+	SearchKernels()
+		: countLessInt( countLessScalar<int> ), countLessEqualInt( countLessEqualScalar<int> ),
+			countLessDouble( countLessScalar<double> ), countLessEqualDouble( countLessEqualScalar<double> )
+	{
+#ifdef NODESEARCH_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2"))
+		{
+			countLessInt = countLessIntSSE2;
+			countLessEqualInt = countLessEqualIntSSE2;
+			countLessDouble = countLessDoubleSSE2;
+			countLessEqualDouble = countLessEqualDoubleSSE2;
+		}
+		if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("popcnt"))
+		{
+			countLessDouble = countLessDoubleAVX;
+			countLessEqualDouble = countLessEqualDoubleAVX;
+		}
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+		{
+			countLessInt = countLessIntAVX2;
+			countLessEqualInt = countLessEqualIntAVX2;
+		}
+#endif
+	}
+};
+
+static const SearchKernels &kernels()
+{
+	static const SearchKernels selected;
+	return selected;
+}
+
+// -----------------------------------------------------------------------------
+// Specializations used by the B+Tree
+// -----------------------------------------------------------------------------
+
+template <>
+int countLess<int>(const int* keys, const int numKeys, const int& key)
+{
+	return kernels().countLessInt(keys, numKeys, key);
+}
+
+template <>
+int countLessEqual<int>(const int* keys, const int numKeys, const int& key)
+{
+	return kernels().countLessEqualInt(keys, numKeys, key);
+}
+
+template <>
+int countLess<double>(const double* keys, const int numKeys, const double& key)
+{
+	return kernels().countLessDouble(keys, numKeys, key);
+}
+
+template <>
+int countLessEqual<double>(const double* keys, const int numKeys, const double& key)
+{
+	return kernels().countLessEqualDouble(keys, numKeys, key);
+}
+
+}
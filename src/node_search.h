@@ -0,0 +1,126 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+namespace badgerdb {
+
+/**
+ * @brief Size, in bytes, of the tail of a search that is finished by comparing
+ * against every key instead of halving further. Two cache lines.
+ */
+const int NODESEARCH_WINDOWBYTES = 128;
+
+/**
+ * @brief Count the keys in keys[0, numKeys) that are less than key.
+ * The keys have to be sorted, so this is also the position of the first key
+ * that is not less than key. Specialized with SIMD kernels for int and double.
+ * STRING keys go through the generic loop, on the two normalized integers of
+ * StringKey, which measured faster than comparing each key as one 80-bit
+ * integer. DOUBLE keys are compared as the doubles they are rather than
+ * mapped to integers: the order-preserving integer form would put -0.0 below
+ * 0.0, which changes the entries a scan bound of 0.0 matches.
+ *
+ * @param keys      Sorted key array
+ * @param numKeys   Number of keys in use
+ * @param key       Key to compare against
+ * @return  Number of keys less than key
+ */
+template <class T>
+int countLess(const T* keys, const int numKeys, const T& key)
+{
+	int count = 0;
+	for (int i = 0; i < numKeys; i++)
+	{
+		count += keys[i] < key;
+	}
+	return count;
+}
+
+/**
+ * @brief Count the keys in keys[0, numKeys) that are less than or equal to key.
+ * Specialized with SIMD kernels for int and double. Every kernel counts the keys
+ * that key is not less than, as the search in nodeUpperBound does, so that a
+ * DOUBLE NaN compares the same whichever kernel the CPU gets.
+ *
+ * @param keys      Sorted key array
+ * @param numKeys   Number of keys in use
+ * @param key       Key to compare against
+ * @return  Number of keys less than or equal to key
+ */
+template <class T>
+int countLessEqual(const T* keys, const int numKeys, const T& key)
+{
+	int count = 0;
+	for (int i = 0; i < numKeys; i++)
+	{
+		count += !(key < keys[i]);
+	}
+	return count;
+}
+
+template <>
+int countLess<int>(const int* keys, const int numKeys, const int& key);
+
+template <>
+int countLessEqual<int>(const int* keys, const int numKeys, const int& key);
+
+template <>
+int countLess<double>(const double* keys, const int numKeys, const double& key);
+
+template <>
+int countLessEqual<double>(const double* keys, const int numKeys, const double& key);
+
+/**
+ * @brief Position of the first key in keys[0, numKeys) that is not less than key.
+ * Branchless binary search down to NODESEARCH_WINDOWBYTES of keys, which are
+ * then compared all at once by countLess.
+ *
+ * @param keys      Sorted key array
+ * @param numKeys   Number of keys in use
+ * @param key       Key to search for
+ * @return  Index in [0, numKeys]
+ */
+template <class T>
+int nodeLowerBound(const T* keys, const int numKeys, const T& key)
+{
+	const int window = sizeof(T) < NODESEARCH_WINDOWBYTES ? NODESEARCH_WINDOWBYTES / sizeof(T) : 1;
+	const T* base = keys;
+	int len = numKeys;
+	while (len > window)
+	{
+		const int half = len / 2;
+		base += (base[half - 1] < key) ? half : 0;
+		len -= half;
+	}
+	return (base - keys) + countLess<T>(base, len, key);
+}
+
+/**
+ * @brief Position of the first key in keys[0, numKeys) that is greater than key.
+ *
+ * @param keys      Sorted key array
+ * @param numKeys   Number of keys in use
+ * @param key       Key to search for
+ * @return  Index in [0, numKeys]
+ */
+template <class T>
+int nodeUpperBound(const T* keys, const int numKeys, const T& key)
+{
+	const int window = sizeof(T) < NODESEARCH_WINDOWBYTES ? NODESEARCH_WINDOWBYTES / sizeof(T) : 1;
+	const T* base = keys;
+	int len = numKeys;
+	while (len > window)
+	{
+		const int half = len / 2;
+		base += !(key < base[half - 1]) ? half : 0;
+		len -= half;
+	}
+	return (base - keys) + countLessEqual<T>(base, len, key);
+}
+
+}
@@ -0,0 +1,240 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Number of latches in a chunk of an OptimisticLatchTable, for consecutive pages. A power of two.
+ */
+const std::uint32_t LATCHTABLE_SIZE = 4096;
+
+/**
+ * @brief Number of entries in each of the two directory levels of an OptimisticLatchTable, which
+ * together with the chunks cover every PageId.
+ */
+const std::uint32_t LATCHTABLE_FANOUT = 1024;
+
+/**
+ * @brief Number of times a latch is polled before waiting threads start yielding.
+ */
+const int LATCH_SPINS = 64;
+
+/**
+ * @brief Version counter used for optimistic lock coupling.
+ *
+ * Readers remember the version before reading a node and check it afterwards,
+ * retrying when it changed. They never write to the latch. Writers lock the
+ * latch by setting the low bit of the version and bump the version when they
+ * unlock, which invalidates every read that overlapped the write.
+ */
+class OptimisticLatch
+{
+ public:
+	OptimisticLatch()
+		: version_(0)
+	{
+	}
+
+  /**
+   * Wait until no writer holds the latch and return the version to validate reads against.
+   */
+	std::uint64_t readLock() const
+	{
+		std::uint64_t v = version_.load(std::memory_order_acquire);
+		for (int spins = 0; v & 1; spins++)
+		{
+			// writers may hold the latch across page I/O, give up the cpu when it takes long
+			if (spins < LATCH_SPINS)
+			{
+#if defined(__x86_64__) || defined(__i386__)
+				__builtin_ia32_pause();
+#endif
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+			v = version_.load(std::memory_order_acquire);
+		}
+		return v;
+	}
+
+  /**
+   * Check that nothing was written since readLock() returned version.
+   *
+   * @return false if the reads made under version have to be thrown away
+   */
+	bool validate(const std::uint64_t version) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return version_.load(std::memory_order_relaxed) == version;
+	}
+
+  /**
+   * Turn a read under version into an exclusive latch.
+   *
+   * @return false if a writer got there first, in which case nothing is latched
+   */
+	bool upgradeToWriteLock(const std::uint64_t version)
+	{
+		std::uint64_t expected = version;
+		return version_.compare_exchange_strong(expected, version + 1, std::memory_order_acquire);
+	}
+
+  /**
+   * Wait for and take an exclusive latch.
+   */
+	void writeLock()
+	{
+		while (!upgradeToWriteLock(readLock()))
+		{
+		}
+	}
+
+  /**
+   * Release an exclusive latch, publishing a new version.
+   */
+	void writeUnlock()
+	{
+		version_.fetch_add(1, std::memory_order_release);
+	}
+
+  /**
+   * Release an exclusive latch under which nothing was written. Reads that
+   * overlapped it stay valid.
+   */
+	void writeUnlockUnchanged()
+	{
+		version_.fetch_sub(1, std::memory_order_release);
+	}
+
+ private:
+	std::atomic<std::uint64_t> version_;
+};
+
+/**
+ * @brief OptimisticLatch objects of every page, one latch a page.
+ *
+ * Latches live outside the pages so that they survive pages being evicted from
+ * and read back into the buffer pool. Every page has a latch of its own, so that
+ * a thread holding the latch of one page can always take that of another.
+ * Latches are made in chunks of LATCHTABLE_SIZE consecutive pages the first time
+ * one of them is latched, and found through two directory levels without taking
+ * any lock. Latches are spaced a cache line apart so that no two share one.
+ */
+class OptimisticLatchTable
+{
+ public:
+	OptimisticLatchTable()
+	{
+		for (std::uint32_t i = 0; i < LATCHTABLE_FANOUT; i++)
+		{
+			directory_[i].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+	~OptimisticLatchTable()
+	{
+		for (std::uint32_t i = 0; i < LATCHTABLE_FANOUT; i++)
+		{
+			ChunkDirectory *chunks = directory_[i].load(std::memory_order_relaxed);
+			if (chunks != NULL)
+			{
+				for (std::uint32_t j = 0; j < LATCHTABLE_FANOUT; j++)
+				{
+					delete[] chunks->chunks[j].load(std::memory_order_relaxed);
+				}
+				delete chunks;
+			}
+		}
+	}
+
+  /**
+   * Latch of the given page.
+   */
+	OptimisticLatch& latchFor(const PageId pageNo)
+	{
+		const std::uint64_t chunkNo = pageNo / LATCHTABLE_SIZE;
+		ChunkDirectory *chunks = getOrMake(directory_[chunkNo / LATCHTABLE_FANOUT]);
+		PaddedLatch *chunk = getOrMake(chunks->chunks[chunkNo % LATCHTABLE_FANOUT]);
+		return chunk[pageNo % LATCHTABLE_SIZE].latch;
+	}
+
+ private:
+	OptimisticLatchTable(const OptimisticLatchTable&);
+	OptimisticLatchTable& operator=(const OptimisticLatchTable&);
+
+	struct PaddedLatch
+	{
+		OptimisticLatch latch;
+		char padding[64 - sizeof(OptimisticLatch)];
+	};
+
+	struct ChunkDirectory
+	{
+		ChunkDirectory()
+		{
+			for (std::uint32_t i = 0; i < LATCHTABLE_FANOUT; i++)
+			{
+				chunks[i].store(NULL, std::memory_order_relaxed);
+			}
+		}
+
+		std::atomic<PaddedLatch*> chunks[LATCHTABLE_FANOUT];
+	};
+
+	static ChunkDirectory* make(std::atomic<ChunkDirectory*>&)
+	{
+		return new ChunkDirectory();
+	}
+
+	static PaddedLatch* make(std::atomic<PaddedLatch*>&)
+	{
+		return new PaddedLatch[LATCHTABLE_SIZE];
+	}
+
+	static void unmake(ChunkDirectory* made)
+	{
+		delete made;
+	}
+
+	static void unmake(PaddedLatch* made)
+	{
+		delete[] made;
+	}
+
+  /**
+   * Entry of a directory, made first if it is not there yet. Of threads making it at once, one wins.
+   */
+	template <class Entry>
+	static Entry* getOrMake(std::atomic<Entry*>& slot)
+	{
+		Entry* entry = slot.load(std::memory_order_acquire);
+		if (entry != NULL)
+		{
+			return entry;
+		}
+		Entry* made = make(slot);
+		if (slot.compare_exchange_strong(entry, made, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			return made;
+		}
+		unmake(made);
+		return entry;
+	}
+
+	std::atomic<ChunkDirectory*> directory_[LATCHTABLE_FANOUT];
+};
+
+}
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include "btree.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// verify_index
+// Checks the structure of an index file with BTreeIndex::verifyIndex, without
+// the base relation, which the index is only opened after it has been found to
+// be named after. Exits with 0 if no problem is found, 1 if there are problems
+// and 2 if the index cannot be opened.
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 5)
+	{
+		std::cerr << "usage: " << argv[0] << " <index file> [threads] [ring frames] [buffer pool frames]" << std::endl;
+		return 2;
+	}
+	const std::string indexName = argv[1];
+	const int numThreads = argc > 2 ? atoi(argv[2]) : VERIFY_THREADS;
+	const std::uint32_t ringFrames = argc > 3 ? atoi(argv[3]) : VERIFY_FRAMES;
+	const std::uint32_t poolFrames = argc > 4 ? atoi(argv[4]) : 4 * ringFrames;
+
+	try
+	{
+		// the key columns, and the relation the file has to be named after, are on the meta page
+		IndexMetaInfo meta;
+		{
+			BlobFile indexFile(indexName, false);
+			Page headerPage = indexFile.readPage(1);
+			memcpy(&meta, &headerPage, sizeof(meta));
+		}
+		const std::string relationName(meta.relationName, strnlen(meta.relationName, sizeof(meta.relationName)));
+		std::ostringstream expectedName;
+		expectedName << relationName << '.' << meta.attrByteOffset;
+		for (int i = 1; i < meta.numKeyColumns && i < MAX_KEY_COLUMNS; i++)
+		{
+			expectedName << '+' << meta.keyColumns[i].attrByteOffset;
+		}
+		if (meta.numKeyColumns < 1 || meta.numKeyColumns > MAX_KEY_COLUMNS || expectedName.str() != indexName)
+		{
+			std::cerr << indexName << " is not an index file, or not named after its relation and key" << std::endl;
+			return 2;
+		}
+
+		// nothing is written to the index, which is opened without concurrent inserts and without
+		// rebuilding entry counts it does not keep, and whose statistics page is only read. Its meta page
+		// says whether the left siblings are exact.
+		BTreeBuildOptions options;
+		options.cachedNodes = 0;
+		options.rebuildCounts = false;
+		BufMgr bufMgr(poolFrames);
+		std::string outIndexName;
+		std::unique_ptr<BTreeIndex> index;
+		if (meta.attrType == COMPOSITE)
+		{
+			const std::vector<KeyColumn> keyColumns(meta.keyColumns, meta.keyColumns + meta.numKeyColumns);
+			index.reset(new BTreeIndex(relationName, outIndexName, &bufMgr, keyColumns, options));
+		}
+		else
+		{
+			index.reset(new BTreeIndex(relationName, outIndexName, &bufMgr, meta.attrByteOffset, meta.attrType, options));
+		}
+
+		const IndexVerifyReport report = index->verifyIndex(numThreads, ringFrames);
+		index.reset();
+		std::cout << indexName << ": " << report.height << " levels, " << report.numNonLeafPages << " non-leaf pages, "
+				  << report.numLeafPages << " leaf pages, " << report.numPostingPages << " posting list pages, "
+				  << report.numEntries << " entries" << std::endl;
+		for (std::size_t i = 0; i < report.errors.size(); i++)
+		{
+			std::cout << report.errors[i] << std::endl;
+		}
+		std::cout << (report.ok() ? "no problems found" : "PROBLEMS FOUND") << std::endl;
+		return report.ok() ? 0 : 1;
+	}
+	catch (const BadgerDbException &e)
+	{
+		std::cerr << indexName << ": " << e.message() << std::endl;
+		return 2;
+	}
+}